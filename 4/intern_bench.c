@@ -0,0 +1,210 @@
+// Interns a stream of identifiers with many duplicates and compares the
+// memory with keeping one my_malloc copy per occurrence, then measures
+// concurrent lookups with 1 to 4 threads and str_hash against FNV-1a.
+//
+// Build: gcc -O2 -pthread intern_bench.c -o intern_bench
+// Usage: ./intern_bench [identifiers] [distinct]     (default 4000000 200000)
+#include <pthread.h>
+#include <stdlib.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "../5/malloc copy.c"
+#include "my_intern.h"
+
+#define LOOKUP_ROUNDS 4
+
+static const char* services[] = { "billing", "auth", "search", "checkout", "inventory", "gateway" };
+static const char* fields[] = { "request_id", "user", "session.token", "latency_ms", "region", "trace" };
+
+typedef struct LookupWork{
+    MyIntern* table;
+    char** names;
+    size_t count;
+    size_t found;
+    double ns;
+}LookupWork;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Identifiers like "billing.session.token.48213"; a few of them are most of the stream
+static char** make_names(size_t count, size_t distinct) {
+    char** names = malloc(count * sizeof(char*));
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < count; i++) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        // Squaring a uniform value favours the low ids
+        double u = (double)(rng >> 11) / (double)(1ULL << 53);
+        size_t id = (size_t)(u * u * (double)distinct);
+        char name[96];
+        int length = snprintf(name, sizeof(name), "%s.%s.%zu", services[id % 6], fields[(id / 6) % 6], id);
+        names[i] = malloc((size_t)length + 1);
+        memcpy(names[i], name, (size_t)length + 1);
+    }
+    return names;
+}
+
+static size_t block_footprint(void* ptr) {
+    return sizeof(MyBlockHeader) + my_usable_size(ptr);
+}
+
+static void run_memory(MyIntern* table, char** names, size_t count) {
+    double start = now_ns();
+    const char* first = NULL;
+    size_t same = 0;
+    for (size_t i = 0; i < count; i++) {
+        const char* handle = my_intern(table, names[i]);
+        if (handle == NULL) {
+            printf("Out of memory after %zu identifiers\n", i);
+            exit(1);
+        }
+        if (i == 0) {
+            first = handle;
+        }
+        same += handle == first;
+    }
+    double intern_ns = now_ns() - start;
+
+    // The same strings as one my_malloc copy each
+    char** copies = malloc(count * sizeof(char*));
+    size_t copy_bytes = 0;
+    start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        size_t length = strlen(names[i]);
+        copies[i] = my_malloc(length + 1);
+        my_memcpy(copies[i], names[i], length + 1);
+    }
+    double copy_ns = now_ns() - start;
+    for (size_t i = 0; i < count; i++) {
+        copy_bytes += block_footprint(copies[i]);
+        my_free(copies[i]);
+    }
+    free(copies);
+
+    printf("  interned %zu identifiers, %zu distinct, %zu bytes of them (%zu copies of the first)\n",
+           count, table->count, table->string_bytes, same);
+    printf("  %-30s %8.2f ns/string  %8.2f MB\n", "my_intern", intern_ns / (double)count,
+           (double)my_intern_memory(table) / 1e6);
+    printf("  %-30s %8.2f ns/string  %8.2f MB\n", "one my_malloc per occurrence", copy_ns / (double)count,
+           (double)copy_bytes / 1e6);
+}
+
+static void* lookup_worker(void* arg) {
+    LookupWork* work = arg;
+    double start = now_ns();
+    for (int round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (size_t i = 0; i < work->count; i++) {
+            work->found += my_intern_find(work->table, work->names[i]) != NULL;
+        }
+    }
+    work->ns = now_ns() - start;
+    my_ebr_thread_exit();
+    return NULL;
+}
+
+static void run_lookups(MyIntern* table, char** names, size_t count, int threads) {
+    pthread_t ids[threads];
+    LookupWork work[threads];
+    for (int t = 0; t < threads; t++) {
+        // Every thread walks its own slice of the stream
+        size_t from = count * (size_t)t / (size_t)threads, to = count * (size_t)(t + 1) / (size_t)threads;
+        work[t] = (LookupWork){ table, names + from, to - from, 0, 0 };
+        pthread_create(&ids[t], NULL, lookup_worker, &work[t]);
+    }
+    size_t found = 0, lookups = 0;
+    double slowest_ns = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+        found += work[t].found;
+        lookups += work[t].count * LOOKUP_ROUNDS;
+        slowest_ns = work[t].ns > slowest_ns ? work[t].ns : slowest_ns;
+    }
+    printf("  %d thread%s  %8.1f M lookups/s%s\n", threads, threads == 1 ? " " : "s",
+           (double)lookups / slowest_ns * 1e3, found == lookups ? "" : "  MISSING STRINGS");
+}
+
+static uint64_t fnv1a(const char* p, size_t length) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        h = (h ^ (unsigned char)p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static void run_hash(size_t length) {
+    static char data[1 << 17];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)('a' + i * 7 % 26);
+    }
+    size_t iterations = (256 << 20) / (length + 16);
+    uint64_t sink = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += fnv1a(data + ((i * 64 + (sink & 1)) & 0xffff), length);
+    }
+    double fnv_ns = now_ns() - start;
+    start = now_ns();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += str_hash(data + ((i * 64 + (sink & 1)) & 0xffff), length);
+    }
+    double hash_ns = now_ns() - start;
+    printf("  %6zu bytes  FNV-1a %7.2f ns %6.2f GB/s   str_hash %7.2f ns %6.2f GB/s%s\n", length,
+           fnv_ns / (double)iterations, (double)(length * iterations) / fnv_ns,
+           hash_ns / (double)iterations, (double)(length * iterations) / hash_ns, sink == 1 ? " " : "");
+}
+
+// Every kernel level must give the same hash, or a table would depend on the CPU
+static void check_levels(void) {
+    static char data[4096];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)(i * 131 + (i >> 5));
+    }
+    for (size_t length = 0; length <= sizeof(data); length += length < 300 ? 1 : 97) {
+        my_string_select("swar");
+        uint64_t expected = str_hash(data, length);
+        const char* impls[] = { "sse2", "avx2" };
+        for (int i = 0; i < 2; i++) {
+            if (my_string_select(impls[i]) && str_hash(data, length) != expected) {
+                printf("str_hash differs between swar and %s at %zu bytes\n", impls[i], length);
+                exit(1);
+            }
+        }
+    }
+    my_string_select(NULL);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+    size_t distinct = argc > 2 ? strtoul(argv[2], NULL, 10) : 200000;
+    count = count == 0 ? 1 : count;
+    distinct = distinct == 0 ? 1 : distinct;
+    check_levels();
+    char** names = make_names(count, distinct);
+
+    MyIntern table;
+    my_intern_init(&table);
+    printf("=== Interning (%s kernels) ===\n", my_string_impl_name());
+    run_memory(&table, names, count);
+
+    printf("\n=== my_intern_find, %d passes over the stream ===\n", LOOKUP_ROUNDS);
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        run_lookups(&table, names, count, threads);
+    }
+
+    printf("\n=== Hashing ===\n");
+    size_t lengths[] = { 8, 16, 24, 48, 256, 4096, 65000 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        run_hash(lengths[i]);
+    }
+
+    my_intern_destroy(&table);
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return 0;
+}
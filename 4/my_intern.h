@@ -0,0 +1,287 @@
+// MyIntern: a string interning table on the allocator in 5/"malloc copy.c".
+//
+// my_intern returns one canonical copy per distinct string, so services that
+// hold millions of copies of the same identifiers keep a single one, and two
+// handles are equal exactly when the pointers are. A handle is a plain NUL
+// terminated char* that lives until my_intern_destroy.
+//
+// The unique bytes are bump allocated from large chunks taken from the
+// long-lived page pool (my_malloc_hint with MY_HINT_LONG_LIVED), each
+// string behind a 4-byte length, instead of one my_malloc and its block
+// header per string.
+//
+// The table is open addressing over groups of 16 slots. One byte per slot,
+// the tag, holds 7 bits of the hash (0 means empty) and lives in an array of
+// its own, so a probe compares a whole group of tags with one SSE2 compare
+// and only touches a string when its tag matches. There are no deletions,
+// so a group with an empty slot ends the probe.
+//
+// Lookups take no lock. They run inside my_ebr_enter/my_ebr_exit, so a
+// reader can keep probing slots the table just outgrew; the grown table
+// retires the old slots through my_ebr_retire. Inserts take the table's
+// mutex and publish the string before its tag. Threads that used a table
+// should call my_ebr_thread_exit before they exit.
+//
+// Include this after "malloc copy.c": it needs MyAllocHint and the EBR calls.
+#ifndef MY_INTERN_H
+#define MY_INTERN_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "my_string_compare.h"
+#include "my_string_hash.h"
+#include "../5/my_memory.h"
+
+#define MY_INTERN_GROUP 16                 // slots whose tags are compared at once
+#define MY_INTERN_MIN_SLOTS 64
+#define MY_INTERN_CHUNK (256 << 10)        // bytes of strings per chunk
+#define MY_INTERN_OWN_CHUNK (MY_INTERN_CHUNK / 8) // longer strings get a chunk of their own
+
+typedef struct MyInternSlots{
+    size_t mask;                 // slot count - 1; the count is a power of two
+    _Atomic(const char*)* strings;
+    _Atomic uint8_t tags[];      // 0x80 | 7 hash bits, 0 when empty
+}MyInternSlots;
+
+typedef struct MyIntern{
+    _Atomic(MyInternSlots*) slots;
+    pthread_mutex_t lock;        // held by inserts; lookups never take it
+    size_t count;                // distinct strings
+    char* chunks;                // newest chunk; each starts with a pointer to the previous one
+    size_t chunk_used;
+    size_t chunk_size;
+    size_t chunk_bytes;          // bytes taken from the allocator for strings
+    size_t string_bytes;         // of those, bytes of string data and terminators
+}MyIntern;
+
+static inline uint8_t my_intern_tag(uint64_t hash) {
+    return (uint8_t)(0x80 | (hash & 0x7f));
+}
+
+static inline size_t my_intern_length(const char* handle) {
+    uint32_t length;
+    __builtin_memcpy(&length, handle - sizeof(length), sizeof(length));
+    return length;
+}
+
+// Bit i set when slot group + i holds `tag`, and in *empty when it is empty
+static inline uint32_t my_intern_match(const MyInternSlots* slots, size_t group, uint8_t tag, uint32_t* empty) {
+    const uint8_t* tags = (const uint8_t*)slots->tags + group;
+#if defined(__x86_64__) && !defined(__SANITIZE_THREAD__)
+    // A plain load is enough here: a tag only picks slots to check, and the
+    // string pointer is loaded with acquire before it is used. ThreadSanitizer
+    // cannot know that, so it gets the byte loads below.
+    __m128i group_tags = _mm_loadu_si128((const __m128i*)tags);
+    *empty = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group_tags, _mm_setzero_si128()));
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group_tags, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t matches = 0;
+    *empty = 0;
+    for (int i = 0; i < MY_INTERN_GROUP; i++) {
+        uint8_t t = atomic_load_explicit(&slots->tags[group + i], memory_order_relaxed);
+        matches |= (uint32_t)(t == tag) << i;
+        *empty |= (uint32_t)(t == 0) << i;
+    }
+    return matches;
+#endif
+}
+
+// The interned copy of the `length` bytes at p in `slots`, or NULL
+static inline const char* my_intern_probe(const MyInternSlots* slots, const char* p, size_t length, uint64_t hash) {
+    uint8_t tag = my_intern_tag(hash);
+    size_t group = (size_t)(hash >> 7) & slots->mask & ~(size_t)(MY_INTERN_GROUP - 1);
+    for (;;) {
+        uint32_t empty;
+        uint32_t matches = my_intern_match(slots, group, tag, &empty);
+        while (matches != 0) {
+            size_t slot = group + (size_t)__builtin_ctz(matches);
+            matches &= matches - 1;
+            const char* candidate = atomic_load_explicit(&slots->strings[slot], memory_order_acquire);
+            if (candidate != NULL && my_intern_length(candidate) == length &&
+                str_memcmp_impls[str_level](candidate, p, length) == 0) {
+                return candidate;
+            }
+        }
+        if (empty != 0) {
+            return NULL;
+        }
+        group = (group + MY_INTERN_GROUP) & slots->mask;
+    }
+}
+
+static inline MyInternSlots* my_intern_slots_new(size_t count) {
+    MyInternSlots* slots = my_malloc_hint(sizeof(MyInternSlots) + count + count * sizeof(const char*),
+                                          MY_HINT_LONG_LIVED);
+    if (slots == NULL) {
+        return NULL;
+    }
+    slots->mask = count - 1;
+    slots->strings = (_Atomic(const char*)*)((char*)slots->tags + count); // count is a multiple of 8
+    my_memset((void*)slots->tags, 0, count);
+    return slots;
+}
+
+// Places a string known to be absent; only called with the lock held
+static inline void my_intern_place(MyInternSlots* slots, const char* string, uint64_t hash) {
+    size_t group = (size_t)(hash >> 7) & slots->mask & ~(size_t)(MY_INTERN_GROUP - 1);
+    for (;;) {
+        uint32_t empty;
+        my_intern_match(slots, group, 0x80, &empty);
+        if (empty != 0) {
+            size_t slot = group + (size_t)__builtin_ctz(empty);
+            atomic_store_explicit(&slots->strings[slot], string, memory_order_release);
+            atomic_store_explicit(&slots->tags[slot], my_intern_tag(hash), memory_order_release);
+            return;
+        }
+        group = (group + MY_INTERN_GROUP) & slots->mask;
+    }
+}
+
+static inline void my_intern_init(MyIntern* table) {
+    memset(table, 0, sizeof(*table));
+    pthread_mutex_init(&table->lock, NULL);
+    atomic_store(&table->slots, my_intern_slots_new(MY_INTERN_MIN_SLOTS));
+}
+
+// Frees every string and the slots. No other thread may still use the table
+// or any handle it returned, and the caller must not be inside my_ebr_enter.
+// Slot arrays this thread retired while growing the table are freed here
+// too; those retired by other threads go at their next my_ebr_flush or
+// my_ebr_thread_exit.
+static inline void my_intern_destroy(MyIntern* table) {
+    my_ebr_flush();
+    while (table->chunks != NULL) {
+        char* previous;
+        __builtin_memcpy(&previous, table->chunks, sizeof(previous));
+        my_free(table->chunks);
+        table->chunks = previous;
+    }
+    my_free(atomic_load(&table->slots));
+    atomic_store(&table->slots, NULL);
+    pthread_mutex_destroy(&table->lock);
+}
+
+// Doubles the slots once they are 7/8 full. Readers still probing the old
+// ones are safe until they leave their critical section.
+static inline bool my_intern_grow(MyIntern* table) {
+    MyInternSlots* old = atomic_load_explicit(&table->slots, memory_order_relaxed);
+    size_t count = old->mask + 1;
+    if (table->count + 1 <= count - count / 8) {
+        return true;
+    }
+    MyInternSlots* slots = my_intern_slots_new(count * 2);
+    if (slots == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char* string = atomic_load_explicit(&old->strings[i], memory_order_relaxed);
+        if (atomic_load_explicit(&old->tags[i], memory_order_relaxed) != 0) {
+            my_intern_place(slots, string, str_hash(string, my_intern_length(string)));
+        }
+    }
+    atomic_store_explicit(&table->slots, slots, memory_order_release);
+    my_ebr_retire(old);
+    return true;
+}
+
+// Writes the length, the bytes and a terminator at `at`; returns the handle
+static inline const char* my_intern_write(MyIntern* table, char* at, const char* p, size_t length) {
+    uint32_t stored = (uint32_t)length;
+    __builtin_memcpy(at, &stored, sizeof(stored));
+    char* string = at + sizeof(stored);
+    my_memcpy(string, p, length);
+    string[length] = '\0';
+    table->string_bytes += length + 1;
+    return string;
+}
+
+// Copies the bytes into the current chunk, starting a new one when it is
+// full. A long string gets a chunk of its own, linked in behind the current
+// one so the space left there is not wasted.
+static inline const char* my_intern_store(MyIntern* table, const char* p, size_t length) {
+    size_t need = (sizeof(uint32_t) + length + 1 + 3) & ~(size_t)3;
+    if (table->chunks != NULL && table->chunk_used + need <= table->chunk_size) {
+        const char* string = my_intern_write(table, table->chunks + table->chunk_used, p, length);
+        table->chunk_used += need;
+        return string;
+    }
+    bool own = need > MY_INTERN_OWN_CHUNK;
+    size_t size = own ? sizeof(char*) + need : MY_INTERN_CHUNK;
+    char* chunk = my_malloc_hint(size, MY_HINT_LONG_LIVED);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    table->chunk_bytes += size;
+    if (own && table->chunks != NULL) {
+        char* previous;
+        __builtin_memcpy(&previous, table->chunks, sizeof(previous));
+        __builtin_memcpy(chunk, &previous, sizeof(previous));
+        __builtin_memcpy(table->chunks, &chunk, sizeof(chunk));
+        return my_intern_write(table, chunk + sizeof(char*), p, length);
+    }
+    __builtin_memcpy(chunk, &table->chunks, sizeof(char*));
+    table->chunks = chunk;
+    table->chunk_size = size;
+    table->chunk_used = sizeof(char*) + need;
+    return my_intern_write(table, chunk + sizeof(char*), p, length);
+}
+
+// The interned copy of the `length` bytes at p, or NULL if it was never
+// interned. Safe from any number of threads, alongside inserts.
+static inline const char* my_intern_find_bytes(MyIntern* table, const char* p, size_t length) {
+    uint64_t hash = str_hash(p, length);
+    my_ebr_enter();
+    const char* found = my_intern_probe(atomic_load_explicit(&table->slots, memory_order_acquire), p, length, hash);
+    my_ebr_exit();
+    return found;
+}
+
+static inline const char* my_intern_find(MyIntern* table, const char* s) {
+    return my_intern_find_bytes(table, s, str_len_impls[str_level](s));
+}
+
+// The canonical copy of the `length` bytes at p, storing it on first use.
+// Returns NULL if the allocator is out of memory or length is 4 GB or more.
+static inline const char* my_intern_bytes(MyIntern* table, const char* p, size_t length) {
+    if (length > UINT32_MAX) {
+        return NULL;
+    }
+    uint64_t hash = str_hash(p, length);
+    my_ebr_enter();
+    const char* found = my_intern_probe(atomic_load_explicit(&table->slots, memory_order_acquire), p, length, hash);
+    my_ebr_exit();
+    if (found != NULL) {
+        return found;
+    }
+
+    pthread_mutex_lock(&table->lock);
+    // Another thread may have stored it since; the lock keeps the slots still
+    MyInternSlots* slots = atomic_load_explicit(&table->slots, memory_order_relaxed);
+    found = my_intern_probe(slots, p, length, hash);
+    if (found == NULL && my_intern_grow(table)) {
+        found = my_intern_store(table, p, length);
+        if (found != NULL) {
+            my_intern_place(atomic_load_explicit(&table->slots, memory_order_relaxed), found, hash);
+            table->count++;
+        }
+    }
+    pthread_mutex_unlock(&table->lock);
+    return found;
+}
+
+static inline const char* my_intern(MyIntern* table, const char* s) {
+    return my_intern_bytes(table, s, str_len_impls[str_level](s));
+}
+
+// Bytes the table holds: string chunks plus slots
+static inline size_t my_intern_memory(MyIntern* table) {
+    pthread_mutex_lock(&table->lock);
+    MyInternSlots* slots = atomic_load_explicit(&table->slots, memory_order_relaxed);
+    size_t bytes = table->chunk_bytes + sizeof(MyInternSlots) + (slots->mask + 1) * (1 + sizeof(const char*));
+    pthread_mutex_unlock(&table->lock);
+    return bytes;
+}
+
+#endif
@@ -0,0 +1,252 @@
+// MyScan: runs a routine over a large text file in parallel, one chunk of
+// whole lines per call, straight out of a read-only mapping of the file.
+//
+// my_scan_open maps the file and tells the kernel it will be read front to
+// back (MADV_SEQUENTIAL), so it reads ahead further and drops pages behind
+// the reader. my_scan_parallel cuts the mapping into chunks of up to
+// MY_SCAN_CHUNK bytes. A chunk ends just after the first '\n' at or past its
+// nominal end, so no line is split between two chunks. Each worker can find
+// both ends of any chunk on its own with memchr, so threads claim chunks
+// from an atomic counter and need no coordination beyond that. A worker
+// asks for its whole chunk to be read in (MADV_WILLNEED) before it starts.
+// Threads working on different parts of the file would otherwise defeat the
+// readahead, which follows one position per open file.
+//
+// Nothing is copied: the routine gets a pointer into the mapping, and
+// counts, searches or splits it with the kernels of this directory. When a
+// flush routine is given, it runs after each chunk, in file order, so
+// output gathered per chunk comes out the way a sequential pass would
+// print it. my_scan_count counts a byte (e.g. '\n') at the widest level.
+#ifndef MY_SCAN_H
+#define MY_SCAN_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "my_string_search.h"
+
+#define MY_SCAN_CHUNK (32 << 20)        // largest chunk handed to a worker
+#define MY_SCAN_CHUNK_MIN (1 << 20)     // smallest, however many threads there are
+#define MY_SCAN_MAX_THREADS 64
+
+typedef size_t (*MyCountFn)(const char* p, size_t n, int c);
+
+// ---- Word at a time (any CPU) ----
+static size_t count_swar(const char* p, size_t n, int c) {
+    const uint64_t pattern = (unsigned char)c * STR_ONES;
+    size_t count = 0, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        count += (size_t)__builtin_popcountll(str_eq_bytes(str_load64(p + i), pattern));
+    }
+    for (; i < n; i++) {
+        count += p[i] == (char)c;
+    }
+    return count;
+}
+
+#if defined(__x86_64__)
+// ---- SSE2 ----
+// Each compare gives -1 per hit; subtracting it counts in 16 byte lanes,
+// which psadbw sums before they can overflow
+static size_t count_sse2(const char* p, size_t n, int c) {
+    const __m128i pattern = _mm_set1_epi8((char)c);
+    size_t count = 0, i = 0;
+    while (n - i >= 16) {
+        size_t steps = (n - i) / 16 < 255 ? (n - i) / 16 : 255;
+        __m128i lanes = _mm_setzero_si128();
+        for (size_t s = 0; s < steps; s++, i += 16) {
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), pattern));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si64(sums) + (size_t)_mm_extract_epi16(sums, 4);
+    }
+    return count + count_swar(p + i, n - i, c);
+}
+
+// ---- AVX2 ----
+__attribute__((target("avx2")))
+static size_t count_avx2(const char* p, size_t n, int c) {
+    const __m256i pattern = _mm256_set1_epi8((char)c);
+    size_t count = 0, i = 0;
+    while (n - i >= 32) {
+        size_t steps = (n - i) / 32 < 255 ? (n - i) / 32 : 255;
+        __m256i lanes = _mm256_setzero_si256();
+        for (size_t s = 0; s < steps; s++, i += 32) {
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + i)), pattern));
+        }
+        __m256i sums = _mm256_sad_epu8(lanes, _mm256_setzero_si256());
+        __m128i pairs = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        count += (size_t)_mm_cvtsi128_si64(pairs) + (size_t)_mm_extract_epi64(pairs, 1);
+    }
+    return count + count_swar(p + i, n - i, c);
+}
+#endif
+
+static const MyCountFn str_count_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(count_swar, count_sse2, count_avx2);
+
+// Number of bytes equal to c in the n bytes at p
+static inline size_t my_scan_count(const char* p, size_t n, int c) {
+    return str_count_impls[str_level](p, n, c);
+}
+
+// ---- Mapping ----
+typedef struct MyScanFile{
+    const char* data;        // NULL when the file is empty
+    size_t size;
+}MyScanFile;
+
+// Maps the regular file at path read-only. Returns false with errno set if
+// it cannot be opened or mapped.
+static inline bool my_scan_open(MyScanFile* file, const char* path) {
+    file->data = NULL;
+    file->size = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    // Pipes and devices cannot be mapped
+    struct stat st;
+    int error = fstat(fd, &st) != 0 ? errno : S_ISREG(st.st_mode) ? 0 : ENODEV;
+    void* data = NULL;
+    if (error == 0 && st.st_size > 0) {
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            error = errno;
+        } else {
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+        }
+    }
+    // The mapping keeps the file open
+    close(fd);
+    if (error != 0) {
+        errno = error;
+        return false;
+    }
+    file->data = data;
+    file->size = data == NULL ? 0 : (size_t)st.st_size;
+    return true;
+}
+
+static inline void my_scan_close(MyScanFile* file) {
+    if (file->data != NULL) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+// ---- Parallel scan ----
+// Called with a chunk of whole lines; the last chunk may lack its final '\n'.
+// `thread` is in [0, threads) and tells apart per-thread state.
+typedef void (*MyScanChunkFn)(void* context, int thread, const char* data, size_t size);
+// Called in file order, after the chunk `thread` last scanned
+typedef void (*MyScanFlushFn)(void* context, int thread);
+
+typedef struct MyScan{
+    const char* data;
+    size_t size;
+    size_t chunk_size;
+    size_t chunk_count;
+    MyScanChunkFn scan;
+    MyScanFlushFn flush;
+    void* context;
+    _Atomic size_t next_chunk;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    size_t next_flush;       // chunk whose flush goes next
+}MyScan;
+
+typedef struct MyScanWorker{
+    MyScan* scan;
+    int thread;
+}MyScanWorker;
+
+// Where chunk i starts: after the first '\n' at or past its nominal start
+// minus one, so a chunk that would start on a line start keeps it
+static inline size_t str_scan_boundary(const MyScan* scan, size_t i) {
+    if (i == 0) {
+        return 0;
+    }
+    if (i >= scan->chunk_count) {
+        return scan->size;
+    }
+    size_t at = i * scan->chunk_size - 1;
+    const char* newline = str_memchr_impls[str_level](scan->data + at, '\n', scan->size - at);
+    return newline == NULL ? scan->size : (size_t)(newline - scan->data) + 1;
+}
+
+static void* str_scan_worker(void* arg) {
+    MyScanWorker* worker = arg;
+    MyScan* scan = worker->scan;
+    for (;;) {
+        size_t chunk = atomic_fetch_add(&scan->next_chunk, 1);
+        if (chunk >= scan->chunk_count) {
+            break;
+        }
+        size_t start = str_scan_boundary(scan, chunk);
+        size_t end = str_scan_boundary(scan, chunk + 1);
+        if (end > start) {
+            size_t page_start = start & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+            madvise((void*)(scan->data + page_start), end - page_start, MADV_WILLNEED);
+        }
+        // A line longer than a chunk leaves the chunks it covers empty
+        scan->scan(scan->context, worker->thread, scan->data + start, end - start);
+
+        if (scan->flush != NULL) {
+            pthread_mutex_lock(&scan->lock);
+            while (scan->next_flush != chunk) {
+                pthread_cond_wait(&scan->turn, &scan->lock);
+            }
+            pthread_mutex_unlock(&scan->lock);
+            scan->flush(scan->context, worker->thread);
+            pthread_mutex_lock(&scan->lock);
+            scan->next_flush++;
+            pthread_cond_broadcast(&scan->turn);
+            pthread_mutex_unlock(&scan->lock);
+        }
+    }
+    return NULL;
+}
+
+// Runs scan_chunk over the `size` bytes at data with up to `threads`
+// threads, counting the caller, and flush (if not NULL) after each chunk in
+// file order. Returns the number of threads that took part.
+static inline int my_scan_parallel(const char* data, size_t size, int threads, MyScanChunkFn scan_chunk,
+                                   MyScanFlushFn flush, void* context) {
+    threads = threads < 1 ? 1 : threads > MY_SCAN_MAX_THREADS ? MY_SCAN_MAX_THREADS : threads;
+    // A few chunks per thread, so one slow chunk does not hold up the end
+    size_t chunk_size = size / ((size_t)threads * 4);
+    chunk_size = chunk_size < MY_SCAN_CHUNK_MIN ? MY_SCAN_CHUNK_MIN : chunk_size > MY_SCAN_CHUNK ? MY_SCAN_CHUNK : chunk_size;
+    MyScan scan = { .data = data, .size = size, .chunk_size = chunk_size, .chunk_count = (size + chunk_size - 1) / chunk_size,
+                    .scan = scan_chunk, .flush = flush, .context = context, .next_flush = 0 };
+    atomic_init(&scan.next_chunk, 0);
+    if ((size_t)threads > scan.chunk_count) {
+        threads = scan.chunk_count == 0 ? 1 : (int)scan.chunk_count;
+    }
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.turn, NULL);
+
+    MyScanWorker workers[MY_SCAN_MAX_THREADS];
+    pthread_t ids[MY_SCAN_MAX_THREADS];
+    int started = 1;
+    for (; started < threads; started++) {
+        workers[started] = (MyScanWorker){ &scan, started };
+        if (pthread_create(&ids[started], NULL, str_scan_worker, &workers[started]) != 0) {
+            break;
+        }
+    }
+    workers[0] = (MyScanWorker){ &scan, 0 };
+    str_scan_worker(&workers[0]);
+    for (int t = 1; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    pthread_cond_destroy(&scan.turn);
+    pthread_mutex_destroy(&scan.lock);
+    return started;
+}
+
+#endif
@@ -0,0 +1,276 @@
+// MySplitter: splits a buffer on a set of delimiter bytes and hands back
+// each field as a view (pointer and length) into the buffer, so parsing a
+// record copies nothing. MySplitStream does the same for input that arrives
+// in chunks; only a field that straddles two chunks is copied, into a
+// MyString that grows to the longest such field.
+//
+// Delimiters are found 64 bytes at a time: a kernel returns one bit per
+// byte of the block that is in the set, and the splitter pops fields off
+// that mask with ctz until it runs out, so a block holding many short fields
+// costs one scan. AVX2 classifies bytes for any set with two nibble lookups
+// (vpshufb): a row of the low nibble's table holds one bit per high nibble.
+// SSE2 and the word loop compare with each delimiter and OR the results.
+//
+// Fields follow strsep: n delimiters make n + 1 fields, empty ones
+// included, so "a,,b," gives "a", "", "b" and "".
+//
+// MySplitStream keeps its carry in a MyString, so include this after
+// "malloc copy.c" or link the allocator built with -DMY_MALLOC_NO_MAIN
+// when using it.
+#ifndef MY_SPLIT_H
+#define MY_SPLIT_H
+
+#include "my_string_search.h"
+#include "my_string.h"
+
+#define MY_SPLIT_MAX_DELIMITERS 16
+#define MY_SPLIT_BLOCK 64
+
+typedef struct MyStringView{
+    const char* data;
+    size_t length;
+}MyStringView;
+
+typedef struct MySplitClass{
+    uint8_t low_rows[16];    // bit h of entry l: byte (h << 4 | l) is a delimiter, h < 8
+    uint8_t high_rows[16];   // the same for h >= 8, bit h - 8
+    uint64_t bitmap[4];      // the set, one bit per byte value
+    uint8_t delimiters[MY_SPLIT_MAX_DELIMITERS];
+    int count;
+}MySplitClass;
+
+// Bit i set when p[i] is a delimiter, for the 64 bytes at p
+typedef uint64_t (*MySplitBlockFn)(const MySplitClass* set, const char* p);
+
+typedef struct MySplitter{
+    MySplitClass set;
+    const char* data;
+    size_t length;
+    size_t start;            // where the next field starts
+    size_t block;            // offset of the block `marks` belongs to
+    uint64_t marks;          // delimiters of that block not returned yet
+    int delimiter;           // byte that ended the last field, -1 at the end of the buffer
+    bool done;
+}MySplitter;
+
+// Builds the class for the bytes of the NUL terminated `delimiters`.
+// Returns false if there are more than MY_SPLIT_MAX_DELIMITERS distinct ones.
+static inline bool my_split_class_init(MySplitClass* set, const char* delimiters) {
+    memset(set, 0, sizeof(*set));
+    for (const unsigned char* d = (const unsigned char*)delimiters; *d != '\0'; d++) {
+        if ((set->bitmap[*d >> 6] >> (*d & 63) & 1) != 0) {
+            continue;
+        }
+        if (set->count == MY_SPLIT_MAX_DELIMITERS) {
+            return false;
+        }
+        set->bitmap[*d >> 6] |= 1ULL << (*d & 63);
+        set->delimiters[set->count++] = *d;
+        if (*d < 0x80) {
+            set->low_rows[*d & 15] |= (uint8_t)(1 << (*d >> 4));
+        } else {
+            set->high_rows[*d & 15] |= (uint8_t)(1 << ((*d >> 4) - 8));
+        }
+    }
+    return true;
+}
+
+static inline bool my_split_class_has(const MySplitClass* set, unsigned char c) {
+    return (set->bitmap[c >> 6] >> (c & 63) & 1) != 0;
+}
+
+// ---- Word at a time (any CPU) ----
+static uint64_t split_block_swar(const MySplitClass* set, const char* p) {
+    uint64_t marks = 0;
+    for (int word = 0; word < MY_SPLIT_BLOCK / 8; word++) {
+        uint64_t v = str_load64(p + 8 * word);
+        uint64_t found = 0;
+        for (int i = 0; i < set->count; i++) {
+            found |= str_eq_bytes(v, set->delimiters[i] * STR_ONES);
+        }
+        marks |= str_mark_bits(found) << (8 * word);
+    }
+    return marks;
+}
+
+#if defined(__x86_64__)
+// ---- SSE2, one compare per delimiter ----
+static uint64_t split_block_sse2(const MySplitClass* set, const char* p) {
+    __m128i v[4], found[4];
+    for (int k = 0; k < 4; k++) {
+        v[k] = _mm_loadu_si128((const __m128i*)(p + 16 * k));
+        found[k] = _mm_setzero_si128();
+    }
+    for (int i = 0; i < set->count; i++) {
+        __m128i d = _mm_set1_epi8((char)set->delimiters[i]);
+        for (int k = 0; k < 4; k++) {
+            found[k] = _mm_or_si128(found[k], _mm_cmpeq_epi8(v[k], d));
+        }
+    }
+    return (uint64_t)(unsigned)_mm_movemask_epi8(found[0]) | (uint64_t)(unsigned)_mm_movemask_epi8(found[1]) << 16 |
+           (uint64_t)(unsigned)_mm_movemask_epi8(found[2]) << 32 | (uint64_t)(unsigned)_mm_movemask_epi8(found[3]) << 48;
+}
+
+// ---- AVX2, nibble lookup for any set ----
+__attribute__((target("avx2")))
+static inline uint32_t str_split_classify_avx2(__m256i v, __m256i low_rows, __m256i high_rows) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i bit_of_high = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                 1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    __m256i low = _mm256_and_si256(v, nibble);
+    // Rows for the low nibble; the sign bit of v picks the table for high nibbles 8-15
+    __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(low_rows, low), _mm256_shuffle_epi8(high_rows, low), v);
+    __m256i bit = _mm256_shuffle_epi8(bit_of_high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+    return (uint32_t)_mm256_movemask_epi8(hit);
+}
+
+__attribute__((target("avx2")))
+static uint64_t split_block_avx2(const MySplitClass* set, const char* p) {
+    __m256i low_rows = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->low_rows));
+    __m256i high_rows = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->high_rows));
+    uint64_t low = str_split_classify_avx2(_mm256_loadu_si256((const __m256i*)p), low_rows, high_rows);
+    uint64_t high = str_split_classify_avx2(_mm256_loadu_si256((const __m256i*)(p + 32)), low_rows, high_rows);
+    return low | high << 32;
+}
+#endif
+
+static const MySplitBlockFn str_split_block_impls[STR_LEVEL_COUNT] =
+    STR_X86_KERNELS(split_block_swar, split_block_sse2, split_block_avx2);
+
+// Delimiter marks of the block at `offset`; a short last block is copied
+// out first so nothing past the buffer is read
+static inline uint64_t my_split_load(const MySplitter* splitter, size_t offset) {
+    size_t left = splitter->length - offset;
+    if (left >= MY_SPLIT_BLOCK) {
+        return str_split_block_impls[str_level](&splitter->set, splitter->data + offset);
+    }
+    char tail[MY_SPLIT_BLOCK] = { 0 };
+    memcpy(tail, splitter->data + offset, left);
+    return str_split_block_impls[str_level](&splitter->set, tail) & ((1ULL << left) - 1);
+}
+
+// Starts splitting the `length` bytes at data, which must outlive the fields
+static inline void my_split_reset(MySplitter* splitter, const char* data, size_t length) {
+    splitter->data = data;
+    splitter->length = length;
+    splitter->start = 0;
+    splitter->block = 0;
+    splitter->marks = length == 0 ? 0 : my_split_load(splitter, 0);
+    splitter->delimiter = -1;
+    splitter->done = false;
+}
+
+static inline bool my_split_init(MySplitter* splitter, const char* delimiters, const char* data, size_t length) {
+    if (!my_split_class_init(&splitter->set, delimiters)) {
+        return false;
+    }
+    my_split_reset(splitter, data, length);
+    return true;
+}
+
+// The next field, and in splitter->delimiter the byte that ended it (-1 for
+// the last field). Returns false once every field has been returned.
+static inline bool my_split_next(MySplitter* splitter, MyStringView* field) {
+    while (splitter->marks == 0) {
+        splitter->block += MY_SPLIT_BLOCK;
+        if (splitter->block >= splitter->length) {
+            if (splitter->done) {
+                return false;
+            }
+            field->data = splitter->data + splitter->start;
+            field->length = splitter->length - splitter->start;
+            splitter->start = splitter->length;
+            splitter->delimiter = -1;
+            splitter->done = true;
+            return true;
+        }
+        splitter->marks = my_split_load(splitter, splitter->block);
+    }
+    size_t end = splitter->block + (size_t)__builtin_ctzll(splitter->marks);
+    splitter->marks &= splitter->marks - 1;
+    field->data = splitter->data + splitter->start;
+    field->length = end - splitter->start;
+    splitter->start = end + 1;
+    splitter->delimiter = (unsigned char)splitter->data[end];
+    return true;
+}
+
+// ---- Input in chunks ----
+typedef struct MySplitStream{
+    MySplitter chunk;        // over the chunk being split
+    MyString carry;          // the start of a field that began in an earlier chunk
+    bool carry_returned;     // carry was handed out and is cleared on the next call
+    bool finished;
+    bool failed;             // out of memory growing the carry; fields since are not to be trusted
+}MySplitStream;
+
+static inline bool my_split_stream_init(MySplitStream* stream, const char* delimiters) {
+    my_string_init(&stream->carry);
+    stream->carry_returned = false;
+    stream->finished = false;
+    stream->failed = false;
+    return my_split_init(&stream->chunk, delimiters, NULL, 0);
+}
+
+static inline void my_split_stream_free(MySplitStream* stream) {
+    my_string_free(&stream->carry);
+}
+
+// Hands over the next chunk. It must stay valid until the fields it yields
+// have been used and the following chunk is fed.
+static inline void my_split_stream_feed(MySplitStream* stream, const char* data, size_t length) {
+    my_split_reset(&stream->chunk, data, length);
+}
+
+// The next field that is complete in the input fed so far. Returns false
+// when the chunk is used up, or if the allocator is out of memory, which
+// also sets stream->failed: check it once the input is done. A field that
+// reached into the chunk from earlier ones is returned from the carry
+// buffer, valid until the next call; the others point into their chunk.
+static inline bool my_split_stream_next(MySplitStream* stream, MyStringView* field) {
+    if (stream->carry_returned) {
+        my_string_clear(&stream->carry);
+        stream->carry_returned = false;
+    }
+    MyStringView piece;
+    if (stream->chunk.data == NULL || !my_split_next(&stream->chunk, &piece)) {
+        return false;
+    }
+    if (stream->chunk.delimiter < 0) {
+        // Runs to the end of the chunk: keep it for the next one
+        my_split_reset(&stream->chunk, NULL, 0);
+        if (!my_string_append_bytes(&stream->carry, piece.data, piece.length)) {
+            stream->failed = true;
+        }
+        return false;
+    }
+    if (stream->carry.length == 0) {
+        *field = piece;
+        return true;
+    }
+    if (!my_string_append_bytes(&stream->carry, piece.data, piece.length)) {
+        stream->failed = true;
+        return false;
+    }
+    field->data = my_string_cstr(&stream->carry);
+    field->length = stream->carry.length;
+    stream->carry_returned = true;
+    return true;
+}
+
+// After the last chunk: the field that runs to the end of the input, which
+// is empty when the input ends with a delimiter. Returns false once it has
+// been returned.
+static inline bool my_split_stream_finish(MySplitStream* stream, MyStringView* field) {
+    if (stream->finished) {
+        return false;
+    }
+    stream->finished = true;
+    field->data = my_string_cstr(&stream->carry);
+    field->length = stream->carry.length;
+    stream->carry_returned = true;
+    return true;
+}
+
+#endif
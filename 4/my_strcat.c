@@ -1,48 +1,30 @@
 
 #include <stdio.h>
+#include "my_string_kernels.h"
 
 char* my_strcat(const char* src, char* dest){
-    char* init = dest;
-    while(*dest!='\0'){
-        dest++;
-    }
-    while(*src!='\0'){
-        *dest=*src;
-        dest++;
-        src++;
-    }
-    *dest = '\0';
-    return init;
+    char* end = dest + str_len_impls[str_level](dest);
+    str_copy_impls[str_level](end, src, SIZE_MAX);
+    return dest;
 }
 
-char* my_strncat(const char* src, char* dest, int size){
-    //append src in size to dest string
-    char* init = dest;
-    int counter = 0;
-    while(*dest!='\0'){
-        dest++;
-    }
-    while(*src!='\0'){
-        if(counter>=size){
-            break;
-        }
-        *dest=*src;
-        dest++;
-        src++;
-        counter++;
-    }
-    *dest = '\0';
-    return init;
+char* my_strncat(const char* src, char* dest, size_t size){
+    //append src in size to dest string; returns the new terminator, so
+    //appending the next piece there does not rescan dest
+    char* end = dest + str_len_impls[str_level](dest);
+    return str_copy_impls[str_level](end, src, size);
 }
 
+#ifndef MY_STRING_NO_MAIN
 int main()
 {
     char stri[] = "Dunia";
     char dest[20] = "Halo ";
-    int c =0;
     
     my_strcat(stri, dest);
-    my_strncat(stri, dest, 9);
+    char* end = my_strncat(stri, dest, 9);
+    my_strncat("!!!", end, 1);
     
     printf("%s", dest);
-}
\ No newline at end of file
+}
+#endif
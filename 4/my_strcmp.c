@@ -1,19 +1,46 @@
 
 #include <stdio.h>
+#include "my_string_compare.h"
 
+// Negative, zero or positive as a sorts before, equal to or after b,
+// comparing bytes as unsigned char like the C library
 int my_strcmp(const char* a, const char* b){
-    while(*a!='\0'|*b!='\0'){
-        if(*b - *a !=0){
-            return *b - *a;
-        }
-        a++;
-        b++;
-    }
-    return 0;
+    return str_ncmp_impls[str_level](a, b, SIZE_MAX);
+}
+
+int my_strncmp(const char* a, const char* b, size_t size){
+    return str_ncmp_impls[str_level](a, b, size);
+}
+
+int my_memcmp(const void* a, const void* b, size_t size){
+    return str_memcmp_impls[str_level](a, b, size);
 }
 
+// results[i] = my_strcmp(key, candidates[i]) for count candidates
+void my_strcmp_many(const char* key, const char* const* candidates, size_t count, int* results){
+    str_cmp_many(key, candidates, count, results);
+}
+
+// results[i] = my_strcmp(a[i], b[i]) for count pairs
+void my_strcmp_pairs(const char* const* a, const char* const* b, size_t count, int* results){
+    str_cmp_pairs(a, b, count, results);
+}
+
+#ifndef MY_STRING_NO_MAIN
 int main(int argc, char const *argv[])
 {
-    /* code */
+    (void)argc;
+    (void)argv;
+    const char* key = "Halo Dunia";
+    const char* candidates[] = { "Halo", "Halo Dunia", "Halo dunia", "Hal\xe9" };
+    int results[4];
+    
+    my_strcmp_many(key, candidates, 4, results);
+    for (int i = 0; i < 4; i++) {
+        printf("my_strcmp(\"%s\", \"%s\") = %d\n", key, candidates[i], results[i]);
+    }
+    printf("my_strncmp(..., 4) = %d, my_memcmp(..., 6) = %d (%s)\n",
+           my_strncmp(key, candidates[2], 4), my_memcmp(key, candidates[2], 6), my_string_impl_name());
     return 0;
 }
+#endif
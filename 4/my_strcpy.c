@@ -1,46 +1,29 @@
 #include <stdio.h>
+#include "my_string_kernels.h"
 
 char* my_strcpy(const char* src, char* dest){
     // Copy src string to dest
-    char* init = dest;
-    while(*src!='\0'){
-        *dest= *src;
-        // printf("%c", *dest);
-        dest++;
-        src++;
-        // printf("%c", *src);
-    }
-    *dest = *src;
-    // printf("%c", *dest);
-    return init;
+    str_copy_impls[str_level](dest, src, SIZE_MAX);
+    return dest;
 }
 
-char* my_strncpy(const char* src, char* dest, int size){
-    // Copy n size char from src string to dest.
-    char* init = dest;
-    int counter=0;
-    while(*src!='\0'){
-        *dest = *src;
-        dest++;
-        src++;
-        counter++;
-        if(counter>=size){
-            break;
-        }
-    }
-    *dest = '\0'; // null terminator
-    return init;
+char* my_strncpy(const char* src, char* dest, size_t size){
+    // Copy at most size chars from src to dest, always null terminated.
+    // Returns the terminator, so the next piece can be copied right there.
+    return str_copy_impls[str_level](dest, src, size);
 }
 
 
+#ifndef MY_STRING_NO_MAIN
 int main()
 {
     char stri[] = "Dunia";
     char dest[20] = "Halo ";
-    int c =0;
     
     my_strcpy(stri, dest);
-    my_strncpy(stri,dest, 9);
+    char* end = my_strncpy(stri, dest, 9);
+    end = my_strncpy(" Raya", end, 3);
     
     printf("%s", dest);
-}
\ No newline at end of file
+}
+#endif
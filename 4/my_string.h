@@ -0,0 +1,162 @@
+// MyString: a string that knows its length and capacity, on the allocator
+// in 5/"malloc copy.c".
+//
+// my_strcat has to find the end of dest before every append, so building a
+// string from n pieces costs O(n^2), and dest never grows. MyString keeps
+// the length, so appends, copies and compares never scan for the
+// terminator. Strings of up to MY_STRING_INLINE bytes live inside the
+// struct and allocate nothing. Longer ones grow geometrically, first in
+// place through my_try_expand and otherwise by moving, so n appends cost
+// O(n) with O(log n) growths. The bytes stay NUL terminated, and
+// my_string_cstr can be passed to anything that takes a char*.
+//
+// Either include this after "malloc copy.c", or link the allocator built
+// with -DMY_MALLOC_NO_MAIN.
+#ifndef MY_STRING_H
+#define MY_STRING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "my_string_compare.h"
+#include "../5/my_memory.h"
+
+void* my_malloc(size_t size);
+void my_free(void* ptr);
+size_t my_usable_size(void* ptr);
+size_t my_try_expand(void* ptr, size_t min_size, size_t preferred_size);
+
+#define MY_STRING_INLINE 15 // bytes stored in the struct, plus the terminator
+
+typedef struct MyString{
+    size_t length;
+    size_t capacity;    // bytes it can hold without growing, not counting the terminator
+    union {
+        char* heap;     // when capacity > MY_STRING_INLINE
+        char small[MY_STRING_INLINE + 1];
+    };
+}MyString;
+
+static inline bool my_string_is_small(const MyString* string) {
+    return string->capacity <= MY_STRING_INLINE;
+}
+
+static inline char* my_string_data(MyString* string) {
+    return my_string_is_small(string) ? string->small : string->heap;
+}
+
+static inline const char* my_string_cstr(const MyString* string) {
+    return my_string_is_small(string) ? string->small : string->heap;
+}
+
+static inline void my_string_init(MyString* string) {
+    string->length = 0;
+    string->capacity = MY_STRING_INLINE;
+    string->small[0] = '\0';
+}
+
+static inline void my_string_free(MyString* string) {
+    if (!my_string_is_small(string)) {
+        my_free(string->heap);
+    }
+    my_string_init(string);
+}
+
+static inline void my_string_clear(MyString* string) {
+    string->length = 0;
+    my_string_data(string)[0] = '\0';
+}
+
+// Makes room for at least `min_capacity` bytes. Aims for double the current
+// capacity, in place if the allocator can, and only copies otherwise.
+static inline bool my_string_reserve(MyString* string, size_t min_capacity) {
+    if (min_capacity <= string->capacity) {
+        return true;
+    }
+    if (min_capacity == SIZE_MAX) {
+        return false;
+    }
+    size_t preferred = string->capacity * 2;
+    if (preferred < min_capacity) {
+        preferred = min_capacity;
+    }
+
+    // The allocation also holds the terminator
+    if (!my_string_is_small(string)) {
+        size_t expanded = my_try_expand(string->heap, min_capacity + 1, preferred + 1);
+        if (expanded != 0) {
+            string->capacity = expanded - 1;
+            return true;
+        }
+    }
+
+    char* heap = my_malloc(preferred + 1);
+    if (heap == NULL) {
+        return false;
+    }
+    my_memcpy(heap, my_string_data(string), string->length + 1);
+    if (!my_string_is_small(string)) {
+        my_free(string->heap);
+    }
+    string->heap = heap;
+    string->capacity = my_usable_size(heap) - 1;
+    return true;
+}
+
+// `bytes` may point into the string itself, e.g. to append it to itself
+static inline bool my_string_append_bytes(MyString* string, const void* bytes, size_t size) {
+    if (size > string->capacity - string->length) {
+        const char* data = my_string_data(string);
+        size_t offset = (size_t)((const char*)bytes - data);
+        bool inside = (const char*)bytes >= data && offset <= string->length;
+        if (string->length + size < string->length || !my_string_reserve(string, string->length + size)) {
+            return false;
+        }
+        if (inside) {
+            bytes = my_string_data(string) + offset;
+        }
+    }
+    char* end = my_string_data(string) + string->length;
+    my_memmove(end, bytes, size);
+    end[size] = '\0';
+    string->length += size;
+    return true;
+}
+
+static inline bool my_string_append(MyString* string, const char* cstr) {
+    return my_string_append_bytes(string, cstr, str_len_impls[str_level](cstr));
+}
+
+static inline bool my_string_append_string(MyString* string, const MyString* other) {
+    return my_string_append_bytes(string, my_string_cstr(other), other->length);
+}
+
+static inline bool my_string_set_bytes(MyString* string, const void* bytes, size_t size) {
+    string->length = 0;
+    return my_string_append_bytes(string, bytes, size);
+}
+
+// Like my_strcpy: src first, then dest. Keeps dest's buffer when it is big enough.
+static inline bool my_string_copy(const MyString* src, MyString* dest) {
+    if (src == dest) {
+        return true;
+    }
+    return my_string_set_bytes(dest, my_string_cstr(src), src->length);
+}
+
+// Same sign convention as my_strcmp; embedded NUL bytes compare like any other
+static inline int my_string_compare(const MyString* a, const MyString* b) {
+    size_t common = a->length < b->length ? a->length : b->length;
+    int result = str_memcmp_impls[str_level](my_string_cstr(a), my_string_cstr(b), common);
+    if (result != 0 || a->length == b->length) {
+        return result;
+    }
+    return a->length < b->length ? -1 : 1;
+}
+
+// Strings of different lengths are told apart without reading them
+static inline bool my_string_equals(const MyString* a, const MyString* b) {
+    return a->length == b->length &&
+           str_memcmp_impls[str_level](my_string_cstr(a), my_string_cstr(b), a->length) == 0;
+}
+
+#endif
@@ -0,0 +1,292 @@
+// Comparison kernels behind my_strcmp, my_strncmp and my_memcmp, on the
+// dispatch in my_string_kernels.h.
+//
+// Bytes compare as unsigned char, like the C library. A step loads one
+// vector (or word) from each string at the same offset and builds a mask
+// of the positions where they differ or where the first string ends. The
+// lowest set bit is the answer. The two strings are rarely aligned the
+// same way, so the loads are unaligned. A step that would cross a page
+// boundary in either string is done one byte at a time instead, because
+// the next page may not be mapped.
+#ifndef MY_STRING_COMPARE_H
+#define MY_STRING_COMPARE_H
+
+#include "my_string_kernels.h"
+
+#define STR_PAGE_SIZE 4096
+#define STR_LOWS 0x7f7f7f7f7f7f7f7fULL
+
+typedef int (*MyStrncmpFn)(const char* a, const char* b, size_t n);
+typedef int (*MyMemcmpFn)(const void* a, const void* b, size_t n);
+
+static inline int str_byte_diff(const char* a, const char* b, size_t i) {
+    return (int)(unsigned char)a[i] - (int)(unsigned char)b[i];
+}
+
+// Bytes from a and from b that can be read before either crosses a page
+static inline size_t str_page_room(const char* a, const char* b) {
+    size_t room_a = STR_PAGE_SIZE - ((uintptr_t)a & (STR_PAGE_SIZE - 1));
+    size_t room_b = STR_PAGE_SIZE - ((uintptr_t)b & (STR_PAGE_SIZE - 1));
+    return room_a < room_b ? room_a : room_b;
+}
+
+// One byte of a compare near a page end: sets *result and returns true
+// once the strings are decided
+static inline bool str_cmp_byte(const char* a, const char* b, size_t i, int* result) {
+    *result = str_byte_diff(a, b, i);
+    return *result != 0 || a[i] == '\0';
+}
+
+// ---- Word at a time (any CPU) ----
+// High bit of every byte of v that is not zero; exact, unlike str_zero_bytes
+static inline uint64_t str_nonzero_bytes(uint64_t v) {
+    return (((v & STR_LOWS) + STR_LOWS) | v) & STR_HIGHS;
+}
+
+// Compares at most n bytes, stopping after the terminator of a. Words run
+// up to the nearest page end of either string; the few bytes right before
+// it go one at a time.
+STR_NO_ASAN
+static int strncmp_swar(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+    int result;
+    while (i < n) {
+        size_t page_end = i + str_page_room(a + i, b + i);
+        if (page_end - i < 8) {
+            if (str_cmp_byte(a, b, i, &result)) {
+                return result;
+            }
+            i++;
+            continue;
+        }
+        for (; i + 8 <= page_end; i += 8) {
+            uint64_t x = str_load64(a + i), y = str_load64(b + i);
+            uint64_t stop = str_nonzero_bytes(x ^ y) | (~str_nonzero_bytes(x) & STR_HIGHS);
+            if (n - i < 8) {
+                stop |= 1ULL << ((n - i) * 8 + 7);
+            }
+            if (stop != 0) {
+                size_t at = i + (size_t)__builtin_ctzll(stop) / 8;
+                return at == n ? 0 : str_byte_diff(a, b, at);
+            }
+        }
+    }
+    return 0;
+}
+
+// The first differing byte of two words, as a signed difference
+static inline int str_word_diff(uint64_t x, uint64_t y) {
+    unsigned shift = (unsigned)__builtin_ctzll(x ^ y) & ~7u;
+    return (int)((x >> shift) & 0xff) - (int)((y >> shift) & 0xff);
+}
+
+static int memcmp_swar(const void* av, const void* bv, size_t n) {
+    const char* a = av;
+    const char* b = bv;
+    if (n < 8) {
+        for (size_t i = 0; i < n; i++) {
+            if (a[i] != b[i]) {
+                return str_byte_diff(a, b, i);
+            }
+        }
+        return 0;
+    }
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t x = str_load64(a + i), y = str_load64(b + i);
+        if (x != y) {
+            return str_word_diff(x, y);
+        }
+    }
+    // The last word overlaps bytes already known to be equal
+    uint64_t x = str_load64(a + n - 8), y = str_load64(b + n - 8);
+    return x != y ? str_word_diff(x, y) : 0;
+}
+
+#if defined(__x86_64__)
+// ---- SSE2, 16 byte vectors ----
+// min(x, x == y) is zero exactly where the strings differ or x ends, so
+// two vectors are checked with one compare against zero.
+STR_NO_ASAN
+static int strncmp_sse2(const char* a, const char* b, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    int result;
+    while (i < n) {
+        size_t page_end = i + str_page_room(a + i, b + i);
+        if (page_end - i < 16) {
+            if (str_cmp_byte(a, b, i, &result)) {
+                return result;
+            }
+            i++;
+            continue;
+        }
+        size_t end = n < page_end ? n : page_end;
+        for (; i + 32 <= end; i += 32) {
+            __m128i x0 = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i x1 = _mm_loadu_si128((const __m128i*)(a + i + 16));
+            __m128i v0 = _mm_min_epu8(x0, _mm_cmpeq_epi8(x0, _mm_loadu_si128((const __m128i*)(b + i))));
+            __m128i v1 = _mm_min_epu8(x1, _mm_cmpeq_epi8(x1, _mm_loadu_si128((const __m128i*)(b + i + 16))));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v0, v1), zero)) != 0) {
+                unsigned stop = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v0, zero)) |
+                                (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v1, zero)) << 16;
+                return str_byte_diff(a, b, i + (size_t)__builtin_ctz(stop));
+            }
+        }
+        // The last vector before the page end, or the one the bound ends in
+        for (; i < n && i + 16 <= page_end; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i v = _mm_min_epu8(x, _mm_cmpeq_epi8(x, _mm_loadu_si128((const __m128i*)(b + i))));
+            unsigned stop = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+            if (n - i < 16) {
+                stop |= 1u << (n - i);
+            }
+            if (stop != 0) {
+                size_t at = i + (size_t)__builtin_ctz(stop);
+                return at == n ? 0 : str_byte_diff(a, b, at);
+            }
+        }
+    }
+    return 0;
+}
+
+static int memcmp_sse2(const void* av, const void* bv, size_t n) {
+    const char* a = av;
+    const char* b = bv;
+    if (n < 16) {
+        return memcmp_swar(a, b, n);
+    }
+    for (size_t i = 0;; i += 16) {
+        if (i + 16 > n) {
+            i = n - 16; // last vector, overlapping the previous one
+        }
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        unsigned differ = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffffu;
+        if (differ != 0) {
+            return str_byte_diff(a, b, i + (size_t)__builtin_ctz(differ));
+        }
+        if (i + 16 == n) {
+            return 0;
+        }
+    }
+}
+
+// ---- AVX2, 32 byte vectors ----
+__attribute__((target("avx2"))) STR_NO_ASAN
+static int strncmp_avx2(const char* a, const char* b, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    int result;
+    while (i < n) {
+        size_t page_end = i + str_page_room(a + i, b + i);
+        if (page_end - i < 32) {
+            if (str_cmp_byte(a, b, i, &result)) {
+                return result;
+            }
+            i++;
+            continue;
+        }
+        size_t end = n < page_end ? n : page_end;
+        for (; i + 64 <= end; i += 64) {
+            __m256i x0 = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i x1 = _mm256_loadu_si256((const __m256i*)(a + i + 32));
+            __m256i v0 = _mm256_min_epu8(x0, _mm256_cmpeq_epi8(x0, _mm256_loadu_si256((const __m256i*)(b + i))));
+            __m256i v1 = _mm256_min_epu8(x1, _mm256_cmpeq_epi8(x1, _mm256_loadu_si256((const __m256i*)(b + i + 32))));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v0, v1), zero)) != 0) {
+                uint64_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v0, zero)) |
+                                (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v1, zero)) << 32;
+                return str_byte_diff(a, b, i + (size_t)__builtin_ctzll(stop));
+            }
+        }
+        for (; i < n && i + 32 <= page_end; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i v = _mm256_min_epu8(x, _mm256_cmpeq_epi8(x, _mm256_loadu_si256((const __m256i*)(b + i))));
+            uint64_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+            if (n - i < 32) {
+                stop |= 1ULL << (n - i);
+            }
+            if (stop != 0) {
+                size_t at = i + (size_t)__builtin_ctzll(stop);
+                return at == n ? 0 : str_byte_diff(a, b, at);
+            }
+        }
+    }
+    return 0;
+}
+
+__attribute__((target("avx2")))
+static int memcmp_avx2(const void* av, const void* bv, size_t n) {
+    const char* a = av;
+    const char* b = bv;
+    if (n < 32) {
+        return memcmp_sse2(a, b, n);
+    }
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                        _mm256_loadu_si256((const __m256i*)(b + i)));
+        __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i + 32)),
+                                        _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) != 0xffffffffu) {
+            uint64_t differ = ~((uint32_t)_mm256_movemask_epi8(eq0) |
+                                (uint64_t)(uint32_t)_mm256_movemask_epi8(eq1) << 32);
+            return str_byte_diff(a, b, i + (size_t)__builtin_ctzll(differ));
+        }
+    }
+    // At most two more vectors, the last one overlapping
+    for (;; i += 32) {
+        if (i + 32 > n) {
+            i = n - 32;
+        }
+        uint32_t differ = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)))) ^ 0xffffffffu;
+        if (differ != 0) {
+            return str_byte_diff(a, b, i + (size_t)__builtin_ctz(differ));
+        }
+        if (i + 32 >= n) {
+            return 0;
+        }
+    }
+}
+#endif
+
+static const MyStrncmpFn str_ncmp_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(strncmp_swar, strncmp_sse2, strncmp_avx2);
+static const MyMemcmpFn str_memcmp_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(memcmp_swar, memcmp_sse2, memcmp_avx2);
+
+// ---- Batches ----
+// How many entries ahead the batch loops prefetch; the strings are
+// usually scattered over the heap, so the pointer chase is what costs.
+#define STR_BATCH_PREFETCH 8
+
+// results[i] = strcmp(key, candidates[i]). The kernel and the key's
+// length are looked up once, a candidate whose first byte differs is
+// settled without a call, and no compare reads past the key's terminator.
+static inline void str_cmp_many(const char* key, const char* const* candidates, size_t count, int* results) {
+    MyStrncmpFn compare = str_ncmp_impls[str_level];
+    size_t key_size = str_len_impls[str_level](key) + 1;
+    unsigned char first = (unsigned char)key[0];
+    for (size_t i = 0; i < count; i++) {
+        if (i + STR_BATCH_PREFETCH < count) {
+            __builtin_prefetch(candidates[i + STR_BATCH_PREFETCH]);
+        }
+        const char* candidate = candidates[i];
+        unsigned char other = (unsigned char)candidate[0];
+        results[i] = first != other || first == '\0' ? (int)first - (int)other
+                                                     : compare(key, candidate, key_size);
+    }
+}
+
+// results[i] = strcmp(a[i], b[i])
+static inline void str_cmp_pairs(const char* const* a, const char* const* b, size_t count, int* results) {
+    MyStrncmpFn compare = str_ncmp_impls[str_level];
+    for (size_t i = 0; i < count; i++) {
+        if (i + STR_BATCH_PREFETCH < count) {
+            __builtin_prefetch(a[i + STR_BATCH_PREFETCH]);
+            __builtin_prefetch(b[i + STR_BATCH_PREFETCH]);
+        }
+        results[i] = compare(a[i], b[i], SIZE_MAX);
+    }
+}
+
+#endif
@@ -0,0 +1,167 @@
+// 64-bit hash of a byte string, on the dispatch in my_string_kernels.h.
+//
+// Up to 32 bytes, which covers most identifiers, the bytes are loaded as
+// two or four overlapping words and mixed with 64x64->128 bit multiplies.
+// Longer inputs run through four 64-bit accumulators, 32 bytes (a stripe)
+// per step: each lane adds the product of the low and high halves of
+// (data ^ secret) and the data of its neighbour lane, the way XXH3 does.
+// That is two multiplies per 16 bytes with SSE2 and four per instruction
+// with AVX2. Every 8 stripes the accumulators are scrambled, so the order
+// of the stripes matters. All levels compute the same value, so a table
+// built with one kernel can be searched with another.
+#ifndef MY_STRING_HASH_H
+#define MY_STRING_HASH_H
+
+#include "my_string_kernels.h"
+
+#define STR_HASH_STRIPE 32
+#define STR_HASH_BLOCK_STRIPES 8
+#define STR_HASH_LAST_SECRET 3      // secret word the overlapping last stripe starts at
+#define STR_HASH_SCRAMBLE_SECRET 8  // secret words of the scramble
+#define STR_HASH_PRIME32 0x9E3779B1u
+#define STR_HASH_PRIME64 0x165667919E3779F9ULL
+
+// Stripe s of a block is keyed with words s to s + 3
+static const uint64_t str_hash_secret[12] = {
+    0x138dda71e3658967ULL, 0x0a3aee4966660879ULL, 0x963f389496afcff5ULL, 0xe338e970dc1afab9ULL,
+    0xa27056f73a818b9fULL, 0x26e7581a84060c47ULL, 0x89bc15a5956f5c71ULL, 0xcd6a4292f27baaf9ULL,
+    0x07c7ac10083d0a2fULL, 0xc87ced6d11a64ad3ULL, 0xa1d551dc51f10901ULL, 0x0df0fadcd3393b0fULL,
+};
+
+typedef void (*MyHashStripesFn)(uint64_t acc[4], const char* p, size_t stripes, const char* last);
+
+static inline uint64_t str_hash_mix(uint64_t a, uint64_t b) {
+    unsigned __int128 product = (unsigned __int128)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t str_hash_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= STR_HASH_PRIME64;
+    return h ^ (h >> 32);
+}
+
+// ---- Word at a time (any CPU) ----
+static inline void str_hash_stripe_swar(uint64_t acc[4], const char* p, const uint64_t* secret) {
+    for (int lane = 0; lane < 4; lane++) {
+        uint64_t data = str_load64(p + 8 * lane);
+        uint64_t keyed = data ^ secret[lane];
+        acc[lane] += (keyed & 0xffffffffu) * (keyed >> 32);
+        acc[lane ^ 1] += data;
+    }
+}
+
+static void hash_stripes_swar(uint64_t acc[4], const char* p, size_t stripes, const char* last) {
+    for (size_t s = 0; s < stripes; s++, p += STR_HASH_STRIPE) {
+        str_hash_stripe_swar(acc, p, str_hash_secret + s % STR_HASH_BLOCK_STRIPES);
+        if (s % STR_HASH_BLOCK_STRIPES == STR_HASH_BLOCK_STRIPES - 1) {
+            for (int lane = 0; lane < 4; lane++) {
+                uint64_t x = acc[lane] ^ (acc[lane] >> 47) ^ str_hash_secret[STR_HASH_SCRAMBLE_SECRET + lane];
+                acc[lane] = x * STR_HASH_PRIME32;
+            }
+        }
+    }
+    str_hash_stripe_swar(acc, last, str_hash_secret + STR_HASH_LAST_SECRET);
+}
+
+#if defined(__x86_64__)
+// ---- SSE2, two lanes per vector ----
+static inline __m128i str_hash_stripe_sse2(__m128i acc, const char* p, const uint64_t* secret) {
+    __m128i data = _mm_loadu_si128((const __m128i*)p);
+    __m128i keyed = _mm_xor_si128(data, _mm_loadu_si128((const __m128i*)secret));
+    __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+    __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm_add_epi64(acc, _mm_add_epi64(product, swapped));
+}
+
+// (x ^ x >> 47 ^ key) * PRIME32, the 64-bit product from two 32-bit ones
+static inline __m128i str_hash_scramble_sse2(__m128i acc, const uint64_t* secret) {
+    const __m128i prime = _mm_set1_epi32((int)STR_HASH_PRIME32);
+    __m128i x = _mm_xor_si128(_mm_xor_si128(acc, _mm_srli_epi64(acc, 47)), _mm_loadu_si128((const __m128i*)secret));
+    __m128i low = _mm_mul_epu32(x, prime);
+    __m128i high = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+    return _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+}
+
+static void hash_stripes_sse2(uint64_t acc[4], const char* p, size_t stripes, const char* last) {
+    __m128i a = _mm_loadu_si128((const __m128i*)acc);
+    __m128i b = _mm_loadu_si128((const __m128i*)(acc + 2));
+    for (size_t s = 0; s < stripes; s++, p += STR_HASH_STRIPE) {
+        const uint64_t* secret = str_hash_secret + s % STR_HASH_BLOCK_STRIPES;
+        a = str_hash_stripe_sse2(a, p, secret);
+        b = str_hash_stripe_sse2(b, p + 16, secret + 2);
+        if (s % STR_HASH_BLOCK_STRIPES == STR_HASH_BLOCK_STRIPES - 1) {
+            a = str_hash_scramble_sse2(a, str_hash_secret + STR_HASH_SCRAMBLE_SECRET);
+            b = str_hash_scramble_sse2(b, str_hash_secret + STR_HASH_SCRAMBLE_SECRET + 2);
+        }
+    }
+    a = str_hash_stripe_sse2(a, last, str_hash_secret + STR_HASH_LAST_SECRET);
+    b = str_hash_stripe_sse2(b, last + 16, str_hash_secret + STR_HASH_LAST_SECRET + 2);
+    _mm_storeu_si128((__m128i*)acc, a);
+    _mm_storeu_si128((__m128i*)(acc + 2), b);
+}
+
+// ---- AVX2, all four lanes in one vector ----
+__attribute__((target("avx2")))
+static inline __m256i str_hash_stripe_avx2(__m256i acc, const char* p, const uint64_t* secret) {
+    __m256i data = _mm256_loadu_si256((const __m256i*)p);
+    __m256i keyed = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i*)secret));
+    __m256i product = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+    __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+    return _mm256_add_epi64(acc, _mm256_add_epi64(product, swapped));
+}
+
+__attribute__((target("avx2")))
+static void hash_stripes_avx2(uint64_t acc[4], const char* p, size_t stripes, const char* last) {
+    const __m256i prime = _mm256_set1_epi32((int)STR_HASH_PRIME32);
+    __m256i a = _mm256_loadu_si256((const __m256i*)acc);
+    for (size_t s = 0; s < stripes; s++, p += STR_HASH_STRIPE) {
+        a = str_hash_stripe_avx2(a, p, str_hash_secret + s % STR_HASH_BLOCK_STRIPES);
+        if (s % STR_HASH_BLOCK_STRIPES == STR_HASH_BLOCK_STRIPES - 1) {
+            __m256i x = _mm256_xor_si256(_mm256_xor_si256(a, _mm256_srli_epi64(a, 47)),
+                _mm256_loadu_si256((const __m256i*)(str_hash_secret + STR_HASH_SCRAMBLE_SECRET)));
+            __m256i low = _mm256_mul_epu32(x, prime);
+            __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+            a = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+        }
+    }
+    a = str_hash_stripe_avx2(a, last, str_hash_secret + STR_HASH_LAST_SECRET);
+    _mm256_storeu_si256((__m256i*)acc, a);
+}
+#endif
+
+static const MyHashStripesFn str_hash_impls[STR_LEVEL_COUNT] =
+    STR_X86_KERNELS(hash_stripes_swar, hash_stripes_sse2, hash_stripes_avx2);
+
+// Hash of the `length` bytes at p
+static inline uint64_t str_hash(const char* p, size_t length) {
+    const uint64_t* secret = str_hash_secret;
+    uint64_t h = length * STR_HASH_PRIME64;
+    if (length <= 16) {
+        uint64_t a = 0, b = 0;
+        if (length >= 8) {
+            a = str_load64(p);
+            b = str_load64(p + length - 8);
+        } else if (length >= 4) {
+            a = str_load32(p);
+            b = str_load32(p + length - 4);
+        } else if (length > 0) {
+            a = (uint64_t)(unsigned char)p[0] << 16 | (uint64_t)(unsigned char)p[length / 2] << 8 |
+                (unsigned char)p[length - 1];
+        }
+        return str_hash_avalanche(h ^ str_hash_mix(a ^ secret[0], b ^ secret[1] ^ h));
+    }
+    if (length <= STR_HASH_STRIPE) {
+        h += str_hash_mix(str_load64(p) ^ secret[0], str_load64(p + 8) ^ secret[1]);
+        h += str_hash_mix(str_load64(p + length - 16) ^ secret[2], str_load64(p + length - 8) ^ secret[3]);
+        return str_hash_avalanche(h);
+    }
+    uint64_t acc[4] = { secret[4], secret[5], secret[6], secret[7] };
+    // Whole stripes, then the last 32 bytes, which may overlap the one before
+    str_hash_impls[str_level](acc, p, (length - 1) / STR_HASH_STRIPE, p + length - STR_HASH_STRIPE);
+    h += str_hash_mix(acc[0] ^ secret[8], acc[1] ^ secret[9]);
+    h += str_hash_mix(acc[2] ^ secret[10], acc[3] ^ secret[11]);
+    return str_hash_avalanche(h);
+}
+
+#endif
@@ -0,0 +1,389 @@
+// Length and copy kernels behind my_strlen, my_strcpy, my_strncpy,
+// my_strcat and my_strncat, plus the runtime dispatch the other string
+// routines in this directory share.
+//
+// At startup the widest implementation the CPU supports is picked: AVX2
+// (32 byte vectors), SSE2 (16 byte vectors) or a portable word-at-a-time
+// loop (8 bytes, little-endian). Every kernel looks for the terminator in
+// aligned chunks. An aligned chunk never straddles a page, so reading the
+// whole chunk that holds the last byte of a string can never fault, even
+// when that byte is the last one mapped. Bytes of the first chunk that come
+// before the string are masked off.
+//
+// Header-only: each file in 4/ includes it, and a program that includes
+// several of them still gets one copy.
+#ifndef MY_STRING_KERNELS_H
+#define MY_STRING_KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// The kernels read whole aligned chunks, which can run past the end of a
+// string object; that is safe (see above) but not something ASan can know.
+#if defined(__SANITIZE_ADDRESS__)
+#define STR_NO_ASAN __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define STR_NO_ASAN __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef STR_NO_ASAN
+#define STR_NO_ASAN
+#endif
+
+typedef enum MyStringLevel{
+    STR_SWAR,
+    STR_SSE2,
+    STR_AVX2,
+    STR_LEVEL_COUNT
+}MyStringLevel;
+
+static const char* const str_level_names[STR_LEVEL_COUNT] = { "swar", "sse2", "avx2" };
+
+// Set once before main; every dispatched routine indexes its table with it
+static MyStringLevel str_level = STR_SWAR;
+
+typedef size_t (*MyStrlenFn)(const char* s);
+typedef char* (*MyStpncpyFn)(char* dest, const char* src, size_t n);
+
+// ---- Word at a time (any CPU) ----
+#define STR_ONES 0x0101010101010101ULL
+#define STR_HIGHS 0x8080808080808080ULL
+
+// May-alias word, so aligned word loads are fine on any char buffer
+typedef uint64_t __attribute__((may_alias)) StrWord;
+
+// High bit set in the lowest zero byte of v. Bytes above it may be marked
+// too (borrows), so only the lowest mark is exact.
+static inline uint64_t str_zero_bytes(uint64_t v) {
+    return (v - STR_ONES) & ~v & STR_HIGHS;
+}
+
+static inline uint64_t str_load64(const char* p) { uint64_t v; __builtin_memcpy(&v, p, 8); return v; }
+static inline uint32_t str_load32(const char* p) { uint32_t v; __builtin_memcpy(&v, p, 4); return v; }
+static inline uint16_t str_load16(const char* p) { uint16_t v; __builtin_memcpy(&v, p, 2); return v; }
+static inline void str_store64(char* p, uint64_t v) { __builtin_memcpy(p, &v, 8); }
+static inline void str_store32(char* p, uint32_t v) { __builtin_memcpy(p, &v, 4); }
+static inline void str_store16(char* p, uint16_t v) { __builtin_memcpy(p, &v, 2); }
+
+// Copies n <= 32 bytes with overlapping accesses, all loads first
+static inline void str_copy_small(char* d, const char* s, size_t n) {
+    if (n >= 16) {
+        uint64_t a = str_load64(s), b = str_load64(s + 8);
+        uint64_t c = str_load64(s + n - 16), e = str_load64(s + n - 8);
+        str_store64(d, a);
+        str_store64(d + 8, b);
+        str_store64(d + n - 16, c);
+        str_store64(d + n - 8, e);
+    } else if (n >= 8) {
+        uint64_t head = str_load64(s), tail = str_load64(s + n - 8);
+        str_store64(d, head);
+        str_store64(d + n - 8, tail);
+    } else if (n >= 4) {
+        uint32_t head = str_load32(s), tail = str_load32(s + n - 4);
+        str_store32(d, head);
+        str_store32(d + n - 4, tail);
+    } else if (n >= 2) {
+        uint16_t head = str_load16(s), tail = str_load16(s + n - 2);
+        str_store16(d, head);
+        str_store16(d + n - 2, tail);
+    } else if (n == 1) {
+        *d = *s;
+    }
+}
+
+STR_NO_ASAN
+static size_t strlen_swar(const char* s) {
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)7);
+    // Bytes before s are forced to 0xff so they never look like the end
+    uint64_t v = *(const StrWord*)p | ((1ULL << (((uintptr_t)s & 7) * 8)) - 1);
+    uint64_t zeros;
+    while ((zeros = str_zero_bytes(v)) == 0) {
+        p += 8;
+        v = *(const StrWord*)p;
+    }
+    return (size_t)(p - s) + (size_t)__builtin_ctzll(zeros) / 8;
+}
+
+// Copies at most n bytes of src, then a terminator; returns a pointer to
+// that terminator. Never reads a chunk that lies wholly past src + n, so
+// src need not be terminated if it is at least n bytes long.
+STR_NO_ASAN
+static char* stpncpy_swar(char* d, const char* s, size_t n) {
+    if (n == 0) {
+        *d = '\0';
+        return d;
+    }
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)7);
+    size_t head = 8 - (size_t)(s - p);
+    uint64_t zeros = str_zero_bytes(*(const StrWord*)p | ((1ULL << ((8 - head) * 8)) - 1)) >> ((8 - head) * 8);
+    if (n < head) {
+        zeros |= 1ULL << (n * 8 + 7); // stop at n as if src ended there
+    }
+    if (zeros != 0) {
+        size_t length = (size_t)__builtin_ctzll(zeros) / 8;
+        str_copy_small(d, s, length);
+        d[length] = '\0';
+        return d + length;
+    }
+    str_copy_small(d, s, head);
+    size_t done = head;
+    for (p += 8;; p += 8, done += 8) {
+        if (done == n) {
+            d[done] = '\0';
+            return d + done;
+        }
+        uint64_t v = *(const StrWord*)p;
+        zeros = str_zero_bytes(v);
+        if (n - done < 8) {
+            zeros |= 1ULL << ((n - done) * 8 + 7);
+        }
+        if (zeros != 0) {
+            size_t length = done + (size_t)__builtin_ctzll(zeros) / 8;
+            // The last 8 bytes before the end, overlapping what is already there
+            if (length >= 8) {
+                str_store64(d + length - 8, str_load64(s + length - 8));
+            } else {
+                str_copy_small(d, s, length);
+            }
+            d[length] = '\0';
+            return d + length;
+        }
+        str_store64(d + done, v);
+    }
+}
+
+#if defined(__x86_64__)
+// ---- SSE2, 16 byte vectors ----
+STR_NO_ASAN
+static size_t strlen_sse2(const char* s) {
+    const __m128i zero = _mm_setzero_si128();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)15);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), zero));
+    mask >>= (uintptr_t)s & 15;
+    if (mask != 0) {
+        return (size_t)__builtin_ctz(mask);
+    }
+    // Single vectors up to a 64 byte boundary, then four at a time: the
+    // byte-wise minimum of the four is zero iff one of them holds a zero
+    for (p += 16; ((uintptr_t)p & 63) != 0; p += 16) {
+        mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), zero));
+        if (mask != 0) {
+            return (size_t)(p - s) + (size_t)__builtin_ctz(mask);
+        }
+    }
+    for (;; p += 64) {
+        __m128i a = _mm_load_si128((const __m128i*)p);
+        __m128i b = _mm_load_si128((const __m128i*)(p + 16));
+        __m128i c = _mm_load_si128((const __m128i*)(p + 32));
+        __m128i e = _mm_load_si128((const __m128i*)(p + 48));
+        __m128i min = _mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(c, e));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(min, zero)) != 0) {
+            uint64_t low = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) |
+                           (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(b, zero)) << 16;
+            uint64_t high = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)) |
+                            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(e, zero)) << 16;
+            return (size_t)(p - s) + (size_t)__builtin_ctzll(low | high << 32);
+        }
+    }
+}
+
+STR_NO_ASAN
+static char* stpncpy_sse2(char* d, const char* s, size_t n) {
+    if (n == 0) {
+        *d = '\0';
+        return d;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)15);
+    size_t head = 16 - (size_t)(s - p);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), zero));
+    mask >>= 16 - head;
+    if (n < head) {
+        mask |= 1u << n;
+    }
+    if (mask != 0) {
+        size_t length = (size_t)__builtin_ctz(mask);
+        str_copy_small(d, s, length);
+        d[length] = '\0';
+        return d + length;
+    }
+    str_copy_small(d, s, head);
+    size_t done = head;
+    for (p += 16;; p += 16, done += 16) {
+        if (done == n) {
+            d[done] = '\0';
+            return d + done;
+        }
+        if (((uintptr_t)p & 31) == 0 && n - done >= 32) {
+            __m128i a = _mm_load_si128((const __m128i*)p);
+            __m128i b = _mm_load_si128((const __m128i*)(p + 16));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(a, b), zero)) == 0) {
+                _mm_storeu_si128((__m128i*)(d + done), a);
+                _mm_storeu_si128((__m128i*)(d + done + 16), b);
+                p += 16;
+                done += 16;
+                continue;
+            }
+        }
+        __m128i v = _mm_load_si128((const __m128i*)p);
+        mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if (n - done < 16) {
+            mask |= 1u << (n - done);
+        }
+        if (mask != 0) {
+            size_t length = done + (size_t)__builtin_ctz(mask);
+            if (length >= 16) {
+                _mm_storeu_si128((__m128i*)(d + length - 16), _mm_loadu_si128((const __m128i*)(s + length - 16)));
+            } else {
+                str_copy_small(d, s, length);
+            }
+            d[length] = '\0';
+            return d + length;
+        }
+        _mm_storeu_si128((__m128i*)(d + done), v);
+    }
+}
+
+// ---- AVX2, 32 byte vectors ----
+__attribute__((target("avx2"))) STR_NO_ASAN
+static size_t strlen_avx2(const char* s) {
+    const __m256i zero = _mm256_setzero_si256();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)31);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), zero));
+    mask >>= (uintptr_t)s & 31;
+    if (mask != 0) {
+        return (size_t)__builtin_ctz(mask);
+    }
+    for (p += 32; ((uintptr_t)p & 127) != 0; p += 32) {
+        mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), zero));
+        if (mask != 0) {
+            return (size_t)(p - s) + (size_t)__builtin_ctz(mask);
+        }
+    }
+    for (;; p += 128) {
+        __m256i a = _mm256_load_si256((const __m256i*)p);
+        __m256i b = _mm256_load_si256((const __m256i*)(p + 32));
+        __m256i c = _mm256_load_si256((const __m256i*)(p + 64));
+        __m256i e = _mm256_load_si256((const __m256i*)(p + 96));
+        __m256i min = _mm256_min_epu8(_mm256_min_epu8(a, b), _mm256_min_epu8(c, e));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(min, zero)) != 0) {
+            uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)) |
+                           (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, zero)) << 32;
+            if (low != 0) {
+                return (size_t)(p - s) + (size_t)__builtin_ctzll(low);
+            }
+            uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, zero)) |
+                            (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(e, zero)) << 32;
+            return (size_t)(p - s) + 64 + (size_t)__builtin_ctzll(high);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) STR_NO_ASAN
+static char* stpncpy_avx2(char* d, const char* s, size_t n) {
+    if (n == 0) {
+        *d = '\0';
+        return d;
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)31);
+    size_t head = 32 - (size_t)(s - p);
+    uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), zero));
+    mask >>= 32 - head;
+    if (n < head) {
+        mask |= 1ULL << n;
+    }
+    if (mask != 0) {
+        size_t length = (size_t)__builtin_ctzll(mask);
+        str_copy_small(d, s, length);
+        d[length] = '\0';
+        return d + length;
+    }
+    str_copy_small(d, s, head);
+    size_t done = head;
+    for (p += 32;; p += 32, done += 32) {
+        if (done == n) {
+            d[done] = '\0';
+            return d + done;
+        }
+        // Two vectors per step from a 64 byte boundary on (both in one page)
+        if (((uintptr_t)p & 63) == 0 && n - done >= 64) {
+            __m256i a = _mm256_load_si256((const __m256i*)p);
+            __m256i b = _mm256_load_si256((const __m256i*)(p + 32));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(a, b), zero)) == 0) {
+                _mm256_storeu_si256((__m256i*)(d + done), a);
+                _mm256_storeu_si256((__m256i*)(d + done + 32), b);
+                p += 32;
+                done += 32;
+                continue;
+            }
+        }
+        __m256i v = _mm256_load_si256((const __m256i*)p);
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if (n - done < 32) {
+            mask |= 1ULL << (n - done);
+        }
+        if (mask != 0) {
+            size_t length = done + (size_t)__builtin_ctzll(mask);
+            if (length >= 32) {
+                _mm256_storeu_si256((__m256i*)(d + length - 32), _mm256_loadu_si256((const __m256i*)(s + length - 32)));
+            } else {
+                str_copy_small(d, s, length);
+            }
+            d[length] = '\0';
+            return d + length;
+        }
+        _mm256_storeu_si256((__m256i*)(d + done), v);
+    }
+}
+#define STR_X86_KERNELS(swar, sse2, avx2) { swar, sse2, avx2 }
+#else
+#define STR_X86_KERNELS(swar, sse2, avx2) { swar, swar, swar }
+#endif
+
+// ---- Runtime dispatch ----
+// Per-routine tables indexed by str_level; without x86 every entry is the
+// word-at-a-time version.
+static const MyStrlenFn str_len_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(strlen_swar, strlen_sse2, strlen_avx2);
+static const MyStpncpyFn str_copy_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(stpncpy_swar, stpncpy_sse2, stpncpy_avx2);
+
+static bool str_level_supported(MyStringLevel level) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (level == STR_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    return true; // SSE2 is part of x86-64
+#else
+    return level == STR_SWAR;
+#endif
+}
+
+// Forces one implementation ("avx2", "sse2" or "swar"), or the best one for
+// NULL. Returns false if the CPU does not support it. Meant for benchmarks
+// and tests; startup already picks the best one.
+static inline bool my_string_select(const char* name) {
+    for (int level = STR_LEVEL_COUNT - 1; level >= 0; level--) {
+        bool wanted = name == NULL || __builtin_strcmp(name, str_level_names[level]) == 0;
+        if (wanted && str_level_supported((MyStringLevel)level)) {
+            str_level = (MyStringLevel)level;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline const char* my_string_impl_name(void) {
+    return str_level_names[str_level];
+}
+
+__attribute__((constructor)) static void str_detect_level(void) {
+    my_string_select(NULL);
+}
+
+#endif
@@ -0,0 +1,644 @@
+// Search kernels behind my_strchr, my_strrchr, my_memchr and my_strstr, on
+// the dispatch in my_string_kernels.h.
+//
+// The character searches work like strlen: aligned chunks, the bytes
+// before the start masked off, and a mask of the positions that hold the
+// character or the terminator. my_strstr filters candidate positions 64 at
+// a time by the first and the last byte of the needle and checks only
+// those with memcmp. A needle whose first and last bytes are everywhere in
+// the haystack (say "aaa...ab" in "aaaa...") would make that quadratic, so
+// once the checks cost more than twice the bytes passed, the search goes
+// on with Two-Way, which is linear for any input.
+#ifndef MY_STRING_SEARCH_H
+#define MY_STRING_SEARCH_H
+
+#include "my_string_compare.h"
+
+typedef char* (*MyStrchrFn)(const char* s, int c);
+typedef void* (*MyMemchrFn)(const void* s, int c, size_t n);
+// Bit i set if p[i] is the needle's first byte and p[i + m - 1] its last,
+// for the 64 positions from the 64 byte aligned p
+typedef uint64_t (*MyStrstrBlockFn)(const char* p, size_t m, unsigned char first, unsigned char last);
+
+// ---- Word at a time (any CPU) ----
+// High bit of every byte of v that equals the matching byte of pattern
+static inline uint64_t str_eq_bytes(uint64_t v, uint64_t pattern) {
+    return ~str_nonzero_bytes(v ^ pattern) & STR_HIGHS;
+}
+
+// One bit per byte of an str_eq_bytes mark, low byte first
+static inline uint64_t str_mark_bits(uint64_t marks) {
+    return ((marks >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+// Keeps only the marks (one bit per byte position, `width` positions per
+// chunk) strictly below the lowest terminator mark
+static inline uint64_t str_marks_before(uint64_t marks, uint64_t zeros) {
+    return zeros == 0 ? marks : marks & ((zeros & (0 - zeros)) - 1);
+}
+
+STR_NO_ASAN
+static char* strchr_swar(const char* s, int c) {
+    uint64_t pattern = (unsigned char)c * STR_ONES;
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)7);
+    uint64_t v = *(const StrWord*)p;
+    uint64_t stop = (str_eq_bytes(v, 0) | str_eq_bytes(v, pattern)) >> (((uintptr_t)s & 7) * 8)
+                                                                      << (((uintptr_t)s & 7) * 8);
+    while (stop == 0) {
+        p += 8;
+        v = *(const StrWord*)p;
+        stop = str_eq_bytes(v, 0) | str_eq_bytes(v, pattern);
+    }
+    p += __builtin_ctzll(stop) / 8;
+    return *p == (char)c ? (char*)p : NULL;
+}
+
+STR_NO_ASAN
+static char* strrchr_swar(const char* s, int c) {
+    uint64_t pattern = (unsigned char)c * STR_ONES;
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)7);
+    unsigned skip = ((uintptr_t)s & 7) * 8;
+    const char* last = NULL;
+    uint64_t last_marks = 0;
+    for (;; p += 8, skip = 0) {
+        uint64_t v = *(const StrWord*)p;
+        uint64_t zeros = str_eq_bytes(v, 0) >> skip << skip;
+        uint64_t marks = str_marks_before(str_eq_bytes(v, pattern) >> skip << skip, zeros);
+        if (marks != 0) {
+            last = p;
+            last_marks = marks;
+        }
+        if (zeros != 0) {
+            break;
+        }
+    }
+    if (c == '\0') {
+        return (char*)p + __builtin_ctzll(str_eq_bytes(*(const StrWord*)p, 0) >> skip << skip) / 8;
+    }
+    return last == NULL ? NULL : (char*)last + (63 - __builtin_clzll(last_marks)) / 8;
+}
+
+// Never reads a chunk that lies wholly past s + n, and stops at the first
+// match, so looking for 0 this way is a page-safe strnlen
+STR_NO_ASAN
+static void* memchr_swar(const void* sv, int c, size_t n) {
+    const char* s = sv;
+    if (n == 0) {
+        return NULL;
+    }
+    uint64_t pattern = (unsigned char)c * STR_ONES;
+    const char* end = s + n;
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)7);
+    uint64_t marks = str_eq_bytes(*(const StrWord*)p, pattern) >> (((uintptr_t)s & 7) * 8)
+                                                               << (((uintptr_t)s & 7) * 8);
+    for (;;) {
+        if ((size_t)(end - p) < 8) {
+            marks &= (1ULL << ((end - p) * 8)) - 1;
+        }
+        if (marks != 0) {
+            return (char*)p + __builtin_ctzll(marks) / 8;
+        }
+        p += 8;
+        if (p >= end) {
+            return NULL;
+        }
+        marks = str_eq_bytes(*(const StrWord*)p, pattern);
+    }
+}
+
+STR_NO_ASAN
+static uint64_t strstr_block_swar(const char* p, size_t m, unsigned char first, unsigned char last) {
+    uint64_t first_pattern = first * STR_ONES, last_pattern = last * STR_ONES;
+    uint64_t candidates = 0;
+    for (int i = 0; i < 64; i += 8) {
+        uint64_t marks = str_eq_bytes(*(const StrWord*)(p + i), first_pattern) &
+                         str_eq_bytes(str_load64(p + i + m - 1), last_pattern);
+        candidates |= str_mark_bits(marks) << i;
+    }
+    return candidates;
+}
+
+#if defined(__x86_64__)
+// ---- SSE2, 16 byte vectors ----
+// min(v ^ c, v) is zero exactly where v holds c or the terminator
+static inline unsigned str_chr_mask_sse2(__m128i v, __m128i pattern) {
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(_mm_xor_si128(v, pattern), v), _mm_setzero_si128()));
+}
+
+STR_NO_ASAN
+static char* strchr_sse2(const char* s, int c) {
+    const __m128i pattern = _mm_set1_epi8((char)c);
+    const __m128i zero = _mm_setzero_si128();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)15);
+    unsigned mask = str_chr_mask_sse2(_mm_load_si128((const __m128i*)p), pattern) >> ((uintptr_t)s & 15);
+    if (mask != 0) {
+        p = s + __builtin_ctz(mask);
+        return *p == (char)c ? (char*)p : NULL;
+    }
+    for (p += 16; ((uintptr_t)p & 63) != 0; p += 16) {
+        mask = str_chr_mask_sse2(_mm_load_si128((const __m128i*)p), pattern);
+        if (mask != 0) {
+            p += __builtin_ctz(mask);
+            return *p == (char)c ? (char*)p : NULL;
+        }
+    }
+    for (;; p += 64) {
+        __m128i a = _mm_load_si128((const __m128i*)p);
+        __m128i b = _mm_load_si128((const __m128i*)(p + 16));
+        __m128i e = _mm_load_si128((const __m128i*)(p + 32));
+        __m128i f = _mm_load_si128((const __m128i*)(p + 48));
+        __m128i a_stop = _mm_min_epu8(_mm_xor_si128(a, pattern), a);
+        __m128i b_stop = _mm_min_epu8(_mm_xor_si128(b, pattern), b);
+        __m128i e_stop = _mm_min_epu8(_mm_xor_si128(e, pattern), e);
+        __m128i f_stop = _mm_min_epu8(_mm_xor_si128(f, pattern), f);
+        __m128i min = _mm_min_epu8(_mm_min_epu8(a_stop, b_stop), _mm_min_epu8(e_stop, f_stop));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(min, zero)) != 0) {
+            uint64_t low = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a_stop, zero)) |
+                           (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(b_stop, zero)) << 16;
+            uint64_t high = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(e_stop, zero)) |
+                            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(f_stop, zero)) << 16;
+            p += __builtin_ctzll(low | high << 32);
+            return *p == (char)c ? (char*)p : NULL;
+        }
+    }
+}
+
+STR_NO_ASAN
+static char* strrchr_sse2(const char* s, int c) {
+    const __m128i pattern = _mm_set1_epi8((char)c);
+    const __m128i zero = _mm_setzero_si128();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)15);
+    unsigned skip = (uintptr_t)s & 15;
+    const char* last = NULL;
+    uint64_t last_marks = 0;
+    for (;; p += 16, skip = 0) {
+        // Four vectors at a time while none holds c or the terminator
+        while (((uintptr_t)p & 63) == 0 && skip == 0) {
+            __m128i a = _mm_load_si128((const __m128i*)p);
+            __m128i b = _mm_load_si128((const __m128i*)(p + 16));
+            __m128i e = _mm_load_si128((const __m128i*)(p + 32));
+            __m128i f = _mm_load_si128((const __m128i*)(p + 48));
+            __m128i ends = _mm_cmpeq_epi8(_mm_min_epu8(_mm_min_epu8(a, b), _mm_min_epu8(e, f)), zero);
+            __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(a, pattern), _mm_cmpeq_epi8(b, pattern)),
+                                        _mm_or_si128(_mm_cmpeq_epi8(e, pattern), _mm_cmpeq_epi8(f, pattern)));
+            if (_mm_movemask_epi8(_mm_or_si128(ends, hits)) != 0) {
+                break;
+            }
+            p += 64;
+        }
+        __m128i v = _mm_load_si128((const __m128i*)p);
+        uint64_t zeros = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) >> skip << skip;
+        uint64_t marks = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern)) >> skip << skip;
+        marks = str_marks_before(marks, zeros);
+        if (marks != 0) {
+            last = p;
+            last_marks = marks;
+        }
+        if (zeros != 0) {
+            if (c == '\0') {
+                return (char*)p + __builtin_ctzll(zeros);
+            }
+            break;
+        }
+    }
+    return last == NULL ? NULL : (char*)last + (63 - __builtin_clzll(last_marks));
+}
+
+STR_NO_ASAN
+static void* memchr_sse2(const void* sv, int c, size_t n) {
+    const char* s = sv;
+    if (n == 0) {
+        return NULL;
+    }
+    const __m128i pattern = _mm_set1_epi8((char)c);
+    const char* end = s + n;
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)15);
+    uint64_t marks = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), pattern))
+                     >> ((uintptr_t)s & 15) << ((uintptr_t)s & 15);
+    for (;;) {
+        if ((size_t)(end - p) < 16) {
+            marks &= (1ULL << (end - p)) - 1;
+        }
+        if (marks != 0) {
+            return (char*)p + __builtin_ctzll(marks);
+        }
+        p += 16;
+        if (p >= end) {
+            return NULL;
+        }
+        // Four vectors per step from a 64 byte boundary on
+        if (((uintptr_t)p & 63) == 0 && (size_t)(end - p) >= 64) {
+            __m128i a = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), pattern);
+            __m128i b = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(p + 16)), pattern);
+            __m128i e = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(p + 32)), pattern);
+            __m128i f = _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(p + 48)), pattern);
+            if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(e, f))) == 0) {
+                p += 48;
+                marks = 0;
+                continue;
+            }
+            uint64_t low = (unsigned)_mm_movemask_epi8(a) | (unsigned)_mm_movemask_epi8(b) << 16;
+            uint64_t high = (unsigned)_mm_movemask_epi8(e) | (unsigned)_mm_movemask_epi8(f) << 16;
+            return (char*)p + __builtin_ctzll(low | high << 32);
+        }
+        marks = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i*)p), pattern));
+    }
+}
+
+STR_NO_ASAN
+static uint64_t strstr_block_sse2(const char* p, size_t m, unsigned char first, unsigned char last) {
+    const __m128i first_pattern = _mm_set1_epi8((char)first);
+    const __m128i last_pattern = _mm_set1_epi8((char)last);
+    uint64_t candidates = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i hits = _mm_and_si128(
+            _mm_cmpeq_epi8(_mm_load_si128((const __m128i*)(p + i)), first_pattern),
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + m - 1)), last_pattern));
+        candidates |= (uint64_t)(unsigned)_mm_movemask_epi8(hits) << i;
+    }
+    return candidates;
+}
+
+// ---- AVX2, 32 byte vectors ----
+__attribute__((target("avx2")))
+static inline __m256i str_chr_stop_avx2(__m256i v, __m256i pattern) {
+    return _mm256_min_epu8(_mm256_xor_si256(v, pattern), v);
+}
+
+__attribute__((target("avx2"))) STR_NO_ASAN
+static char* strchr_avx2(const char* s, int c) {
+    const __m256i pattern = _mm256_set1_epi8((char)c);
+    const __m256i zero = _mm256_setzero_si256();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)31);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        str_chr_stop_avx2(_mm256_load_si256((const __m256i*)p), pattern), zero)) >> ((uintptr_t)s & 31);
+    if (mask != 0) {
+        p = s + __builtin_ctz(mask);
+        return *p == (char)c ? (char*)p : NULL;
+    }
+    // Single vectors up to a 128 byte boundary, then four at a time
+    for (p += 32; ((uintptr_t)p & 127) != 0; p += 32) {
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            str_chr_stop_avx2(_mm256_load_si256((const __m256i*)p), pattern), zero));
+        if (mask != 0) {
+            p += __builtin_ctz(mask);
+            return *p == (char)c ? (char*)p : NULL;
+        }
+    }
+    for (;; p += 128) {
+        __m256i a = str_chr_stop_avx2(_mm256_load_si256((const __m256i*)p), pattern);
+        __m256i b = str_chr_stop_avx2(_mm256_load_si256((const __m256i*)(p + 32)), pattern);
+        __m256i e = str_chr_stop_avx2(_mm256_load_si256((const __m256i*)(p + 64)), pattern);
+        __m256i f = str_chr_stop_avx2(_mm256_load_si256((const __m256i*)(p + 96)), pattern);
+        __m256i min = _mm256_min_epu8(_mm256_min_epu8(a, b), _mm256_min_epu8(e, f));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(min, zero)) != 0) {
+            uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, zero)) |
+                           (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, zero)) << 32;
+            if (low == 0) {
+                p += 64;
+                low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(e, zero)) |
+                      (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(f, zero)) << 32;
+            }
+            p += __builtin_ctzll(low);
+            return *p == (char)c ? (char*)p : NULL;
+        }
+    }
+}
+
+__attribute__((target("avx2"))) STR_NO_ASAN
+static char* strrchr_avx2(const char* s, int c) {
+    const __m256i pattern = _mm256_set1_epi8((char)c);
+    const __m256i zero = _mm256_setzero_si256();
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)31);
+    unsigned skip = (uintptr_t)s & 31;
+    const char* last = NULL;
+    uint64_t last_marks = 0;
+    for (;; p += 32, skip = 0) {
+        // Two vectors at a time while neither holds c or the terminator
+        while (((uintptr_t)p & 63) == 0 && skip == 0) {
+            __m256i a = _mm256_load_si256((const __m256i*)p);
+            __m256i b = _mm256_load_si256((const __m256i*)(p + 32));
+            __m256i ends = _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), zero);
+            __m256i hits = _mm256_or_si256(_mm256_cmpeq_epi8(a, pattern), _mm256_cmpeq_epi8(b, pattern));
+            if (_mm256_movemask_epi8(_mm256_or_si256(ends, hits)) != 0) {
+                break;
+            }
+            p += 64;
+        }
+        __m256i v = _mm256_load_si256((const __m256i*)p);
+        uint64_t zeros = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)) >> skip << skip;
+        uint64_t marks = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern)) >> skip << skip;
+        marks = str_marks_before(marks, zeros);
+        if (marks != 0) {
+            last = p;
+            last_marks = marks;
+        }
+        if (zeros != 0) {
+            if (c == '\0') {
+                return (char*)p + __builtin_ctzll(zeros);
+            }
+            break;
+        }
+    }
+    return last == NULL ? NULL : (char*)last + (63 - __builtin_clzll(last_marks));
+}
+
+__attribute__((target("avx2"))) STR_NO_ASAN
+static void* memchr_avx2(const void* sv, int c, size_t n) {
+    const char* s = sv;
+    if (n == 0) {
+        return NULL;
+    }
+    const __m256i pattern = _mm256_set1_epi8((char)c);
+    const char* end = s + n;
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)31);
+    uint64_t marks = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), pattern))
+                     >> ((uintptr_t)s & 31) << ((uintptr_t)s & 31);
+    for (;;) {
+        if ((size_t)(end - p) < 32) {
+            marks &= (1ULL << (end - p)) - 1;
+        }
+        if (marks != 0) {
+            return (char*)p + __builtin_ctzll(marks);
+        }
+        p += 32;
+        if (p >= end) {
+            return NULL;
+        }
+        // Four vectors per step from a 128 byte boundary on
+        if (((uintptr_t)p & 127) == 0 && (size_t)(end - p) >= 128) {
+            __m256i a = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), pattern);
+            __m256i b = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(p + 32)), pattern);
+            __m256i e = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(p + 64)), pattern);
+            __m256i f = _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(p + 96)), pattern);
+            if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(e, f))) == 0) {
+                p += 96;
+                marks = 0;
+                continue;
+            }
+            uint64_t hits = (uint32_t)_mm256_movemask_epi8(a) | (uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32;
+            if (hits == 0) {
+                p += 64;
+                hits = (uint32_t)_mm256_movemask_epi8(e) | (uint64_t)(uint32_t)_mm256_movemask_epi8(f) << 32;
+            }
+            return (char*)p + __builtin_ctzll(hits);
+        }
+        marks = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), pattern));
+    }
+}
+
+__attribute__((target("avx2"))) STR_NO_ASAN
+static uint64_t strstr_block_avx2(const char* p, size_t m, unsigned char first, unsigned char last) {
+    const __m256i first_pattern = _mm256_set1_epi8((char)first);
+    const __m256i last_pattern = _mm256_set1_epi8((char)last);
+    __m256i low = _mm256_and_si256(
+        _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)p), first_pattern),
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + m - 1)), last_pattern));
+    __m256i high = _mm256_and_si256(
+        _mm256_cmpeq_epi8(_mm256_load_si256((const __m256i*)(p + 32)), first_pattern),
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 31 + m)), last_pattern));
+    return (uint32_t)_mm256_movemask_epi8(low) | (uint64_t)(uint32_t)_mm256_movemask_epi8(high) << 32;
+}
+#endif
+
+static const MyStrchrFn str_chr_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(strchr_swar, strchr_sse2, strchr_avx2);
+static const MyStrchrFn str_rchr_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(strrchr_swar, strrchr_sse2, strrchr_avx2);
+static const MyMemchrFn str_memchr_impls[STR_LEVEL_COUNT] = STR_X86_KERNELS(memchr_swar, memchr_sse2, memchr_avx2);
+static const MyStrstrBlockFn str_strstr_block_impls[STR_LEVEL_COUNT] =
+    STR_X86_KERNELS(strstr_block_swar, strstr_block_sse2, strstr_block_avx2);
+
+// ---- Substring search ----
+// How far ahead of the filter the terminator is looked for: 256 bytes past
+// the needle at first, doubling up to this, so that a match close to the
+// start does not pay for a long look ahead
+#define STR_SEARCH_LOOKAHEAD 16384
+
+// Index of the first byte where a and b differ, or n; a word at a time
+static inline size_t str_mismatch(const unsigned char* a, const unsigned char* b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t differ = str_load64((const char*)a + i) ^ str_load64((const char*)b + i);
+        if (differ != 0) {
+            return i + (size_t)__builtin_ctzll(differ) / 8;
+        }
+    }
+    while (i < n && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Start and period of the maximal suffix of n under one byte order, or
+// under the reverse order when `reversed`. SIZE_MAX + 1 wraps to 0 on
+// purpose: the suffix starts at the returned value + 1.
+static size_t str_max_suffix(const unsigned char* n, size_t m, size_t* period, bool reversed) {
+    size_t start = SIZE_MAX, j = 0, k = 1, p = 1;
+    while (j + k < m) {
+        unsigned char a = n[start + k], b = n[j + k];
+        if (a == b) {
+            if (k == p) {
+                j += p;
+                k = 1;
+            } else {
+                k++;
+            }
+        } else if (reversed ? a < b : a > b) {
+            j += k;
+            k = 1;
+            p = j - start;
+        } else {
+            start = j++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+    return start;
+}
+
+// Two-Way (Crochemore and Perrin) with a last-byte shift table. For a
+// NUL terminated haystack (end == NULL) the length is found lazily, some
+// way ahead at a time, so an early match does not scan the whole haystack.
+static char* str_strstr_twoway(const char* haystack, const char* end, const char* needle, size_t m) {
+    const unsigned char* h = (const unsigned char*)haystack;
+    const unsigned char* n = (const unsigned char*)needle;
+    MyMemchrFn find = str_memchr_impls[str_level];
+
+    size_t shift[256] = { 0 }; // 1 + last index of each byte in the needle, 0 if absent
+    for (size_t i = 0; i < m; i++) {
+        shift[n[i]] = i + 1;
+    }
+
+    // Critical factorization: the later of the two maximal suffixes
+    size_t period, reverse_period;
+    size_t split = str_max_suffix(n, m, &period, false);
+    size_t reverse_split = str_max_suffix(n, m, &reverse_period, true);
+    if (reverse_split + 1 > split + 1) {
+        split = reverse_split;
+        period = reverse_period;
+    }
+    size_t memory_reset;
+    if (str_memcmp_impls[str_level](n, n + period, split + 1) != 0) {
+        // Not periodic: no prefix needs remembering between attempts
+        memory_reset = 0;
+        period = (split > m - split - 1 ? split : m - split - 1) + 1;
+    } else {
+        memory_reset = m - period;
+    }
+
+    const unsigned char* known = end != NULL ? (const unsigned char*)end : h; // no terminator before here
+    size_t memory = 0;
+    for (;;) {
+        if ((size_t)(known - h) < m) {
+            if (end != NULL) {
+                return NULL;
+            }
+            size_t grow = m + STR_SEARCH_LOOKAHEAD;
+            const unsigned char* terminator = find(known, 0, grow);
+            if (terminator != NULL) {
+                known = terminator;
+                if ((size_t)(known - h) < m) {
+                    return NULL;
+                }
+            } else {
+                known += grow;
+            }
+        }
+
+        size_t last = shift[h[m - 1]];
+        if (last == 0) {
+            h += m;
+            memory = 0;
+            continue;
+        }
+        if (last != m) {
+            size_t k = m - last;
+            h += k < memory ? memory : k;
+            memory = 0;
+            continue;
+        }
+
+        // Right half, then left half
+        size_t k = split + 1 > memory ? split + 1 : memory;
+        k += str_mismatch(n + k, h + k, m - k);
+        if (k == split + 1) {
+            // No match can start before the next copy of n[k] is at offset k
+            const unsigned char* next = find(h + k, n[k], (size_t)(known - h) - k);
+            h = (next != NULL ? next : known) - k;
+            memory = 0;
+            continue;
+        }
+        if (k < m) {
+            h += k - split;
+            memory = 0;
+            continue;
+        }
+        for (k = split + 1; k > memory && n[k - 1] == h[k - 1]; k--) {
+        }
+        if (k <= memory) {
+            return (char*)h;
+        }
+        h += period;
+        memory = memory_reset;
+    }
+}
+
+// First/last byte filter over 64 byte aligned blocks. A block also reads
+// m - 1 bytes past its end, so the terminator is looked for ahead of it
+// and the last few positions are checked one at a time.
+STR_NO_ASAN
+static inline char* str_strstr(const char* h, const char* needle) {
+    size_t m = str_len_impls[str_level](needle);
+    if (m <= 1) {
+        return m == 0 ? (char*)h : str_chr_impls[str_level](h, needle[0]);
+    }
+    MyStrstrBlockFn block = str_strstr_block_impls[str_level];
+    MyMemchrFn find = str_memchr_impls[str_level];
+    MyMemcmpFn compare = str_memcmp_impls[str_level];
+    unsigned char first = (unsigned char)needle[0], last = (unsigned char)needle[m - 1];
+    size_t grow = m + 256;
+
+    const char* p = (const char*)((uintptr_t)h & ~(uintptr_t)63);
+    const char* known = h;      // no terminator before here
+    const char* end = NULL;     // the terminator, once seen
+    size_t checked = 0;         // bytes compared for candidates
+    for (;; p += 64) {
+        const char* reach = p + 64 + m - 1; // the block reads up to here
+        while (end == NULL && known < reach) {
+            end = find(known, 0, grow);
+            known += grow;
+            grow = grow < STR_SEARCH_LOOKAHEAD ? grow * 2 : grow;
+        }
+        if (end != NULL && reach > end + 1) {
+            break;
+        }
+        if (checked > 2 * (size_t)(p - h) + 4096) {
+            return str_strstr_twoway(p < h ? h : p, NULL, needle, m);
+        }
+
+        uint64_t candidates = block(p, m, first, last);
+        if (p < h) {
+            candidates &= ~0ULL << (h - p);
+        }
+        while (candidates != 0) {
+            const char* q = p + __builtin_ctzll(candidates);
+            checked += m;
+            if (compare(q + 1, needle + 1, m - 2) == 0) {
+                return (char*)q;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+
+    // Fewer than 64 + m positions are left before the terminator
+    for (const char* q = p < h ? h : p; q + m <= end; q++) {
+        if (*q == (char)first && compare(q + 1, needle + 1, m - 1) == 0) {
+            return (char*)q;
+        }
+    }
+    return NULL;
+}
+
+// First occurrence of the m bytes at needle in the n bytes at h, or NULL.
+// The same filter as str_strstr, with the end known up front: blocks stop
+// where they would read past it, and Two-Way takes over on the same terms.
+STR_NO_ASAN
+static inline char* str_memmem(const char* h, size_t n, const char* needle, size_t m) {
+    if (n < m) {
+        return NULL;
+    }
+    if (m <= 1) {
+        return m == 0 ? (char*)h : str_memchr_impls[str_level](h, needle[0], n);
+    }
+    MyStrstrBlockFn block = str_strstr_block_impls[str_level];
+    MyMemcmpFn compare = str_memcmp_impls[str_level];
+    unsigned char first = (unsigned char)needle[0], last = (unsigned char)needle[m - 1];
+    const char* end = h + n;
+
+    const char* p = (const char*)((uintptr_t)h & ~(uintptr_t)63);
+    size_t checked = 0;
+    for (; (size_t)(end - p) >= 64 + m - 1; p += 64) {
+        if (checked > 2 * (size_t)(p - h) + 4096) {
+            return str_strstr_twoway(p < h ? h : p, end, needle, m);
+        }
+        uint64_t candidates = block(p, m, first, last);
+        if (p < h) {
+            candidates &= ~0ULL << (h - p);
+        }
+        while (candidates != 0) {
+            const char* q = p + __builtin_ctzll(candidates);
+            checked += m;
+            if (compare(q + 1, needle + 1, m - 2) == 0) {
+                return (char*)q;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    for (const char* q = p < h ? h : p; q + m <= end; q++) {
+        if (*q == (char)first && compare(q + 1, needle + 1, m - 1) == 0) {
+            return (char*)q;
+        }
+    }
+    return NULL;
+}
+
+#endif
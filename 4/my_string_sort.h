@@ -0,0 +1,255 @@
+// my_string_sort: sorts an array of C strings into my_strcmp order.
+//
+// A comparison sort built on my_strcmp rescans the prefix two keys share
+// on every compare and follows both pointers to do it. Here each string
+// gets an entry holding the pointer and the next 8 bytes of the string,
+// big-endian so that comparing them as integers orders them like
+// my_strcmp. A multikey quicksort then works on the cached keys alone.
+// It partitions three ways on the key. Only the entries equal to the pivot
+// go back to their strings, to load the 8 bytes after that, and then only
+// if the key did not already hold the terminator. Small ranges finish with
+// an insertion sort on the keys.
+//
+// my_string_sort_parallel runs the same sort on a pool of threads: once a
+// partition is large enough it becomes a task, so the buckets of the top
+// levels are sorted side by side.
+//
+// Either include this after "malloc copy.c", or link the allocator built
+// with -DMY_MALLOC_NO_MAIN.
+#ifndef MY_STRING_SORT_H
+#define MY_STRING_SORT_H
+
+#include <pthread.h>
+#include "my_string_compare.h"
+
+void* my_malloc(size_t size);
+void my_free(void* ptr);
+
+#define MY_SORT_INSERTION 16        // ranges this small are insertion sorted
+#define MY_SORT_TASK_MIN (1 << 15)  // smallest partition handed to another thread
+#define MY_SORT_PAGE 4096
+
+typedef struct MySortEntry{
+    uint64_t key;           // 8 bytes of the string from the current depth, big-endian,
+                            // zero after the terminator
+    const char* string;
+}MySortEntry;
+
+typedef struct MySortTask{
+    MySortEntry* entries;
+    size_t count;
+    size_t depth;
+}MySortTask;
+
+typedef struct MySortPool{
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    MySortTask* tasks;
+    size_t task_count;
+    size_t pending;         // tasks queued or running
+}MySortPool;
+
+// The 8 bytes of s from s, NULs after the terminator. A whole word is read
+// when it stays in the page, like the other kernels here.
+STR_NO_ASAN
+static inline uint64_t str_sort_key(const char* s) {
+    uint64_t v;
+    if (((uintptr_t)s & (MY_SORT_PAGE - 1)) <= MY_SORT_PAGE - 8) {
+        v = str_load64(s);
+        uint64_t zeros = str_zero_bytes(v);
+        if (zeros != 0) {
+            // Keep the bytes below the lowest terminator
+            v &= (zeros & (0 - zeros)) - 1;
+        }
+    } else {
+        v = 0;
+        for (int i = 0; i < 8 && s[i] != '\0'; i++) {
+            v |= (uint64_t)(unsigned char)s[i] << (8 * i);
+        }
+    }
+    return __builtin_bswap64(v);
+}
+
+// The key holds the terminator, so equal keys mean equal strings
+static inline bool str_sort_ended(uint64_t key) {
+    return (key & 0xFF) == 0;
+}
+
+static inline void str_sort_swap(MySortEntry* a, MySortEntry* b) {
+    MySortEntry t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static inline int str_sort_compare(const MySortEntry* a, const MySortEntry* b, size_t depth) {
+    if (a->key != b->key) {
+        return a->key < b->key ? -1 : 1;
+    }
+    if (str_sort_ended(a->key)) {
+        return 0;
+    }
+    return str_ncmp_impls[str_level](a->string + depth + 8, b->string + depth + 8, SIZE_MAX);
+}
+
+static void str_sort_insertion(MySortEntry* entries, size_t count, size_t depth) {
+    for (size_t i = 1; i < count; i++) {
+        MySortEntry entry = entries[i];
+        size_t j = i;
+        while (j > 0 && str_sort_compare(&entry, &entries[j - 1], depth) < 0) {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j] = entry;
+    }
+}
+
+static inline uint64_t str_sort_median(uint64_t a, uint64_t b, uint64_t c) {
+    if (a < b) {
+        return b < c ? b : (a < c ? c : a);
+    }
+    return a < c ? a : (b < c ? c : b);
+}
+
+static inline void str_sort_push(MySortPool* pool, MySortEntry* entries, size_t count, size_t depth) {
+    pthread_mutex_lock(&pool->lock);
+    pool->tasks[pool->task_count++] = (MySortTask){ entries, count, depth };
+    pool->pending++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Sorts entries whose strings agree on their first `depth` bytes; keys
+// hold bytes depth to depth + 7. With a pool, large partitions are queued
+// instead of sorted here. The loop goes on with the largest of the three
+// partitions and recurses into the other two, which hold at most half the
+// entries each, so the stack stays logarithmic in count however long the
+// strings' common prefixes are.
+static void str_sort_range(MySortEntry* entries, size_t count, size_t depth, MySortPool* pool) {
+    while (count > MY_SORT_INSERTION) {
+        uint64_t pivot = str_sort_median(entries[0].key, entries[count / 2].key, entries[count - 1].key);
+        size_t less = 0, i = 0, greater = count;
+        while (i < greater) {
+            if (entries[i].key < pivot) {
+                str_sort_swap(&entries[less++], &entries[i++]);
+            } else if (entries[i].key > pivot) {
+                str_sort_swap(&entries[i], &entries[--greater]);
+            } else {
+                i++;
+            }
+        }
+
+        // The middle shares 8 more bytes; move its keys along unless they
+        // ended, in which case it is already in place
+        MySortTask parts[3] = {
+            { entries, less, depth },
+            { entries + less, greater - less, depth + 8 },
+            { entries + greater, count - greater, depth },
+        };
+        if (str_sort_ended(pivot) || parts[1].count < 2) {
+            parts[1].count = 0;
+        } else {
+            for (size_t k = 0; k < parts[1].count; k++) {
+                parts[1].entries[k].key = str_sort_key(parts[1].entries[k].string + depth + 8);
+            }
+        }
+
+        int largest = 0;
+        for (int p = 1; p < 3; p++) {
+            if (parts[p].count > parts[largest].count) {
+                largest = p;
+            }
+        }
+        for (int p = 0; p < 3; p++) {
+            if (p == largest || parts[p].count < 2) {
+                continue;
+            }
+            if (pool != NULL && parts[p].count >= MY_SORT_TASK_MIN) {
+                str_sort_push(pool, parts[p].entries, parts[p].count, parts[p].depth);
+            } else {
+                str_sort_range(parts[p].entries, parts[p].count, parts[p].depth, pool);
+            }
+        }
+        entries = parts[largest].entries;
+        count = parts[largest].count;
+        depth = parts[largest].depth;
+    }
+    str_sort_insertion(entries, count, depth);
+}
+
+static void* str_sort_worker(void* arg) {
+    MySortPool* pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->task_count == 0 && pool->pending > 0) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->task_count == 0) {
+            break;
+        }
+        MySortTask task = pool->tasks[--pool->task_count];
+        pthread_mutex_unlock(&pool->lock);
+        str_sort_range(task.entries, task.count, task.depth, pool);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->wake);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Sorts with up to `threads` threads, counting the caller. Returns false,
+// leaving the strings as they were, if the allocator is out of memory.
+static inline bool my_string_sort_parallel(const char** strings, size_t count, int threads) {
+    if (count < 2) {
+        return true;
+    }
+    MySortEntry* entries = my_malloc(count * sizeof(MySortEntry));
+    if (entries == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        entries[i].key = str_sort_key(strings[i]);
+        entries[i].string = strings[i];
+    }
+
+    if (threads <= 1 || count < 2 * MY_SORT_TASK_MIN) {
+        str_sort_range(entries, count, 0, NULL);
+    } else {
+        // Queued tasks cover disjoint ranges of at least MY_SORT_TASK_MIN entries
+        MySortPool pool = { .task_count = 0, .pending = 1 };
+        pool.tasks = my_malloc((count / MY_SORT_TASK_MIN + 1) * sizeof(MySortTask));
+        if (pool.tasks == NULL) {
+            my_free(entries);
+            return false;
+        }
+        pthread_mutex_init(&pool.lock, NULL);
+        pthread_cond_init(&pool.wake, NULL);
+        pool.tasks[0] = (MySortTask){ entries, count, 0 };
+        pool.task_count = 1;
+        pthread_t ids[threads - 1];
+        int started = 0;
+        while (started < threads - 1 && pthread_create(&ids[started], NULL, str_sort_worker, &pool) == 0) {
+            started++;
+        }
+        str_sort_worker(&pool);
+        for (int t = 0; t < started; t++) {
+            pthread_join(ids[t], NULL);
+        }
+        pthread_cond_destroy(&pool.wake);
+        pthread_mutex_destroy(&pool.lock);
+        my_free(pool.tasks);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        strings[i] = entries[i].string;
+    }
+    my_free(entries);
+    return true;
+}
+
+static inline bool my_string_sort(const char** strings, size_t count) {
+    return my_string_sort_parallel(strings, count, 1);
+}
+
+#endif
@@ -1,21 +1,16 @@
 #include <stdio.h>
+#include "my_string_kernels.h"
 
-
-int my_strlen(const char* s){
-    int counter=0;
-    while(*s!='\0'){
-        counter++;
-        s++;
-    }
-    return counter;
+// Length of s in bytes, scanned a vector (or a word) at a time
+size_t my_strlen(const char* s){
+    return str_len_impls[str_level](s);
 }
 
+#ifndef MY_STRING_NO_MAIN
 int main()
 {
     char stri[] = "Dunia";
-    char dest[20] = "Halo ";
-    int c =0;
-    
     
-    printf("%d", my_strlen(stri));
-}
\ No newline at end of file
+    printf("%zu (%s)", my_strlen(stri), my_string_impl_name());
+}
+#endif
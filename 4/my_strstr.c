@@ -0,0 +1,40 @@
+#include <stdio.h>
+#include "my_string_search.h"
+
+// First c in s, or NULL; c == '\0' finds the terminator
+char* my_strchr(const char* s, int c){
+    return str_chr_impls[str_level](s, c);
+}
+
+// Last c in s, or NULL
+char* my_strrchr(const char* s, int c){
+    return str_rchr_impls[str_level](s, c);
+}
+
+// First c in the size bytes at s, or NULL
+void* my_memchr(const void* s, int c, size_t size){
+    return str_memchr_impls[str_level](s, c, size);
+}
+
+// First occurrence of needle in haystack, or NULL; linear time for any input
+char* my_strstr(const char* haystack, const char* needle){
+    return str_strstr(haystack, needle);
+}
+
+// First occurrence of the needle_size bytes at needle in the size bytes at
+// haystack, or NULL; neither has to be NUL terminated
+void* my_memmem(const void* haystack, size_t size, const void* needle, size_t needle_size){
+    return str_memmem(haystack, size, needle, needle_size);
+}
+
+#ifndef MY_STRING_NO_MAIN
+int main()
+{
+    const char* line = "2024-05-01 12:00:03 ERROR disk /dev/sda1 is full";
+
+    printf("%s\n", my_strstr(line, "ERROR"));
+    printf("%s\n", my_strchr(line, ' ') + 1);
+    printf("%s\n", my_strrchr(line, '/') + 1);
+    printf("%s (%s)\n", (char*)my_memchr(line, 'd', 30), my_string_impl_name());
+}
+#endif
@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include "my_utf8.h"
+
+// True if the n bytes at s are well-formed UTF-8
+bool my_utf8_validate(const char* s, size_t n){
+    return str_utf8_validate_impls[str_level](s, n);
+}
+
+// Code points in the n bytes at s; only meaningful once they are validated
+size_t my_utf8_length(const char* s, size_t n){
+    return str_utf8_count_impls[str_level](s, n);
+}
+
+#ifndef MY_STRING_NO_MAIN
+int main()
+{
+    const char* text = "Selamat pagi, d\xC3\xBCnya \xE2\x9C\x93 \xF0\x9F\x8C\x8F";
+    const char* broken = "caf\xC3";
+    size_t length = __builtin_strlen(text);
+
+    printf("%zu bytes, %zu code points, %s\n", length, my_utf8_length(text, length),
+           my_utf8_validate(text, length) ? "valid" : "invalid");
+    printf("\"caf\\xC3\" is %s (%s)\n", my_utf8_validate(broken, 4) ? "valid" : "invalid", my_string_impl_name());
+}
+#endif
@@ -0,0 +1,303 @@
+// UTF-8 kernels behind my_utf8_validate and my_utf8_length, on the dispatch
+// in my_string_kernels.h. Both take an explicit byte length (my_strlen of a
+// C string) and never read outside it.
+//
+// Validation accepts exactly the well-formed sequences of Unicode table
+// 3-7: no overlong forms, no surrogates, nothing above U+10FFFF, no
+// truncated sequence at the end. The AVX2 kernel checks 64 bytes per step
+// with the lookup method of Keiser and Lemire. Three 16-entry tables,
+// indexed with vpshufb by the high and low nibble of the previous byte and
+// the high nibble of the current one, flag every invalid pair of bytes.
+// A saturating subtract then checks that the third and fourth bytes after a
+// 3 or 4 byte lead are continuations. An all-ASCII block skips all of it.
+// SSE2 has no byte shuffle, so that level only skips ASCII 64 bytes at a
+// time and decodes the rest a sequence at a time, like the word loop does.
+//
+// Code points are counted as the bytes that are not continuation bytes
+// (10xxxxxx), which is exact for valid input and never needs decoding.
+#ifndef MY_UTF8_H
+#define MY_UTF8_H
+
+#include "my_string_kernels.h"
+
+typedef bool (*MyUtf8ValidateFn)(const char* s, size_t n);
+typedef size_t (*MyUtf8CountFn)(const char* s, size_t n);
+
+// Length of the well-formed sequence at p, or 0 if it is invalid or runs past end
+static inline size_t str_utf8_sequence(const unsigned char* p, const unsigned char* end) {
+    unsigned char lead = p[0];
+    if (lead < 0x80) {
+        return 1;
+    }
+    size_t length;
+    unsigned char low = 0x80, high = 0xBF; // allowed range of the second byte
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        low = lead == 0xE0 ? 0xA0 : low;   // overlong
+        high = lead == 0xED ? 0x9F : high; // surrogates
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        low = lead == 0xF0 ? 0x90 : low;   // overlong
+        high = lead == 0xF4 ? 0x8F : high; // above U+10FFFF
+    } else {
+        return 0;
+    }
+    if ((size_t)(end - p) < length || p[1] < low || p[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+// Decodes sequences from p until it is at least at `until`; NULL on an error
+static inline const unsigned char* str_utf8_decode_until(const unsigned char* p, const unsigned char* until,
+                                                         const unsigned char* end) {
+    while (p < until) {
+        size_t length = str_utf8_sequence(p, end);
+        if (length == 0) {
+            return NULL;
+        }
+        p += length;
+    }
+    return p;
+}
+
+// ---- Word at a time (any CPU) ----
+static bool utf8_validate_swar(const char* s, size_t n) {
+    const unsigned char* p = (const unsigned char*)s;
+    const unsigned char* end = p + n;
+    while (p != NULL && p < end) {
+        if (end - p >= 16 && ((str_load64((const char*)p) | str_load64((const char*)p + 8)) & STR_HIGHS) == 0) {
+            p += 16;
+            continue;
+        }
+        p = str_utf8_decode_until(p, p + 1, end);
+    }
+    return p != NULL;
+}
+
+static size_t utf8_count_swar(const char* s, size_t n) {
+    size_t continuations = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v = str_load64(s + i);
+        // Bit 7 set and bit 6 clear; the shift lines bit 6 up with bit 7
+        uint64_t marks = v & ~(v << 1) & STR_HIGHS;
+        continuations += ((marks >> 7) * STR_ONES) >> 56;
+    }
+    for (; i < n; i++) {
+        continuations += ((unsigned char)s[i] & 0xC0) == 0x80;
+    }
+    return n - continuations;
+}
+
+#if defined(__x86_64__)
+// ---- SSE2: ASCII blocks skipped, the rest decoded ----
+static bool utf8_validate_sse2(const char* s, size_t n) {
+    const unsigned char* p = (const unsigned char*)s;
+    const unsigned char* end = p + n;
+    while (end - p >= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*)(p + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) == 0) {
+            p += 64;
+            continue;
+        }
+        // Through this block 16 bytes at a time, decoding from the first
+        // non-ASCII byte of each chunk that has one
+        const unsigned char* block_end = p + 64;
+        while (p < block_end && end - p >= 16) {
+            unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+            p = mask == 0 ? p + 16 : str_utf8_decode_until(p + __builtin_ctz(mask), p + 16, end);
+            if (p == NULL) {
+                return false;
+            }
+        }
+    }
+    return str_utf8_decode_until(p, end, end) != NULL;
+}
+
+// Non-continuation bytes of n (at most 255 * 16) bytes
+static inline size_t str_utf8_count_sse2(const char* s, size_t n) {
+    const __m128i limit = _mm_set1_epi8(-65); // bytes 0x80-0xBF are -128..-65 as signed
+    __m128i counts = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        counts = _mm_sub_epi8(counts, _mm_cmpgt_epi8(v, limit));
+    }
+    __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+    return (size_t)_mm_cvtsi128_si64(sums) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums));
+}
+
+static size_t utf8_count_sse2(const char* s, size_t n) {
+    size_t count = 0;
+    size_t i = 0;
+    while (n - i >= 16) {
+        size_t run = (n - i) & ~(size_t)15;
+        run = run > 255 * 16 ? 255 * 16 : run;
+        count += str_utf8_count_sse2(s + i, run);
+        i += run;
+    }
+    return count + utf8_count_swar(s + i, n - i);
+}
+
+// ---- AVX2: the lookup method, 64 bytes per step ----
+// Error bits; a pair of bytes is invalid when a bit survives all three lookups
+#define UTF8_TOO_SHORT (1 << 0)   // lead or ASCII where a continuation is due
+#define UTF8_TOO_LONG (1 << 1)    // continuation after ASCII
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE (1 << 3)
+#define UTF8_SURROGATE (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS (1 << 7)   // continuation after a continuation; fine in 3 and 4 byte sequences
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// The same 16 entries in both lanes, for vpshufb
+#define UTF8_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+// The 32 bytes ending n bytes before the end of input, the first n from prev
+#define UTF8_PREV(input, prev, n) _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - (n))
+
+// Nonzero bytes wherever input and the bytes before it are not valid UTF-8
+__attribute__((target("avx2")))
+static inline __m256i str_utf8_errors_avx2(__m256i input, __m256i prev) {
+    const __m256i byte_1_high_table = UTF8_TABLE(
+        // 0xxx: ASCII
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        // 10xx: continuation
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        // 1100, 1101: two byte leads
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2, UTF8_TOO_SHORT,
+        // 1110: three byte lead
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        // 1111: four byte lead
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+    const __m256i byte_1_low_table = UTF8_TABLE(
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4, // xxxx0000
+        UTF8_CARRY | UTF8_OVERLONG_2,                                     // xxxx0001
+        UTF8_CARRY, UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,                                      // xxxx0100
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE, // xxxx1101
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+    const __m256i byte_2_high_table = UTF8_TABLE(
+        // 0xxx: ASCII
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        // 1000, 1001, 101x: continuations
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        // 11xx: leads
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    __m256i prev1 = UTF8_PREV(input, prev, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // Bytes two after a 111xxxxx lead or three after a 1111xxxx lead must be
+    // continuations, and exactly those may follow a continuation (TWO_CONTS)
+    __m256i third = _mm256_subs_epu8(UTF8_PREV(input, prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(UTF8_PREV(input, prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, special);
+}
+
+// Nonzero if the last bytes of input start a sequence that needs more bytes
+__attribute__((target("avx2")))
+static inline __m256i str_utf8_incomplete_avx2(__m256i input) {
+    const __m256i max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, max);
+}
+
+__attribute__((target("avx2")))
+static bool utf8_validate_avx2(const char* s, size_t n) {
+    __m256i errors = _mm256_setzero_si256();
+    __m256i prev = _mm256_setzero_si256();
+    __m256i incomplete = _mm256_setzero_si256();
+    char tail[64];
+    for (size_t i = 0; i < n; i += 64) {
+        const char* p = s + i;
+        if (n - i < 64) {
+            // Zeros after the end make a truncated sequence TOO_SHORT
+            __builtin_memset(tail, 0, sizeof(tail));
+            __builtin_memcpy(tail, p, n - i);
+            p = tail;
+        }
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + 32));
+        if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) == 0) {
+            errors = _mm256_or_si256(errors, incomplete);
+            incomplete = _mm256_setzero_si256();
+        } else {
+            errors = _mm256_or_si256(errors, str_utf8_errors_avx2(a, prev));
+            errors = _mm256_or_si256(errors, str_utf8_errors_avx2(b, a));
+            incomplete = str_utf8_incomplete_avx2(b);
+        }
+        prev = b;
+    }
+    errors = _mm256_or_si256(errors, incomplete);
+    return _mm256_testz_si256(errors, errors);
+}
+
+// Non-continuation bytes of n (at most 127 * 64) bytes
+__attribute__((target("avx2")))
+static inline size_t str_utf8_count_avx2(const char* s, size_t n) {
+    const __m256i limit = _mm256_set1_epi8(-65);
+    __m256i counts = _mm256_setzero_si256();
+    for (size_t i = 0; i < n; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + i + 32));
+        counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(a, limit));
+        counts = _mm256_sub_epi8(counts, _mm256_cmpgt_epi8(b, limit));
+    }
+    __m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    return (size_t)_mm_cvtsi128_si64(half) + (size_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+}
+
+__attribute__((target("avx2")))
+static size_t utf8_count_avx2(const char* s, size_t n) {
+    size_t count = 0;
+    size_t i = 0;
+    while (n - i >= 64) {
+        size_t run = (n - i) & ~(size_t)63;
+        run = run > 127 * 64 ? 127 * 64 : run;
+        count += str_utf8_count_avx2(s + i, run);
+        i += run;
+    }
+    return count + utf8_count_sse2(s + i, n - i);
+}
+#endif
+
+static const MyUtf8ValidateFn str_utf8_validate_impls[STR_LEVEL_COUNT] =
+    STR_X86_KERNELS(utf8_validate_swar, utf8_validate_sse2, utf8_validate_avx2);
+static const MyUtf8CountFn str_utf8_count_impls[STR_LEVEL_COUNT] =
+    STR_X86_KERNELS(utf8_count_swar, utf8_count_sse2, utf8_count_avx2);
+
+#endif
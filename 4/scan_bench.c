@@ -0,0 +1,100 @@
+// Counts the lines of a text file, and the lines holding a fixed string,
+// the old way (getline into a buffer, strstr on each copy) against MyScan
+// on 1 to 4 threads over the mapped file. Run it twice to see the file
+// from the page cache; the first run measures the disk.
+//
+// Build: gcc -O2 -pthread scan_bench.c -o scan_bench
+// Usage: ./scan_bench FILE [pattern]     (default pattern "ERROR")
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "../5/malloc copy.c"
+#include "my_scan.h"
+
+typedef struct BenchJob{
+    const char* pattern;
+    size_t pattern_length;
+    _Atomic size_t lines;
+    _Atomic size_t matches;
+}BenchJob;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static void count_chunk(void* context, int thread, const char* data, size_t size) {
+    BenchJob* job = context;
+    (void)thread;
+    size_t lines = my_scan_count(data, size, '\n');
+    size_t matches = 0;
+    const char* end = data + size;
+    for (const char* p = data; p < end;) {
+        const char* match = str_memmem(p, (size_t)(end - p), job->pattern, job->pattern_length);
+        if (match == NULL) {
+            break;
+        }
+        matches++;
+        const char* newline = str_memchr_impls[str_level](match, '\n', (size_t)(end - match));
+        p = newline == NULL ? end : newline + 1;
+    }
+    atomic_fetch_add(&job->lines, lines);
+    atomic_fetch_add(&job->matches, matches);
+}
+
+static void report(const char* what, size_t size, double ns, size_t lines, size_t matches, size_t expected_lines,
+                   size_t expected_matches) {
+    printf("  %-24s %8.3f s  %6.2f GB/s%s\n", what, ns / 1e9, (double)size / ns,
+           lines == expected_lines && matches == expected_matches ? "" : "   RESULTS DIFFER");
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file> [pattern]\n", argv[0]);
+        return 1;
+    }
+    const char* pattern = argc > 2 ? argv[2] : "ERROR";
+
+    FILE* input = fopen(argv[1], "r");
+    if (input == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    char* line = NULL;
+    size_t capacity = 0;
+    size_t expected_lines = 0, expected_matches = 0;
+    double start = now_ns();
+    ssize_t length;
+    while ((length = getline(&line, &capacity, input)) >= 0) {
+        expected_lines += length > 0 && line[length - 1] == '\n';
+        expected_matches += strstr(line, pattern) != NULL;
+    }
+    double ns = now_ns() - start;
+    free(line);
+    fclose(input);
+
+    MyScanFile file;
+    if (!my_scan_open(&file, argv[1])) {
+        perror(argv[1]);
+        return 1;
+    }
+    printf("=== %zu MB, %zu lines, %zu with \"%s\" (%s kernels) ===\n", file.size >> 20, expected_lines,
+           expected_matches, pattern, my_string_impl_name());
+    report("getline + strstr", file.size, ns, expected_lines, expected_matches, expected_lines, expected_matches);
+
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        BenchJob job = { .pattern = pattern, .pattern_length = strlen(pattern) };
+        start = now_ns();
+        int used = my_scan_parallel(file.data, file.size, threads, count_chunk, NULL, &job);
+        ns = now_ns() - start;
+        char what[32];
+        snprintf(what, sizeof(what), "MyScan, %d thread%s", used, used == 1 ? "" : "s");
+        report(what, file.size, ns, job.lines, job.matches, expected_lines, expected_matches);
+    }
+    my_scan_close(&file);
+    return 0;
+}
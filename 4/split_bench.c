@@ -0,0 +1,147 @@
+// Splits comma separated records into fields: the old way (scan for the
+// next delimiter, my_strncpy the field into a buffer) against MySplitter at
+// every kernel level, and MySplitStream fed the same text in chunks.
+//
+// Build: gcc -O2 split_bench.c -o split_bench
+// Usage: ./split_bench [text MB] [chunk KB]     (default 256 64)
+#include <stdlib.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "../5/malloc copy.c"
+#define MY_STRING_NO_MAIN
+#include "my_strcpy.c"
+#include "my_split.h"
+
+#define FIELD_MAX 64
+
+static const char* names[] = { "alice", "bob", "carol", "dave", "eve", "mallory", "trent" };
+static const char* cities[] = { "Jakarta", "Bandung", "Surabaya", "Medan", "Denpasar" };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Records like "1042,carol,Medan,ok,88.13,\n", six fields of 0 to 7 bytes
+static char* make_records(size_t size) {
+    char* text = malloc(size);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    size_t at = 0;
+    for (;;) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        char record[96];
+        int length = snprintf(record, sizeof(record), "%u,%s,%s,%s,%u.%02u,\n", (unsigned)(rng >> 50),
+                              names[(rng >> 20) % 7], cities[(rng >> 30) % 5], (rng >> 40) % 9 == 0 ? "fail" : "ok",
+                              (unsigned)(rng >> 57), (unsigned)(rng >> 10) % 100);
+        if (at + (size_t)length > size) {
+            break;
+        }
+        memcpy(text + at, record, (size_t)length);
+        at += (size_t)length;
+    }
+    memset(text + at, 'x', size - at);
+    return text;
+}
+
+// The old way: find the end of each field a byte at a time, then copy it out
+static size_t copy_fields(const char* text, size_t size, size_t* bytes) {
+    char field[FIELD_MAX + 1];
+    size_t count = 0, total = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= size; i++) {
+        if (i == size || text[i] == ',' || text[i] == '\n') {
+            size_t length = i - start < FIELD_MAX ? i - start : FIELD_MAX;
+            char* end = my_strncpy(text + start, field, length);
+            total += (size_t)(end - field);
+            count++;
+            start = i + 1;
+        }
+    }
+    *bytes = total;
+    return count;
+}
+
+static size_t split_fields(const char* text, size_t size, size_t* bytes) {
+    MySplitter splitter;
+    MyStringView field;
+    size_t count = 0, total = 0;
+    my_split_init(&splitter, ",\n", text, size);
+    while (my_split_next(&splitter, &field)) {
+        total += field.length < FIELD_MAX ? field.length : FIELD_MAX;
+        count++;
+    }
+    *bytes = total;
+    return count;
+}
+
+static size_t stream_fields(const char* text, size_t size, size_t chunk, size_t* bytes) {
+    MySplitStream stream;
+    MyStringView field;
+    size_t count = 0, total = 0;
+    my_split_stream_init(&stream, ",\n");
+    for (size_t at = 0; at < size; at += chunk) {
+        my_split_stream_feed(&stream, text + at, size - at < chunk ? size - at : chunk);
+        while (my_split_stream_next(&stream, &field)) {
+            total += field.length < FIELD_MAX ? field.length : FIELD_MAX;
+            count++;
+        }
+    }
+    while (my_split_stream_finish(&stream, &field)) {
+        total += field.length < FIELD_MAX ? field.length : FIELD_MAX;
+        count++;
+    }
+    if (stream.failed) {
+        fprintf(stderr, "split_bench: out of memory in the stream splitter\n");
+    }
+    my_split_stream_free(&stream);
+    *bytes = total;
+    return count;
+}
+
+static void report(const char* what, size_t size, size_t count, size_t bytes, double ns,
+                   size_t expected_count, size_t expected_bytes) {
+    printf("  %-22s %7.2f GB/s  %7.1f M fields/s%s\n", what, (double)size / ns, (double)count / ns * 1e3,
+           count == expected_count && bytes == expected_bytes ? "" : "   RESULTS DIFFER");
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+    size_t chunk_kb = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    size_t size = (megabytes == 0 ? 1 : megabytes) << 20;
+    size_t chunk = (chunk_kb == 0 ? 1 : chunk_kb) << 10;
+    char* text = make_records(size);
+
+    size_t expected_bytes;
+    double start = now_ns();
+    size_t expected = copy_fields(text, size, &expected_bytes);
+    double ns = now_ns() - start;
+    printf("=== %zu MB of records, %zu fields ===\n", size >> 20, expected);
+    report("bytewise + my_strncpy", size, expected, expected_bytes, ns, expected, expected_bytes);
+
+    const char* impls[] = { "swar", "sse2", "avx2" };
+    for (int i = 0; i < 3; i++) {
+        if (!my_string_select(impls[i])) {
+            continue;
+        }
+        size_t bytes;
+        start = now_ns();
+        size_t count = split_fields(text, size, &bytes);
+        ns = now_ns() - start;
+        char what[32];
+        snprintf(what, sizeof(what), "MySplitter (%s)", impls[i]);
+        report(what, size, count, bytes, ns, expected, expected_bytes);
+    }
+    my_string_select(NULL);
+
+    size_t bytes;
+    start = now_ns();
+    size_t count = stream_fields(text, size, chunk, &bytes);
+    ns = now_ns() - start;
+    char what[32];
+    snprintf(what, sizeof(what), "MySplitStream (%zu KB)", chunk_kb);
+    report(what, size, count, bytes, ns, expected, expected_bytes);
+    free(text);
+    return 0;
+}
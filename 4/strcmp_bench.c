@@ -0,0 +1,145 @@
+// my_strcmp, my_memcmp and the batch compares against glibc on key sets of
+// 8 to 256 bytes. Keys share a prefix and differ in the last byte (the
+// worst case for a compare), or are equal; each set is spread over
+// a few MB so that the loads are realistic, not one hot cache line.
+//
+// Build: gcc -O2 strcmp_bench.c -o strcmp_bench
+// Usage: ./strcmp_bench [pairs per set]     (default 200000)
+#define MY_STRING_NO_MAIN
+#include "my_strcmp.c"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 10
+
+// Called through volatile pointers so the compiler cannot inline glibc's
+static int (*volatile glibc_strcmp)(const char*, const char*) = strcmp;
+static int (*volatile glibc_memcmp)(const void*, const void*, size_t) = memcmp;
+
+static const char* impls[] = { "avx2", "sse2", "swar" };
+// Results of timed calls land here, so the calls cannot be optimized away
+static volatile int sink = 0;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Fills `count` pairs of `length`-byte keys at odd offsets in one arena.
+// With `equal` the pairs match; otherwise they differ in the last byte.
+static char* make_pairs(const char** a, const char** b, size_t count, size_t length, bool equal) {
+    size_t stride = length + 1 + 7;
+    char* arena = malloc(2 * count * stride + 64);
+    uint64_t rng = length * 0x9E3779B97F4A7C15ULL + 1;
+    for (size_t i = 0; i < count; i++) {
+        char* x = arena + 2 * i * stride + (i & 7);
+        char* y = x + stride;
+        for (size_t j = 0; j < length; j++) {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            x[j] = y[j] = (char)('a' + (rng >> 59));
+        }
+        x[length] = y[length] = '\0';
+        if (!equal) {
+            y[length - 1] ^= 1;
+        }
+        a[i] = x;
+        b[i] = y;
+    }
+    return arena;
+}
+
+typedef enum BenchKind{
+    BENCH_STRCMP,
+    BENCH_MEMCMP,
+    BENCH_PAIRS,
+}BenchKind;
+
+// ns per compare for `kind` with `impl` (NULL: glibc in a loop)
+static double run(BenchKind kind, const char* impl, const char** a, const char** b, int* results,
+                  size_t count, size_t length) {
+    if (impl != NULL) {
+        my_string_select(impl);
+    }
+    double start = now_ns();
+    for (int round = 0; round < ROUNDS; round++) {
+        if (kind == BENCH_PAIRS) {
+            my_strcmp_pairs(a, b, count, results);
+            sink += results[count - 1];
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (kind == BENCH_STRCMP) {
+                sink += impl == NULL ? glibc_strcmp(a[i], b[i]) : my_strcmp(a[i], b[i]);
+            } else {
+                sink += impl == NULL ? glibc_memcmp(a[i], b[i], length) : my_memcmp(a[i], b[i], length);
+            }
+        }
+    }
+    return (now_ns() - start) / (double)(ROUNDS * count);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    if (count == 0) {
+        count = 1;
+    }
+    const char** a = malloc(count * sizeof(char*));
+    const char** b = malloc(count * sizeof(char*));
+    int* results = malloc(count * sizeof(int));
+
+    size_t available = 0;
+    for (size_t i = 0; i < 3; i++) {
+        if (my_string_select(impls[i])) {
+            impls[available++] = impls[i];
+        }
+    }
+    my_string_select(NULL);
+    const char* kind_names[] = { "strcmp", "memcmp", "pairs" };
+    printf("=== ns per compare, %zu pairs per set (default: %s) ===\n", count, my_string_impl_name());
+    for (int equal = 0; equal <= 1; equal++) {
+        printf("\n%s keys\n%-8s %6s %9s", equal ? "Equal" : "Last byte differs,", "", "length", "glibc");
+        for (size_t i = 0; i < available; i++) {
+            printf(" %9s", impls[i]);
+        }
+        printf("\n");
+        for (int kind = BENCH_STRCMP; kind <= BENCH_PAIRS; kind++) {
+            for (size_t length = 8; length <= 256; length *= 2) {
+                char* arena = make_pairs(a, b, count, length, equal);
+                // The pairs batch is measured against glibc strcmp in a loop
+                double glibc = run(kind == BENCH_MEMCMP ? BENCH_MEMCMP : BENCH_STRCMP, NULL, a, b, results, count, length);
+                printf("%-8s %6zu %9.2f", kind_names[kind], length, glibc);
+                for (size_t i = 0; i < available; i++) {
+                    printf(" %9.2f", run(kind, impls[i], a, b, results, count, length));
+                }
+                printf("\n");
+                free(arena);
+            }
+        }
+    }
+
+    // One key against every candidate, e.g. a linear probe over a bucket
+    printf("\nOne key against %zu candidates (%s)\n", count, my_string_impl_name());
+    for (size_t length = 8; length <= 256; length *= 4) {
+        char* arena = make_pairs(a, b, count, length, false);
+        const char* key = a[0];
+        double start = now_ns();
+        for (int round = 0; round < ROUNDS; round++) {
+            for (size_t i = 0; i < count; i++) {
+                sink += glibc_strcmp(key, b[i]);
+            }
+        }
+        double glibc = (now_ns() - start) / (double)(ROUNDS * count);
+        start = now_ns();
+        for (int round = 0; round < ROUNDS; round++) {
+            my_strcmp_many(key, b, count, results);
+            sink += results[count - 1];
+        }
+        double batch = (now_ns() - start) / (double)(ROUNDS * count);
+        printf("  length %3zu: glibc loop %6.2f ns, my_strcmp_many %6.2f ns\n", length, glibc, batch);
+        free(arena);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Builds one string out of many short fragments, with my_strcat into a big
+// enough buffer and with MyString. my_strcat rescans the whole string before
+// every append, so its cost per append grows with the string; MyString's
+// stays flat and it grows only O(log n) times.
+//
+// Build: gcc -O2 string_append_bench.c -o string_append_bench
+// Usage: ./string_append_bench [fragments]     (default 10000000)
+#include <stdlib.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "../5/malloc copy.c"
+#define MY_STRING_NO_MAIN
+#include "my_strcat.c"
+#include "my_string.h"
+
+#define FRAGMENT_COUNT 64
+#define STRCAT_MAX 160000 // my_strcat runs stop here, they are quadratic
+
+static char fragments[FRAGMENT_COUNT][24];
+static size_t fragment_lengths[FRAGMENT_COUNT];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Fragments of 1 to 16 bytes, like the words of a generated message
+static void make_fragments(void) {
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < FRAGMENT_COUNT; i++) {
+        size_t length = 1 + (size_t)i % 16;
+        for (size_t j = 0; j < length; j++) {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            fragments[i][j] = (char)('a' + (rng >> 59));
+        }
+        fragments[i][length] = '\0';
+        fragment_lengths[i] = length;
+    }
+}
+
+static void run_strcat(size_t count) {
+    char* dest = malloc(count * 16 + 1);
+    dest[0] = '\0';
+    double start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        my_strcat(fragments[i % FRAGMENT_COUNT], dest);
+    }
+    double elapsed_ns = now_ns() - start;
+    printf("  my_strcat %10zu fragments  %10.2f ns/append  %10.3f s\n", count,
+           elapsed_ns / (double)count, elapsed_ns / 1e9);
+    free(dest);
+}
+
+static void run_string(size_t count) {
+    MyString string;
+    my_string_init(&string);
+    size_t growths = 0, moves = 0;
+    double start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+        size_t capacity = string.capacity;
+        const char* data = my_string_cstr(&string);
+        const char* fragment = fragments[i % FRAGMENT_COUNT];
+        if (!my_string_append_bytes(&string, fragment, fragment_lengths[i % FRAGMENT_COUNT])) {
+            printf("Out of memory after %zu fragments\n", i);
+            break;
+        }
+        if (string.capacity != capacity) {
+            growths++;
+            moves += my_string_cstr(&string) != data;
+        }
+    }
+    double elapsed_ns = now_ns() - start;
+    printf("  MyString  %10zu fragments  %10.2f ns/append  %10.3f s  %zu bytes, "
+           "%zu growths (%zu moved)\n", count, elapsed_ns / (double)count, elapsed_ns / 1e9,
+           string.length, growths, moves);
+    my_string_free(&string);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    if (count == 0) {
+        count = 1;
+    }
+    make_fragments();
+
+    printf("=== Appending fragments of 1 to 16 bytes (%s kernels) ===\n", my_string_impl_name());
+    for (size_t n = 10000; n <= count && n <= STRCAT_MAX; n *= 2) {
+        run_strcat(n);
+    }
+    for (size_t n = 10000; n < count; n *= 10) {
+        run_string(n);
+    }
+    run_string(count);
+    return 0;
+}
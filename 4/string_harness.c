@@ -0,0 +1,740 @@
+// Differential test and benchmark for the string routines in 4/.
+//
+// check: runs every routine on random inputs at every kernel level and
+// compares the result and every written byte with the C library. Half the
+// inputs end right before a PROT_NONE page, so a kernel that reads past a
+// terminator crashes instead of passing. Bytes >= 0x80 are common, so a
+// signed compare shows up too. Needles include periodic ones that push
+// my_strstr onto its Two-Way path. my_utf8_validate and my_utf8_length
+// are checked the same way against a plain decoder, on valid text with one
+// defect placed across each 16, 32 and 64 byte block boundary and at the
+// end of the input. Problems go to stderr, the exit status is 1.
+//
+// bench: times every routine and the C library over a length sweep, a few
+// source and destination alignments and, for the compares and searches, an
+// early, late or no mismatch or match. Prints CSV on stdout, one row per
+// case, so runs can be kept and diffed over time. Cycles are TSC ticks on
+// x86 and are left empty elsewhere.
+//
+// Build: gcc -O2 string_harness.c -o string_harness
+// Usage: ./string_harness [check|bench|all] [trials]     (default all 20000)
+#define _GNU_SOURCE // memmem
+#define MY_STRING_NO_MAIN
+#include "my_strlen.c"
+#include "my_strcpy.c"
+#include "my_strcat.c"
+#include "my_strcmp.c"
+#include "my_strstr.c"
+#include "my_utf8.c"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define REGION_PAGES 4          // readable pages in front of each guard page
+#define CHECK_MAX_LENGTH 5000
+#define SENTINEL 0x5a
+#define BENCH_BYTES (256 * 1024) // bytes processed per timed repetition
+#define BENCH_REPEATS 5          // the fastest repetition counts
+
+typedef enum HarnessKind{
+    KIND_SCAN,      // reads a
+    KIND_COPY,      // copies a into b
+    KIND_APPEND,    // appends a to the string in b
+    KIND_COMPARE,   // compares the strings a and b
+    KIND_MEMCOMPARE,// compares n bytes of a and b, NUL included
+    KIND_FIND_CHAR, // looks for b[0] in the string a
+    KIND_MEMFIND,   // looks for b[0] in n bytes of a, NUL included
+    KIND_FIND_STRING,// looks for the string b in the string a
+    KIND_MEMFIND_STRING,// looks for the string b in n bytes of a, NUL included
+}HarnessKind;
+
+// Every routine behind one signature. Pointer results come back as an
+// offset from b (from a for the searches, SIZE_MAX for NULL) and compare
+// results as -1, 0 or 1, so that both sides of a check can be compared as
+// numbers.
+typedef size_t (*HarnessFn)(const char* a, char* b, size_t n);
+
+typedef struct HarnessRoutine{
+    const char* name;
+    HarnessKind kind;
+    bool bounded;   // takes n
+    HarnessFn mine;
+    HarnessFn libc;
+}HarnessRoutine;
+
+static size_t sign_of(int result) {
+    return (size_t)((result > 0) - (result < 0));
+}
+
+static size_t found_at(const char* a, const void* found) {
+    return found == NULL ? SIZE_MAX : (size_t)((const char*)found - a);
+}
+
+static size_t mine_strlen(const char* a, char* b, size_t n) { (void)b; (void)n; return my_strlen(a); }
+static size_t mine_strcpy(const char* a, char* b, size_t n) { (void)n; return (size_t)(my_strcpy(a, b) - b); }
+static size_t mine_strncpy(const char* a, char* b, size_t n) { return (size_t)(my_strncpy(a, b, n) - b); }
+static size_t mine_strcat(const char* a, char* b, size_t n) { (void)n; return (size_t)(my_strcat(a, b) - b); }
+static size_t mine_strncat(const char* a, char* b, size_t n) { return (size_t)(my_strncat(a, b, n) - b); }
+static size_t mine_strcmp(const char* a, char* b, size_t n) { (void)n; return sign_of(my_strcmp(a, b)); }
+static size_t mine_strncmp(const char* a, char* b, size_t n) { return sign_of(my_strncmp(a, b, n)); }
+static size_t mine_memcmp(const char* a, char* b, size_t n) { return sign_of(my_memcmp(a, b, n)); }
+static size_t mine_strchr(const char* a, char* b, size_t n) { (void)n; return found_at(a, my_strchr(a, b[0])); }
+static size_t mine_strrchr(const char* a, char* b, size_t n) { (void)n; return found_at(a, my_strrchr(a, b[0])); }
+static size_t mine_memchr(const char* a, char* b, size_t n) { return found_at(a, my_memchr(a, b[0], n)); }
+static size_t mine_strstr(const char* a, char* b, size_t n) { (void)n; return found_at(a, my_strstr(a, b)); }
+static size_t mine_memmem(const char* a, char* b, size_t n) { return found_at(a, my_memmem(a, n, b, strlen(b))); }
+
+// Called through volatile pointers so the compiler cannot expand them inline
+static size_t (*volatile libc_strlen_fn)(const char*) = strlen;
+static size_t (*volatile libc_strnlen_fn)(const char*, size_t) = strnlen;
+static char* (*volatile libc_strcpy_fn)(char*, const char*) = strcpy;
+static char* (*volatile libc_strcat_fn)(char*, const char*) = strcat;
+static int (*volatile libc_strcmp_fn)(const char*, const char*) = strcmp;
+static int (*volatile libc_strncmp_fn)(const char*, const char*, size_t) = strncmp;
+static int (*volatile libc_memcmp_fn)(const void*, const void*, size_t) = memcmp;
+static void* (*volatile libc_memcpy_fn)(void*, const void*, size_t) = memcpy;
+static char* (*volatile libc_strchr_fn)(const char*, int) = strchr;
+static char* (*volatile libc_strrchr_fn)(const char*, int) = strrchr;
+static void* (*volatile libc_memchr_fn)(const void*, int, size_t) = memchr;
+static char* (*volatile libc_strstr_fn)(const char*, const char*) = strstr;
+static void* (*volatile libc_memmem_fn)(const void*, size_t, const void*, size_t) = memmem;
+
+static size_t libc_strlen(const char* a, char* b, size_t n) { (void)b; (void)n; return libc_strlen_fn(a); }
+static size_t libc_strcpy(const char* a, char* b, size_t n) { (void)n; return (size_t)(libc_strcpy_fn(b, a) - b); }
+static size_t libc_strcat(const char* a, char* b, size_t n) { (void)n; return (size_t)(libc_strcat_fn(b, a) - b); }
+static size_t libc_strcmp(const char* a, char* b, size_t n) { (void)n; return sign_of(libc_strcmp_fn(a, b)); }
+static size_t libc_strncmp(const char* a, char* b, size_t n) { return sign_of(libc_strncmp_fn(a, b, n)); }
+static size_t libc_memcmp(const char* a, char* b, size_t n) { return sign_of(libc_memcmp_fn(a, b, n)); }
+static size_t libc_strchr(const char* a, char* b, size_t n) { (void)n; return found_at(a, libc_strchr_fn(a, b[0])); }
+static size_t libc_strrchr(const char* a, char* b, size_t n) { (void)n; return found_at(a, libc_strrchr_fn(a, b[0])); }
+static size_t libc_memchr(const char* a, char* b, size_t n) { return found_at(a, libc_memchr_fn(a, b[0], n)); }
+static size_t libc_strstr(const char* a, char* b, size_t n) { (void)n; return found_at(a, libc_strstr_fn(a, b)); }
+static size_t libc_memmem(const char* a, char* b, size_t n) { return found_at(a, libc_memmem_fn(a, n, b, strlen(b))); }
+
+// The C strncpy pads to n and returns dest, so the bounded copies are
+// modelled as strnlen + memcpy + terminator, which is also what they cost
+static size_t libc_strncpy(const char* a, char* b, size_t n) {
+    size_t length = libc_strnlen_fn(a, n);
+    libc_memcpy_fn(b, a, length);
+    b[length] = '\0';
+    return length;
+}
+
+static size_t libc_strncat(const char* a, char* b, size_t n) {
+    size_t start = libc_strlen_fn(b);
+    return start + libc_strncpy(a, b + start, n);
+}
+
+static const HarnessRoutine routines[] = {
+    { "strlen",  KIND_SCAN,       false, mine_strlen,  libc_strlen },
+    { "strcpy",  KIND_COPY,       false, mine_strcpy,  libc_strcpy },
+    { "strncpy", KIND_COPY,       true,  mine_strncpy, libc_strncpy },
+    { "strcat",  KIND_APPEND,     false, mine_strcat,  libc_strcat },
+    { "strncat", KIND_APPEND,     true,  mine_strncat, libc_strncat },
+    { "strcmp",  KIND_COMPARE,    false, mine_strcmp,  libc_strcmp },
+    { "strncmp", KIND_COMPARE,    true,  mine_strncmp, libc_strncmp },
+    { "memcmp",  KIND_MEMCOMPARE, true,  mine_memcmp,  libc_memcmp },
+    { "strchr",  KIND_FIND_CHAR,  false, mine_strchr,  libc_strchr },
+    { "strrchr", KIND_FIND_CHAR,  false, mine_strrchr, libc_strrchr },
+    { "memchr",  KIND_MEMFIND,    true,  mine_memchr,  libc_memchr },
+    { "strstr",  KIND_FIND_STRING,false, mine_strstr,  libc_strstr },
+    { "memmem",  KIND_MEMFIND_STRING,true, mine_memmem, libc_memmem },
+};
+#define ROUTINE_COUNT (sizeof(routines) / sizeof(routines[0]))
+
+static const char* levels[] = { "swar", "sse2", "avx2" };
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+// Results of timed calls land here, so the calls cannot be optimized away
+static volatile size_t sink = 0;
+
+// n bytes of a are read whatever they hold
+static bool is_raw(HarnessKind kind) {
+    return kind == KIND_MEMCOMPARE || kind == KIND_MEMFIND || kind == KIND_MEMFIND_STRING;
+}
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+// Mostly a few letters, so that compares run long, plus high bytes
+static char random_char(bool allow_nul) {
+    static const char alphabet[] = { 'a', 'b', 'c', (char)0x80, (char)0xff, (char)0x7f };
+    uint64_t r = next_random();
+    if (allow_nul && r % 16 == 0) {
+        return '\0';
+    }
+    return alphabet[(r >> 8) % sizeof(alphabet)];
+}
+
+// REGION_PAGES readable pages followed by a PROT_NONE page; returns the
+// address of the guard page
+static char* map_guarded(void) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* region = mmap(NULL, (REGION_PAGES + 1) * page, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        printf("mmap failed\n");
+        exit(1);
+    }
+    mprotect(region + REGION_PAGES * page, page, PROT_NONE);
+    return region + REGION_PAGES * page;
+}
+
+// `size` bytes that either end at the guard page or start somewhere random
+static char* place(char* guard, size_t size) {
+    size_t room = REGION_PAGES * (size_t)sysconf(_SC_PAGESIZE);
+    if (next_random() % 2 == 0) {
+        return guard - size;
+    }
+    return guard - size - 64 - (size_t)(next_random() % (room - size - 64));
+}
+
+// ---- Differential test ----
+typedef struct CheckCase{
+    char a[CHECK_MAX_LENGTH + 1];
+    char b[2 * CHECK_MAX_LENGTH + 2];
+    size_t a_size;  // bytes of a the routine may read
+    size_t b_size;  // bytes of b the routine may read or write
+    size_t n;
+}CheckCase;
+
+// Fills a and b with inputs for `routine` and the sizes to place them with
+static void make_case(const HarnessRoutine* routine, CheckCase* c) {
+    size_t length = (size_t)(next_random() % 8 == 0 ? next_random() % CHECK_MAX_LENGTH : next_random() % 300);
+    bool raw = is_raw(routine->kind);
+    // Sometimes a single letter, for long runs of candidate positions
+    bool one_letter = routine->kind >= KIND_FIND_STRING && next_random() % 4 == 0;
+    for (size_t i = 0; i < length; i++) {
+        c->a[i] = one_letter ? 'a' : random_char(raw);
+    }
+    c->a[length] = '\0';
+    c->a_size = raw ? length : length + 1;
+    c->n = routine->bounded ? (size_t)(next_random() % (length + 20)) : SIZE_MAX;
+
+    size_t copied = routine->bounded && c->n < length ? c->n : length;
+    switch (routine->kind) {
+    case KIND_SCAN:
+        c->b_size = 0;
+        break;
+    case KIND_COPY:
+        c->b_size = copied + 1;
+        break;
+    case KIND_APPEND: {
+        size_t prefix = (size_t)(next_random() % (CHECK_MAX_LENGTH / 2));
+        for (size_t i = 0; i < prefix; i++) {
+            c->b[i] = random_char(false);
+        }
+        c->b[prefix] = '\0';
+        c->b_size = prefix + copied + 1;
+        break;
+    }
+    case KIND_COMPARE:
+    case KIND_MEMCOMPARE: {
+        // Equal, one byte changed, or cut short / run longer
+        size_t b_length = length;
+        memcpy(c->b, c->a, length + 1);
+        uint64_t mode = next_random() % 4;
+        if (mode == 1 && length > 0) {
+            c->b[next_random() % length] = random_char(raw);
+        } else if (mode == 2 && !raw) {
+            b_length = (size_t)(next_random() % (length + 1));
+        } else if (mode == 3 && !raw) {
+            size_t extra = (size_t)(next_random() % 40);
+            for (size_t i = 0; i < extra; i++) {
+                c->b[length + i] = random_char(false);
+            }
+            b_length = length + extra;
+        }
+        c->b[b_length] = '\0';
+        if (raw) {
+            c->n = length;
+        }
+        c->b_size = raw ? length : b_length + 1;
+        break;
+    }
+    case KIND_FIND_CHAR:
+    case KIND_MEMFIND:
+        // Mostly a byte of the alphabet, the terminator, or one never used
+        c->b[0] = next_random() % 8 == 0 ? 'z' : random_char(true);
+        c->b_size = 1;
+        if (raw) {
+            c->n = length;
+        }
+        break;
+    case KIND_FIND_STRING:
+    case KIND_MEMFIND_STRING: {
+        // A piece of a, random bytes, or "aa...ab...a", which is periodic
+        // and matches almost everywhere in a run of 'a'
+        size_t needle_length = (size_t)(next_random() % (next_random() % 8 == 0 ? 300 : 24));
+        uint64_t mode = next_random() % 3;
+        if (mode == 0 && needle_length <= length) {
+            memcpy(c->b, c->a + next_random() % (length - needle_length + 1), needle_length);
+        } else if (mode == 1) {
+            memset(c->b, 'a', needle_length);
+            if (needle_length > 0) {
+                c->b[next_random() % needle_length] = 'b';
+            }
+        } else {
+            for (size_t i = 0; i < needle_length; i++) {
+                c->b[i] = random_char(false);
+            }
+        }
+        c->b[needle_length] = '\0';
+        c->b_size = needle_length + 1;
+        if (raw) {
+            c->n = length;
+        }
+        break;
+    }
+    }
+}
+
+static bool check_routine(const HarnessRoutine* routine, char* guard_a, char* guard_b, long trials) {
+    static CheckCase c;
+    static char expected[2 * CHECK_MAX_LENGTH + 2 + 64];
+    long failures = 0;
+    for (long trial = 0; trial < trials && failures < 5; trial++) {
+        make_case(routine, &c);
+        char* a = place(guard_a, c.a_size);
+        char* b = place(guard_b, c.b_size);
+        memcpy(a, c.a, c.a_size);
+        // Bytes of b past what the routine may write keep the sentinel
+        memset(b, SENTINEL, c.b_size);
+        memset(expected, SENTINEL, sizeof(expected));
+        size_t b_input = routine->kind == KIND_APPEND ? strlen(c.b) + 1 :
+                         routine->kind >= KIND_COMPARE ? c.b_size : 0;
+        memcpy(b, c.b, b_input);
+        memcpy(expected, c.b, b_input);
+
+        size_t want = routine->libc(c.a, expected, c.n);
+        size_t got = routine->mine(a, b, c.n);
+        bool bytes_match = memcmp(b, expected, c.b_size) == 0;
+        if (got != want || !bytes_match) {
+            fprintf(stderr, "FAIL %s (%s): a %zu bytes, b %zu bytes, n %zu: got %zu, want %zu%s\n", routine->name,
+                   my_string_impl_name(), c.a_size, c.b_size, c.n, got, want,
+                   bytes_match ? "" : ", written bytes differ");
+            failures++;
+        }
+    }
+    return failures == 0;
+}
+
+// ---- UTF-8 validation ----
+// The reference decodes each sequence and then checks the code point, the
+// way the definition reads, rather than the ranges of the second byte that
+// the kernels test.
+static bool ref_utf8_validate(const unsigned char* s, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        unsigned char lead = s[i];
+        size_t length;
+        uint32_t code_point, smallest;
+        if (lead < 0x80) {
+            i++;
+            continue;
+        } else if ((lead & 0xE0) == 0xC0) {
+            length = 2, code_point = lead & 0x1F, smallest = 0x80;
+        } else if ((lead & 0xF0) == 0xE0) {
+            length = 3, code_point = lead & 0x0F, smallest = 0x800;
+        } else if ((lead & 0xF8) == 0xF0) {
+            length = 4, code_point = lead & 0x07, smallest = 0x10000;
+        } else {
+            return false;
+        }
+        if (n - i < length) {
+            return false;
+        }
+        for (size_t k = 1; k < length; k++) {
+            if ((s[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+            code_point = code_point << 6 | (s[i + k] & 0x3F);
+        }
+        if (code_point < smallest || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
+
+static size_t ref_utf8_length(const unsigned char* s, size_t n) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += (s[i] & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+typedef enum Utf8Defect{
+    DEFECT_NONE,
+    DEFECT_OVERLONG,      // C0/C1 leads, E0 80..9F, F0 80..8F
+    DEFECT_SURROGATE,     // ED A0..BF
+    DEFECT_TOO_BIG,       // F4 90..BF, F5..FF leads
+    DEFECT_STRAY,         // a continuation byte without a lead
+    DEFECT_TRUNCATED,     // a 2 to 4 byte sequence missing its last bytes
+    DEFECT_COUNT
+}Utf8Defect;
+
+static const char* utf8_defect_names[] = { "none", "overlong", "surrogate", "too big", "stray", "truncated" };
+
+static unsigned char utf8_continuation(void) {
+    return (unsigned char)(0x80 | next_random() % 64);
+}
+
+// Encodes a random valid code point at out, often one at the edge of its
+// length or of the surrogates; returns its length
+static size_t utf8_valid_char(unsigned char* out, size_t room) {
+    static const uint32_t edges[] = { 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF, 0x10000, 0x10FFFF };
+    uint32_t code_point;
+    uint64_t r = next_random();
+    size_t length = 1 + (size_t)(r % 4);
+    if (length > room || r % 3 == 0) {
+        code_point = 'a' + (uint32_t)(next_random() % 26);
+    } else if (r % 5 == 0) {
+        code_point = edges[next_random() % (sizeof(edges) / sizeof(edges[0]))];
+    } else {
+        static const uint32_t starts[] = { 0, 0x80, 0x800, 0x10000 }, ends[] = { 0x80, 0x800, 0x10000, 0x110000 };
+        code_point = starts[length - 1] + (uint32_t)(next_random() % (ends[length - 1] - starts[length - 1]));
+        if (code_point >= 0xD800 && code_point <= 0xDFFF) {
+            code_point += 0x800;
+        }
+    }
+    length = code_point < 0x80 ? 1 : code_point < 0x800 ? 2 : code_point < 0x10000 ? 3 : 4;
+    if (length > room) {
+        out[0] = 'a';
+        return 1;
+    }
+    if (length == 1) {
+        out[0] = (unsigned char)code_point;
+        return 1;
+    }
+    static const unsigned char leads[] = { 0, 0, 0xC0, 0xE0, 0xF0 };
+    for (size_t k = length - 1; k > 0; k--) {
+        out[k] = (unsigned char)(0x80 | (code_point & 0x3F));
+        code_point >>= 6;
+    }
+    out[0] = (unsigned char)(leads[length] | code_point);
+    return length;
+}
+
+// Writes an ill-formed sequence of kind `defect` at out; returns its length
+static size_t utf8_defect(unsigned char* out, Utf8Defect defect) {
+    uint64_t r = next_random();
+    switch (defect) {
+    case DEFECT_OVERLONG:
+        if (r % 3 == 0) {
+            out[0] = (unsigned char)(0xC0 | (r >> 8) % 2);
+            out[1] = utf8_continuation();
+            return 2;
+        } else if (r % 3 == 1) {
+            out[0] = 0xE0;
+            out[1] = (unsigned char)(0x80 + (r >> 8) % 0x20);
+            out[2] = utf8_continuation();
+            return 3;
+        }
+        out[0] = 0xF0;
+        out[1] = (unsigned char)(0x80 + (r >> 8) % 0x10);
+        out[2] = utf8_continuation();
+        out[3] = utf8_continuation();
+        return 4;
+    case DEFECT_SURROGATE:
+        out[0] = 0xED;
+        out[1] = (unsigned char)(0xA0 + (r >> 8) % 0x20);
+        out[2] = utf8_continuation();
+        return 3;
+    case DEFECT_TOO_BIG:
+        if (r % 2 == 0) {
+            out[0] = 0xF4;
+            out[1] = (unsigned char)(0x90 + (r >> 8) % 0x30);
+        } else {
+            out[0] = (unsigned char)(0xF5 + (r >> 8) % 11);
+            out[1] = utf8_continuation();
+        }
+        out[2] = utf8_continuation();
+        out[3] = utf8_continuation();
+        return 4;
+    case DEFECT_STRAY:
+        out[0] = utf8_continuation();
+        return 1;
+    case DEFECT_TRUNCATED: {
+        // A valid sequence of 2 to 4 bytes, cut before its last byte or earlier
+        size_t length;
+        do {
+            length = utf8_valid_char(out, 4);
+        } while (length == 1);
+        return 1 + (size_t)(next_random() % (length - 1));
+    }
+    default:
+        return 0;
+    }
+}
+
+// Valid text with `defect` starting at byte `at` and `after` bytes of
+// valid text behind it, in out; returns the length
+static size_t utf8_make_case(unsigned char* out, size_t at, Utf8Defect defect, size_t after) {
+    size_t n = 0;
+    bool ascii = next_random() % 4 == 0;  // the ASCII fast paths up to the defect
+    while (n < at) {
+        n += ascii ? (out[n] = 'a', 1) : utf8_valid_char(out + n, at - n);
+    }
+    n += utf8_defect(out + n, defect);
+    size_t end = n + after;
+    while (n < end) {
+        n += utf8_valid_char(out + n, end - n);
+    }
+    return n;
+}
+
+static bool check_utf8_case(const unsigned char* text, size_t n, char* guard, Utf8Defect defect, size_t at) {
+    char* s = place(guard, n);
+    memcpy(s, text, n);
+    bool want = ref_utf8_validate(text, n);
+    bool got = my_utf8_validate(s, n);
+    size_t want_length = ref_utf8_length(text, n);
+    size_t got_length = my_utf8_length(s, n);
+    if (got == want && got_length == want_length) {
+        return true;
+    }
+    fprintf(stderr, "FAIL utf8 (%s): %zu bytes, %s at %zu: got %s, %zu code points, want %s, %zu\n",
+            my_string_impl_name(), n, utf8_defect_names[defect], at, got ? "valid" : "invalid", got_length,
+            want ? "valid" : "invalid", want_length);
+    return false;
+}
+
+static bool check_utf8(char* guard, long trials) {
+    static unsigned char text[CHECK_MAX_LENGTH + 16];
+    static const size_t blocks[] = { 16, 32, 64 };
+    long failures = 0;
+    // Each defect starting up to 4 bytes before the end of block 1, 2 or 3,
+    // so it straddles the boundary, and as the last bytes of the input
+    for (Utf8Defect defect = DEFECT_OVERLONG; defect < DEFECT_COUNT; defect++) {
+        for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+            for (size_t k = 1; k <= 3; k++) {
+                for (size_t back = 0; back <= 4; back++) {
+                    for (int repeat = 0; repeat < 8 && failures < 5; repeat++) {
+                        size_t at = k * blocks[b] - back;
+                        size_t after = repeat % 2 == 0 ? 0 : (size_t)(next_random() % (2 * blocks[b]));
+                        size_t n = utf8_make_case(text, at, defect, after);
+                        failures += !check_utf8_case(text, n, guard, defect, at);
+                    }
+                }
+            }
+        }
+    }
+    // Random lengths, half of them valid
+    for (long trial = 0; trial < trials && failures < 5; trial++) {
+        size_t length = (size_t)(next_random() % 8 == 0 ? next_random() % CHECK_MAX_LENGTH : next_random() % 300);
+        Utf8Defect defect = next_random() % 2 == 0 ? DEFECT_NONE : (Utf8Defect)(1 + next_random() % (DEFECT_COUNT - 1));
+        size_t at = (size_t)(next_random() % (length + 1));
+        size_t n = utf8_make_case(text, at, defect, length - at);
+        failures += !check_utf8_case(text, n, guard, defect, at);
+    }
+    return failures == 0;
+}
+
+static bool run_check(long trials) {
+    char* guard_a = map_guarded();
+    char* guard_b = map_guarded();
+    bool ok = true;
+    for (size_t level = 0; level < sizeof(levels) / sizeof(levels[0]); level++) {
+        if (!my_string_select(levels[level])) {
+            continue;
+        }
+        for (size_t r = 0; r < ROUTINE_COUNT; r++) {
+            bool passed = check_routine(&routines[r], guard_a, guard_b, trials);
+            fprintf(stderr, "check %-8s %-5s %s\n", routines[r].name, levels[level], passed ? "ok" : "FAILED");
+            ok = ok && passed;
+        }
+        bool passed = check_utf8(guard_a, trials);
+        fprintf(stderr, "check %-8s %-5s %s\n", "utf8", levels[level], passed ? "ok" : "FAILED");
+        ok = ok && passed;
+    }
+    my_string_select(NULL);
+    return ok;
+}
+
+// ---- Benchmark ----
+static const size_t bench_lengths[] = { 1, 7, 16, 31, 64, 127, 256, 1024, 4096, 16384 };
+static const size_t src_aligns[] = { 0, 1, 15 };
+static const size_t dst_aligns[] = { 0, 5 };
+
+// Where compared strings first differ, or where the searched-for byte or
+// needle is
+typedef enum Position{
+    POSITION_NONE,
+    POSITION_EARLY, // an eighth of the way in
+    POSITION_LATE,  // the last byte
+}Position;
+
+static const char* position_names[] = { "none", "early", "late" };
+
+#define BENCH_TARGET '#'        // the byte the character searches look for
+#define BENCH_NEEDLE "nopqrsTu" // its first and last byte come every 26 bytes
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void) {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Times one case and prints its row
+static void bench_case(const HarnessRoutine* routine, const char* impl, HarnessFn fn, char* a, char* b,
+                       size_t length, size_t src_align, size_t dst_align, Position position) {
+    size_t n = is_raw(routine->kind) ? length : length + 1;
+    size_t prefix = routine->kind == KIND_APPEND ? length : 0;
+    // Bytes the routine has to look at
+    size_t bytes = length;
+    if (position == POSITION_EARLY) {
+        bytes = length / 8 + 1;
+    }
+    bytes += prefix;
+    long calls = (long)(BENCH_BYTES / bytes) + 16;
+
+    double best_ns = 1e300;
+    uint64_t best_cycles = UINT64_MAX;
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        double start_ns = now_ns();
+        uint64_t start_cycles = now_cycles();
+        if (routine->kind == KIND_APPEND) {
+            for (long i = 0; i < calls; i++) {
+                sink += fn(a, b, n);
+                b[prefix] = '\0';
+            }
+        } else {
+            for (long i = 0; i < calls; i++) {
+                sink += fn(a, b, n);
+            }
+        }
+        uint64_t cycles = now_cycles() - start_cycles;
+        double elapsed_ns = now_ns() - start_ns;
+        best_ns = elapsed_ns < best_ns ? elapsed_ns : best_ns;
+        best_cycles = cycles < best_cycles ? cycles : best_cycles;
+    }
+
+    printf("%s,%s,%zu,%zu,%zu,%s,%.2f,", routine->name, impl, length, src_align, dst_align,
+           routine->kind >= KIND_COMPARE ? position_names[position] : "", best_ns / (double)calls);
+    if (best_cycles != 0) {
+        printf("%.1f,%.3f\n", (double)best_cycles / (double)calls, (double)bytes * (double)calls / (double)best_cycles);
+    } else {
+        printf(",\n");
+    }
+}
+
+// Writes the inputs of one case: a holds `length` bytes at src_align; b is
+// the destination, the string appended to or compared with, the byte
+// searched for, or the needle
+static void setup_case(const HarnessRoutine* routine, char* a, char* b, size_t length, Position position) {
+    for (size_t i = 0; i < length; i++) {
+        a[i] = (char)('a' + i % 26);
+    }
+    a[length] = '\0';
+    size_t at = position == POSITION_EARLY ? length / 8 : length - 1;
+    switch (routine->kind) {
+    case KIND_APPEND:
+        memset(b, 'x', length);
+        b[length] = '\0';
+        break;
+    case KIND_COMPARE:
+    case KIND_MEMCOMPARE:
+        memcpy(b, a, length + 1);
+        if (position != POSITION_NONE) {
+            b[at] = 'A';
+        }
+        break;
+    case KIND_FIND_CHAR:
+    case KIND_MEMFIND:
+        b[0] = BENCH_TARGET;
+        if (position != POSITION_NONE) {
+            a[at] = BENCH_TARGET;
+        }
+        break;
+    case KIND_FIND_STRING:
+    case KIND_MEMFIND_STRING: {
+        // Cut short to fit the shortest haystacks; a match ends at `at`
+        size_t needle_length = length < 8 ? length : 8;
+        memcpy(b, BENCH_NEEDLE, needle_length);
+        b[needle_length] = '\0';
+        if (position != POSITION_NONE) {
+            at = at + 1 < needle_length ? needle_length - 1 : at;
+            memcpy(a + at + 1 - needle_length, b, needle_length);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void run_bench(void) {
+    size_t largest = bench_lengths[sizeof(bench_lengths) / sizeof(bench_lengths[0]) - 1];
+    char* a_buffer = aligned_alloc(64, largest + 128);
+    char* b_buffer = aligned_alloc(64, 2 * largest + 128);
+
+    printf("function,impl,length,src_align,dst_align,position,ns_per_call,cycles_per_call,bytes_per_cycle\n");
+    for (size_t r = 0; r < ROUTINE_COUNT; r++) {
+        const HarnessRoutine* routine = &routines[r];
+        bool uses_b = routine->kind != KIND_SCAN;
+        Position last_position = routine->kind >= KIND_COMPARE ? POSITION_LATE : POSITION_NONE;
+        for (size_t l = 0; l < sizeof(bench_lengths) / sizeof(bench_lengths[0]); l++) {
+            for (size_t s = 0; s < sizeof(src_aligns) / sizeof(src_aligns[0]); s++) {
+                for (size_t d = 0; d < (uses_b ? sizeof(dst_aligns) / sizeof(dst_aligns[0]) : 1); d++) {
+                    for (Position m = POSITION_NONE; m <= last_position; m++) {
+                        char* a = a_buffer + src_aligns[s];
+                        char* b = b_buffer + dst_aligns[d];
+                        size_t length = bench_lengths[l];
+                        setup_case(routine, a, b, length, m);
+                        bench_case(routine, "libc", routine->libc, a, b, length, src_aligns[s], dst_aligns[d], m);
+                        for (size_t level = 0; level < sizeof(levels) / sizeof(levels[0]); level++) {
+                            if (my_string_select(levels[level])) {
+                                bench_case(routine, levels[level], routine->mine, a, b, length,
+                                           src_aligns[s], dst_aligns[d], m);
+                            }
+                        }
+                        my_string_select(NULL);
+                    }
+                }
+            }
+        }
+    }
+    free(a_buffer);
+    free(b_buffer);
+}
+
+int main(int argc, char const *argv[])
+{
+    const char* mode = argc > 1 ? argv[1] : "all";
+    long trials = argc > 2 ? atol(argv[2]) : 20000;
+    bool check = strcmp(mode, "check") == 0 || strcmp(mode, "all") == 0;
+    bool bench = strcmp(mode, "bench") == 0 || strcmp(mode, "all") == 0;
+    if (!check && !bench) {
+        printf("Usage: %s [check|bench|all] [trials]\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+    if (check) {
+        ok = run_check(trials);
+        fprintf(stderr, "check %s (%ld trials per routine and level)\n", ok ? "passed" : "FAILED", trials);
+    }
+    if (bench) {
+        run_bench();
+    }
+    return ok ? 0 : 1;
+}
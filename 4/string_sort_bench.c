@@ -0,0 +1,85 @@
+// Sorts URL-like keys with qsort and a my_strcmp comparator, and with
+// my_string_sort on 1 to 4 threads. The keys share long prefixes
+// ("https://www.example...."), which is where comparison sorts rescan the
+// most.
+//
+// Build: gcc -O2 -pthread string_sort_bench.c -o string_sort_bench
+// Usage: ./string_sort_bench [keys]     (default 10000000)
+#include <stdlib.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "../5/malloc copy.c"
+#include "my_string_sort.h"
+
+static const char* hosts[] = { "www.example.com", "www.example.org", "api.example.com", "cdn.example.net",
+                               "shop.example.com", "www.example.co.id" };
+static const char* sections[] = { "products", "users", "search", "static/img", "blog/2024", "docs/api/v2" };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// The allocator already has a my_strcmp, so this calls the 4/ kernel the
+// way my_strcmp.c does
+static int compare_keys(const void* a, const void* b) {
+    return str_ncmp_impls[str_level](*(const char* const*)a, *(const char* const*)b, SIZE_MAX);
+}
+
+// Keys like "https://shop.example.com/blog/2024/item-48213?page=7", in one
+// buffer; returns them in random order
+static const char** make_keys(size_t count, char** storage) {
+    *storage = malloc(count * 80);
+    const char** keys = malloc(count * sizeof(char*));
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    char* at = *storage;
+    for (size_t i = 0; i < count; i++) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        int length = snprintf(at, 80, "https://%s/%s/item-%u?page=%u", hosts[(rng >> 20) % 6],
+                              sections[(rng >> 30) % 6], (unsigned)(rng >> 40) % 1000000, (unsigned)(rng >> 60));
+        keys[i] = at;
+        at += length + 1;
+    }
+    return keys;
+}
+
+static bool is_sorted(const char** keys, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        if (compare_keys(&keys[i - 1], &keys[i]) > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    count = count == 0 ? 1 : count;
+    char* storage;
+    const char** keys = make_keys(count, &storage);
+    const char** work = malloc(count * sizeof(char*));
+    printf("=== Sorting %zu URL-like keys (%s kernels) ===\n", count, my_string_impl_name());
+
+    memcpy(work, keys, count * sizeof(char*));
+    double start = now_ns();
+    qsort(work, count, sizeof(char*), compare_keys);
+    double qsort_ns = now_ns() - start;
+    printf("  %-28s %8.3f s%s\n", "qsort + my_strcmp", qsort_ns / 1e9, is_sorted(work, count) ? "" : "   NOT SORTED");
+
+    for (int threads = 1; threads <= 4; threads *= 2) {
+        memcpy(work, keys, count * sizeof(char*));
+        start = now_ns();
+        bool ok = my_string_sort_parallel(work, count, threads);
+        double ns = now_ns() - start;
+        char what[48];
+        snprintf(what, sizeof(what), "my_string_sort, %d thread%s", threads, threads == 1 ? "" : "s");
+        printf("  %-28s %8.3f s   %5.2fx%s\n", what, ns / 1e9, qsort_ns / ns,
+               ok && is_sorted(work, count) ? "" : "   NOT SORTED");
+    }
+    free(work);
+    free(keys);
+    free(storage);
+    return 0;
+}
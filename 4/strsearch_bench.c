@@ -0,0 +1,167 @@
+// my_memchr, my_strchr, my_strrchr and my_strstr against glibc over a
+// multi-GB log-like text, plus a "aaaa..." haystack with a periodic needle
+// that makes a naive search quadratic.
+//
+// Build: gcc -O2 strsearch_bench.c -o strsearch_bench
+// Usage: ./strsearch_bench [text MB]     (default 2048)
+#define MY_STRING_NO_MAIN
+#include "my_strstr.c"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define BLOCK_SIZE (4 << 20)        // the text repeats a block of this size
+#define ADVERSARIAL_SIZE (256 << 20)
+
+static char* (*volatile glibc_strchr)(const char*, int) = strchr;
+static char* (*volatile glibc_strrchr)(const char*, int) = strrchr;
+static void* (*volatile glibc_memchr)(const void*, int, size_t) = memchr;
+static char* (*volatile glibc_strstr)(const char*, const char*) = strstr;
+
+static const char* levels[] = { "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR" };
+static const char* messages[] = {
+    "request served",
+    "cache miss for key",
+    "connection reset by peer",
+    "retrying upstream call",
+    "user session refreshed",
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char* map_text(size_t size) {
+    char* text = mmap(NULL, size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (text == MAP_FAILED) {
+        printf("Could not map %zu bytes\n", size + 1);
+        exit(1);
+    }
+    return text;
+}
+
+// Log lines of ~70 bytes; one in seven is an ERROR line
+static void fill_log(char* text, size_t size) {
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    size_t block = size < BLOCK_SIZE ? size : BLOCK_SIZE;
+    size_t at = 0;
+    while (at < block) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        char line[160];
+        int length = snprintf(line, sizeof(line), "2024-05-01 %02u:%02u:%02u %s worker-%u %s %u in %u ms\n",
+                              (unsigned)(rng >> 59), (unsigned)(rng >> 20) % 60, (unsigned)(rng >> 26) % 60,
+                              levels[(rng >> 33) % 7], (unsigned)(rng >> 40) % 64, messages[(rng >> 46) % 5],
+                              (unsigned)(rng >> 12) % 100000, (unsigned)(rng >> 52) % 1000);
+        size_t copy = block - at < (size_t)length ? block - at : (size_t)length;
+        memcpy(text + at, line, copy);
+        at += copy;
+    }
+    for (; at < size; at += block) {
+        memcpy(text + at, text, size - at < block ? size - at : block);
+    }
+    text[size] = '\0';
+}
+
+// Prints glibc's and our throughput for one search over `bytes` bytes
+static void report(const char* what, size_t bytes, double glibc_ns, double mine_ns, size_t glibc_count, size_t mine_count) {
+    printf("  %-40s glibc %6.2f GB/s   mine %6.2f GB/s   %s\n", what, (double)bytes / glibc_ns,
+           (double)bytes / mine_ns, glibc_count == mine_count ? "" : "RESULTS DIFFER");
+}
+
+// Counts the matches of `needle` walking the whole text with `search`
+static size_t count_matches(char* (*search)(const char*, const char*), const char* text, const char* needle) {
+    size_t count = 0;
+    size_t step = strlen(needle);
+    for (const char* at = search(text, needle); at != NULL; at = search(at + step, needle)) {
+        count++;
+    }
+    return count;
+}
+
+static size_t count_lines(void* (*search)(const void*, int, size_t), const char* text, size_t size) {
+    size_t count = 0;
+    const char* end = text + size;
+    for (const char* at = search(text, '\n', size); at != NULL; at = search(at + 1, '\n', (size_t)(end - at - 1))) {
+        count++;
+    }
+    return count;
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 2048;
+    size_t size = (megabytes == 0 ? 1 : megabytes) << 20;
+    char* text = map_text(size);
+    fill_log(text, size);
+    printf("=== Searching %zu MB of log text (%s kernels) ===\n", size >> 20, my_string_impl_name());
+
+    double start = now_ns();
+    size_t glibc_count = (size_t)((char*)glibc_memchr(text, '@', size) != NULL);
+    double glibc_ns = now_ns() - start;
+    start = now_ns();
+    size_t mine_count = (size_t)((char*)my_memchr(text, '@', size) != NULL);
+    report("memchr, absent byte", size, glibc_ns, now_ns() - start, glibc_count, mine_count);
+
+    start = now_ns();
+    glibc_count = (size_t)(glibc_strchr(text, '@') != NULL);
+    glibc_ns = now_ns() - start;
+    start = now_ns();
+    mine_count = (size_t)(my_strchr(text, '@') != NULL);
+    report("strchr, absent byte", size, glibc_ns, now_ns() - start, glibc_count, mine_count);
+
+    start = now_ns();
+    glibc_count = (size_t)(glibc_strrchr(text, '2') - text);
+    glibc_ns = now_ns() - start;
+    start = now_ns();
+    mine_count = (size_t)(my_strrchr(text, '2') - text);
+    report("strrchr, last '2'", size, glibc_ns, now_ns() - start, glibc_count, mine_count);
+
+    start = now_ns();
+    glibc_count = count_lines(glibc_memchr, text, size);
+    glibc_ns = now_ns() - start;
+    start = now_ns();
+    mine_count = count_lines(my_memchr, text, size);
+    report("memchr, every line break", size, glibc_ns, now_ns() - start, glibc_count, mine_count);
+
+    const char* needles[] = {
+        "ERROR",
+        "connection reset by peer",
+        "FATAL",
+        "worker-17 connection reset by peer 4",
+        "2024-05-01 25:00:00 FATAL worker-99 the disk is on fire and nobody came",
+    };
+    for (size_t i = 0; i < sizeof(needles) / sizeof(needles[0]); i++) {
+        start = now_ns();
+        glibc_count = count_matches(glibc_strstr, text, needles[i]);
+        glibc_ns = now_ns() - start;
+        start = now_ns();
+        mine_count = count_matches(my_strstr, text, needles[i]);
+        double mine_ns = now_ns() - start;
+        char what[64];
+        snprintf(what, sizeof(what), "strstr, %zu byte needle (%zu hits)", strlen(needles[i]), mine_count);
+        report(what, size, glibc_ns, mine_ns, glibc_count, mine_count);
+    }
+    munmap(text, size + 1);
+
+    // Every position is a candidate for the filter; only Two-Way keeps this linear
+    size_t adversarial_size = size < ADVERSARIAL_SIZE ? size : ADVERSARIAL_SIZE;
+    text = map_text(adversarial_size);
+    memset(text, 'a', adversarial_size);
+    text[adversarial_size] = '\0';
+    char needle[65];
+    memset(needle, 'a', 64);
+    needle[32] = 'b';
+    needle[64] = '\0';
+    printf("\n=== %zu MB of 'a' ===\n", adversarial_size >> 20);
+    start = now_ns();
+    glibc_count = (size_t)(glibc_strstr(text, needle) != NULL);
+    glibc_ns = now_ns() - start;
+    start = now_ns();
+    mine_count = (size_t)(my_strstr(text, needle) != NULL);
+    report("strstr, \"a...aba...a\", 64 bytes", adversarial_size, glibc_ns, now_ns() - start, glibc_count, mine_count);
+    munmap(text, adversarial_size + 1);
+    return 0;
+}
@@ -0,0 +1,219 @@
+// Scans a large text file in parallel on the string kernels: counts its
+// lines, prints (or counts) the lines holding a fixed string, or prints one
+// field of every line. The file is mapped rather than read (see my_scan.h),
+// and lines and fields are handled in place; only output is copied, into a
+// buffer per thread that is written out in file order. Throughput goes to
+// stderr.
+//
+// Build: gcc -O2 -pthread text_scan.c -o text_scan
+// Usage: ./text_scan [-t threads] lines FILE
+//        ./text_scan [-t threads] grep [-c] PATTERN FILE
+//        ./text_scan [-t threads] field N DELIMITERS FILE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "../5/malloc copy.c"
+#include "../5/my_buffer.h"
+#include "my_scan.h"
+#include "my_split.h"
+
+typedef enum ScanMode{
+    MODE_LINES,
+    MODE_GREP,
+    MODE_FIELD
+}ScanMode;
+
+typedef struct ScanThread{
+    MyBuffer output;         // lines of the current chunk, not flushed yet
+    size_t count;            // lines counted or matched
+    bool failed;             // out of memory for output
+}ScanThread;
+
+typedef struct ScanJob{
+    ScanMode mode;
+    bool count_only;
+    const char* pattern;
+    size_t pattern_length;
+    size_t field;            // 1 based
+    MySplitClass delimiters; // '\n' and the field delimiters
+    ScanThread threads[MY_SCAN_MAX_THREADS];
+}ScanJob;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Appends a line and its '\n', which the last line of the file may lack
+static void emit_line(ScanThread* thread, const char* line, size_t length) {
+    if (!my_buffer_append(&thread->output, line, length) || !my_buffer_append(&thread->output, "\n", 1)) {
+        thread->failed = true;
+    }
+}
+
+static void grep_chunk(ScanJob* job, ScanThread* thread, const char* data, size_t size) {
+    const char* end = data + size;
+    const char* line = data;    // start of a line, at or before the next match
+    while (line < end) {
+        const char* match = str_memmem(line, (size_t)(end - line), job->pattern, job->pattern_length);
+        if (match == NULL) {
+            break;
+        }
+        // The pattern holds no '\n', so its line starts after the last one before it
+        const char* start = match;
+        while (start > line && start[-1] != '\n') {
+            start--;
+        }
+        const char* newline = str_memchr_impls[str_level](match, '\n', (size_t)(end - match));
+        const char* stop = newline == NULL ? end : newline;
+        thread->count++;
+        if (!job->count_only) {
+            emit_line(thread, start, (size_t)(stop - start));
+        }
+        line = stop + 1;
+    }
+}
+
+static void field_chunk(ScanJob* job, ScanThread* thread, const char* data, size_t size) {
+    MySplitter splitter;
+    MyStringView field;
+    splitter.set = job->delimiters;
+    my_split_reset(&splitter, data, size);
+    size_t index = 1;
+    while (my_split_next(&splitter, &field)) {
+        if (splitter.delimiter < 0 && index == 1 && field.length == 0) {
+            break;   // nothing after the last '\n'
+        }
+        if (index == job->field) {
+            if (!my_buffer_append(&thread->output, field.data, field.length)) {
+                thread->failed = true;
+            }
+        }
+        if (splitter.delimiter == '\n' || splitter.delimiter < 0) {
+            // Lines without that field print as empty lines
+            if (!my_buffer_append(&thread->output, "\n", 1)) {
+                thread->failed = true;
+            }
+            thread->count++;
+            index = 1;
+        } else {
+            index++;
+        }
+    }
+}
+
+static void scan_chunk(void* context, int thread, const char* data, size_t size) {
+    ScanJob* job = context;
+    ScanThread* state = &job->threads[thread];
+    switch (job->mode) {
+    case MODE_LINES:
+        // Like wc -l: a last line without its '\n' is not counted
+        state->count += my_scan_count(data, size, '\n');
+        break;
+    case MODE_GREP:
+        grep_chunk(job, state, data, size);
+        break;
+    case MODE_FIELD:
+        field_chunk(job, state, data, size);
+        break;
+    }
+}
+
+static void flush_chunk(void* context, int thread) {
+    ScanThread* state = &((ScanJob*)context)->threads[thread];
+    fwrite(state->output.data, 1, state->output.length, stdout);
+    state->output.length = 0;
+}
+
+static int usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [-t threads] lines FILE\n"
+            "       %s [-t threads] grep [-c] PATTERN FILE\n"
+            "       %s [-t threads] field N DELIMITERS FILE\n",
+            program, program, program);
+    return 1;
+}
+
+int main(int argc, char const *argv[])
+{
+    static ScanJob job;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0) {
+        threads = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if (arg >= argc) {
+        return usage(argv[0]);
+    }
+
+    const char* mode = argv[arg++];
+    if (strcmp(mode, "lines") == 0 && argc - arg == 1) {
+        job.mode = MODE_LINES;
+    } else if (strcmp(mode, "grep") == 0 && argc - arg >= 2) {
+        job.mode = MODE_GREP;
+        if (strcmp(argv[arg], "-c") == 0) {
+            job.count_only = true;
+            arg++;
+        }
+        if (argc - arg != 2) {
+            return usage(argv[0]);
+        }
+        job.pattern = argv[arg++];
+        job.pattern_length = strlen(job.pattern);
+    } else if (strcmp(mode, "field") == 0 && argc - arg == 3) {
+        job.mode = MODE_FIELD;
+        job.field = strtoul(argv[arg++], NULL, 10);
+        char delimiters[256] = "\n";
+        snprintf(delimiters + 1, sizeof(delimiters) - 1, "%s", argv[arg++]);
+        if (job.field == 0 || delimiters[1] == '\0' || !my_split_class_init(&job.delimiters, delimiters)) {
+            fprintf(stderr, "%s: fields are numbered from 1, with 1 to %d delimiters besides newline\n",
+                    argv[0], MY_SPLIT_MAX_DELIMITERS - 1);
+            return 1;
+        }
+    } else {
+        return usage(argv[0]);
+    }
+    if (job.mode == MODE_GREP && strchr(job.pattern, '\n') != NULL) {
+        fprintf(stderr, "%s: the pattern cannot span lines\n", argv[0]);
+        return 1;
+    }
+
+    const char* path = argv[arg];
+    MyScanFile file;
+    if (!my_scan_open(&file, path)) {
+        perror(path);
+        return 1;
+    }
+    for (int t = 0; t < MY_SCAN_MAX_THREADS; t++) {
+        my_buffer_init(&job.threads[t].output);
+    }
+
+    bool printing = job.mode == MODE_FIELD || (job.mode == MODE_GREP && !job.count_only);
+    double start = now_ns();
+    int used = my_scan_parallel(file.data, file.size, threads, scan_chunk, printing ? flush_chunk : NULL, &job);
+    double ns = now_ns() - start;
+
+    size_t count = 0;
+    bool failed = false;
+    for (int t = 0; t < MY_SCAN_MAX_THREADS; t++) {
+        count += job.threads[t].count;
+        failed |= job.threads[t].failed;
+        my_buffer_free(&job.threads[t].output);
+    }
+    if (!printing) {
+        printf("%zu\n", count);
+    }
+    fflush(stdout);
+    fprintf(stderr, "%s: %zu MB, %zu lines, %.3f s, %.2f GB/s on %d thread%s (%s kernels)\n", path, file.size >> 20,
+            count, ns / 1e9, ns > 0 ? (double)file.size / ns : 0.0, used, used == 1 ? "" : "s", my_string_impl_name());
+    my_scan_close(&file);
+    if (failed) {
+        fprintf(stderr, "%s: out of memory, output is incomplete\n", argv[0]);
+        return 1;
+    }
+    return job.mode == MODE_GREP && count == 0 ? 1 : 0;
+}
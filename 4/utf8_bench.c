@@ -0,0 +1,144 @@
+// my_utf8_validate and my_utf8_length at every kernel level against a
+// byte-at-a-time decoder, on ASCII log text, mostly-ASCII text with some
+// accented words, and text that is mostly 3 and 4 byte sequences.
+//
+// Build: gcc -O2 utf8_bench.c -o utf8_bench
+// Usage: ./utf8_bench [text MB]     (default 256)
+#define MY_STRING_NO_MAIN
+#include "my_utf8.c"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PASSES 4
+
+static const char* ascii_words[] = { "request", "served", "in", "12", "ms", "worker-7", "cache", "miss", "INFO" };
+static const char* accented_words[] = { "caf\xC3\xA9", "na\xC3\xAFve", "\xC3\xBC" "ber", "se\xC3\xB1or", "stra\xC3\x9F" "e" };
+static const char* wide_words[] = {
+    "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E",         // three 3 byte characters
+    "\xED\x95\x9C\xEA\xB5\xAD\xEC\x96\xB4",         // three more
+    "\xF0\x9F\x98\x80\xF0\x9F\x8C\x8F",             // two 4 byte emoji
+    "\xD0\x9C\xD0\xB8\xD1\x80",                     // three 2 byte characters
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Words separated by spaces; `accented` and `wide` are per mille chances
+static char* make_text(size_t size, unsigned accented, unsigned wide) {
+    char* text = malloc(size);
+    uint64_t rng = 0x9E3779B97F4A7C15ULL;
+    size_t at = 0;
+    for (;;) {
+        rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+        unsigned pick = (unsigned)(rng >> 40) % 1000;
+        const char* word = pick < wide ? wide_words[(rng >> 20) % 4]
+                         : pick < wide + accented ? accented_words[(rng >> 20) % 5]
+                         : ascii_words[(rng >> 20) % 9];
+        size_t length = strlen(word);
+        if (at + length + 1 > size) {
+            break;
+        }
+        memcpy(text + at, word, length);
+        text[at + length] = (rng >> 60) == 0 ? '\n' : ' ';
+        at += length + 1;
+    }
+    memset(text + at, ' ', size - at);
+    return text;
+}
+
+// What the pipeline did before: decode and check every sequence in turn
+static bool bytewise_validate(const char* s, size_t n, size_t* code_points) {
+    const unsigned char* p = (const unsigned char*)s;
+    size_t count = 0;
+    for (size_t i = 0; i < n; count++) {
+        unsigned char c = p[i];
+        uint32_t value;
+        size_t length;
+        if (c < 0x80) {
+            i++;
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            value = c & 0x1F;
+            length = 2;
+        } else if ((c & 0xF0) == 0xE0) {
+            value = c & 0x0F;
+            length = 3;
+        } else if ((c & 0xF8) == 0xF0) {
+            value = c & 0x07;
+            length = 4;
+        } else {
+            return false;
+        }
+        if (n - i < length) {
+            return false;
+        }
+        for (size_t k = 1; k < length; k++) {
+            if ((p[i + k] & 0xC0) != 0x80) {
+                return false;
+            }
+            value = value << 6 | (p[i + k] & 0x3F);
+        }
+        if ((length == 2 && value < 0x80) || (length == 3 && value < 0x800) || (length == 4 && value < 0x10000) ||
+            value > 0x10FFFF || (value >= 0xD800 && value <= 0xDFFF)) {
+            return false;
+        }
+        i += length;
+    }
+    *code_points = count;
+    return true;
+}
+
+static void run_text(const char* name, const char* text, size_t size) {
+    size_t expected = 0;
+    double start = now_ns();
+    bool valid = false;
+    for (int pass = 0; pass < PASSES; pass++) {
+        valid = bytewise_validate(text, size, &expected);
+    }
+    double bytewise_ns = (now_ns() - start) / PASSES;
+    printf("%s: %zu MB, %zu code points, %s\n", name, size >> 20, expected, valid ? "valid" : "INVALID");
+    printf("  %-10s validate+count %6.2f GB/s\n", "bytewise", (double)size / bytewise_ns);
+
+    const char* impls[] = { "swar", "sse2", "avx2" };
+    for (int i = 0; i < 3; i++) {
+        if (!my_string_select(impls[i])) {
+            continue;
+        }
+        bool ok = true;
+        start = now_ns();
+        for (int pass = 0; pass < PASSES; pass++) {
+            ok &= my_utf8_validate(text, size);
+        }
+        double validate_ns = (now_ns() - start) / PASSES;
+        size_t count = 0;
+        start = now_ns();
+        for (int pass = 0; pass < PASSES; pass++) {
+            count = my_utf8_length(text, size);
+        }
+        double length_ns = (now_ns() - start) / PASSES;
+        printf("  %-10s validate %6.2f GB/s   length %6.2f GB/s%s\n", impls[i], (double)size / validate_ns,
+               (double)size / length_ns, ok == valid && count == expected ? "" : "   RESULTS DIFFER");
+    }
+    my_string_select(NULL);
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+    size_t size = (megabytes == 0 ? 1 : megabytes) << 20;
+
+    char* text = make_text(size, 0, 0);
+    run_text("ASCII", text, size);
+    free(text);
+    text = make_text(size, 50, 20);
+    run_text("Mostly ASCII", text, size);
+    free(text);
+    text = make_text(size, 50, 800);
+    run_text("Mostly multibyte", text, size);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Compares STL containers on the default allocator against the adapters in
+// my_allocator.hpp.
+//
+// Build:
+//   gcc -O2 -c -DMY_MALLOC_NO_MAIN "malloc copy.c" -o my_malloc.o
+//   g++ -O2 -std=c++17 allocator_bench.cpp my_malloc.o -o allocator_bench
+//   ./allocator_bench [elements]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+#include "my_allocator.hpp"
+
+using my_alloc::MyAllocator;
+
+template <class Fn>
+static double time_ms(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Keeps the optimizer from dropping the work
+static volatile long sink;
+
+template <class Vector>
+static void vector_workload(Vector& v, int n) {
+    for (int i = 0; i < n; i++) {
+        v.push_back(i);
+    }
+    long sum = 0;
+    for (int x : v) {
+        sum += x;
+    }
+    sink = sum;
+}
+
+template <class Map>
+static void map_workload(Map& m, int n) {
+    for (int i = 0; i < n; i++) {
+        m[(i * 7919) % n] = i;
+    }
+    long sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += m.count(i);
+    }
+    for (int i = 0; i < n; i += 2) {
+        m.erase(i);
+    }
+    sink = sum + (long)m.size();
+}
+
+static void report(const char* workload, const char* allocator, double ms, int n) {
+    printf("%-15s %-22s %10.3f ms %10.1f ns/op\n", workload, allocator, ms, ms * 1e6 / n);
+}
+
+int main(int argc, char const *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 20000;
+    std::pmr::memory_resource* resource = my_alloc::my_memory_resource();
+
+    printf("=== STL containers: default allocator vs my_malloc adapters (%d elements) ===\n", n);
+
+    report("vector<int>", "std::allocator", time_ms([&] {
+        std::vector<int> v;
+        vector_workload(v, n);
+    }), n);
+    report("vector<int>", "MyAllocator", time_ms([&] {
+        std::vector<int, MyAllocator<int>> v;
+        vector_workload(v, n);
+    }), n);
+    report("vector<int>", "pmr (MyMemoryResource)", time_ms([&] {
+        std::pmr::vector<int> v(resource);
+        vector_workload(v, n);
+    }), n);
+
+    report("unordered_map", "std::allocator", time_ms([&] {
+        std::unordered_map<int, int> m;
+        map_workload(m, n);
+    }), n);
+    report("unordered_map", "MyAllocator", time_ms([&] {
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                           MyAllocator<std::pair<const int, int>>> m;
+        map_workload(m, n);
+    }), n);
+    report("unordered_map", "pmr (MyMemoryResource)", time_ms([&] {
+        std::pmr::unordered_map<int, int> m(resource);
+        map_workload(m, n);
+    }), n);
+
+    report("map", "std::allocator", time_ms([&] {
+        std::map<int, int> m;
+        map_workload(m, n);
+    }), n);
+    report("map", "MyAllocator", time_ms([&] {
+        std::map<int, int, std::less<int>, MyAllocator<std::pair<const int, int>>> m;
+        map_workload(m, n);
+    }), n);
+    report("map", "pmr (MyMemoryResource)", time_ms([&] {
+        std::pmr::map<int, int> m(resource);
+        map_workload(m, n);
+    }), n);
+
+    // Over-aligned allocations go through the adapter's offset path
+    struct alignas(64) CacheLine {
+        char bytes[64];
+    };
+    std::vector<CacheLine, MyAllocator<CacheLine>> lines(16);
+    printf("\n64-byte aligned vector data at %p (%s)\n", (void*)lines.data(),
+           reinterpret_cast<std::uintptr_t>(lines.data()) % 64 == 0 ? "aligned" : "MISALIGNED");
+    return 0;
+}
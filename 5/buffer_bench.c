@@ -0,0 +1,117 @@
+// Appends small records to growable buffers, once with plain copy-on-grow
+// doubling and once with MyBuffer, which tries my_try_expand first, and
+// reports how many copies growing in place avoided.
+//
+// Build: gcc -O2 buffer_bench.c -o buffer_bench
+// Usage: ./buffer_bench [records]     (default 100000000)
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "malloc copy.c"
+#include "my_buffer.h"
+
+typedef struct Record{
+    uint64_t id;
+    uint32_t kind;
+    uint32_t value;
+}Record;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// What the dynamic arrays did before: double, allocate, copy, free
+static bool copy_on_grow_reserve(MyBuffer* buffer, size_t min_capacity) {
+    if (min_capacity <= buffer->capacity) {
+        return true;
+    }
+    size_t capacity = buffer->capacity * 2;
+    if (capacity < min_capacity) {
+        capacity = min_capacity;
+    }
+    char* data = my_malloc(capacity);
+    if (data == NULL) {
+        return false;
+    }
+    if (buffer->data != NULL) {
+        memcpy(data, buffer->data, buffer->length);
+        my_free(buffer->data);
+        buffer->grown_by_copy++;
+        buffer->bytes_copied += buffer->length;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+// Spreads `records` over `buffer_count` buffers round-robin, so with more
+// than one buffer their blocks compete for the space behind each other.
+static void run_appends(bool try_expand, size_t records, int buffer_count) {
+    enum { MAX_BUFFERS = 8 };
+    MyBuffer buffers[MAX_BUFFERS];
+    for (int b = 0; b < buffer_count; b++) {
+        my_buffer_init(&buffers[b]);
+    }
+
+    double start = now_ns();
+    for (size_t i = 0; i < records; i++) {
+        MyBuffer* buffer = &buffers[i % buffer_count];
+        Record record = { i, (uint32_t)(i & 7), (uint32_t)(i * 2654435761u) };
+        bool ok = try_expand ? my_buffer_append(buffer, &record, sizeof(record))
+                             : copy_on_grow_reserve(buffer, buffer->length + sizeof(record));
+        if (!ok) {
+            printf("Out of memory after %zu records\n", i);
+            break;
+        }
+        if (!try_expand) {
+            memcpy(buffer->data + buffer->length, &record, sizeof(record));
+            buffer->length += sizeof(record);
+        }
+    }
+    double elapsed_ns = now_ns() - start;
+
+    size_t in_place = 0, by_copy = 0, copied = 0;
+    for (int b = 0; b < buffer_count; b++) {
+        in_place += buffers[b].grown_in_place;
+        by_copy += buffers[b].grown_by_copy;
+        copied += buffers[b].bytes_copied;
+        my_buffer_free(&buffers[b]);
+    }
+    printf("  %-14s %d buffer%s  %8.2f ns/record  grows: %4zu in place, %4zu copied  "
+           "%12zu bytes copied  peak mapped %zu bytes\n",
+           try_expand ? "try-expand" : "copy-on-grow", buffer_count, buffer_count == 1 ? " " : "s",
+           elapsed_ns / (double)records, in_place, by_copy, copied, peak_mapped_bytes);
+}
+
+// Every run gets a fresh heap in a child process
+static void run_in_child(bool try_expand, size_t records, int buffer_count) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        run_appends(try_expand, records, buffer_count);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (child > 0) {
+        waitpid(child, NULL, 0);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000000;
+    if (records == 0) {
+        records = 1;
+    }
+
+    printf("=== Appending %zu records of %zu bytes ===\n", records, sizeof(Record));
+    int buffer_counts[] = { 1, 4 };
+    for (size_t i = 0; i < sizeof(buffer_counts) / sizeof(buffer_counts[0]); i++) {
+        run_in_child(false, records, buffer_counts[i]);
+        run_in_child(true, records, buffer_counts[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Small-object churn through my_cache_malloc/my_cache_free with per-CPU
+// (rseq) caches, with per-thread caches, and straight through the heap lock
+// with my_malloc/my_free. A second run parks many idle threads that each
+// allocated once, to show what the caches cost in memory.
+//
+// Build: gcc -O2 -pthread cache_bench.c -o cache_bench
+// Usage: ./cache_bench [threads] [operations per thread] [idle threads]
+#include <pthread.h>
+#include <stdlib.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "malloc copy.c"
+
+#define LIVE_OBJECTS 64 // per thread
+
+typedef enum BenchFront{
+    FRONT_HEAP,
+    FRONT_PER_THREAD,
+    FRONT_PER_CPU,
+}BenchFront;
+
+static const char* front_names[] = { "my_malloc", "per-thread", "per-CPU" };
+static long operations_per_thread = 2000000;
+static BenchFront front = FRONT_HEAP;
+
+// Idle threads wait here after their one allocation
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static bool idle_release = false;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static inline void* bench_alloc(size_t size) {
+    return front == FRONT_HEAP ? my_malloc(size) : my_cache_malloc(size);
+}
+
+static inline void bench_free(void* ptr) {
+    if (front == FRONT_HEAP) {
+        my_free(ptr);
+    } else {
+        my_cache_free(ptr);
+    }
+}
+
+// Replaces a random one of LIVE_OBJECTS objects of 16 to 256 bytes per step
+static void* worker(void* arg) {
+    uint64_t rng = (uintptr_t)arg * 0x9E3779B97F4A7C15ULL + 1;
+    void* live[LIVE_OBJECTS] = { NULL };
+    for (long i = 0; i < operations_per_thread; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        size_t slot = rng % LIVE_OBJECTS;
+        bench_free(live[slot]);
+        live[slot] = bench_alloc(16 + (rng >> 32) % 241);
+        *(char*)live[slot] = (char)i;
+    }
+    for (int slot = 0; slot < LIVE_OBJECTS; slot++) {
+        bench_free(live[slot]);
+    }
+    return NULL;
+}
+
+static void* idle_worker(void* arg) {
+    (void)arg;
+    bench_free(bench_alloc(64));
+    pthread_mutex_lock(&idle_mutex);
+    while (!idle_release) {
+        pthread_cond_wait(&idle_cond, &idle_mutex);
+    }
+    pthread_mutex_unlock(&idle_mutex);
+    return NULL;
+}
+
+static void run_churn(int threads) {
+    pthread_t* ids = malloc(sizeof(pthread_t) * (size_t)threads);
+    double start = now_ns();
+    for (long t = 0; t < threads; t++) {
+        pthread_create(&ids[t], NULL, worker, (void*)t);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    double elapsed_ns = now_ns() - start;
+    free(ids);
+    double operations = (double)threads * (double)operations_per_thread;
+    printf("  %-10s %3d thread%s %8.2f M alloc+free/s\n", front_names[front], threads,
+           threads == 1 ? " " : "s", operations / elapsed_ns * 1e3);
+}
+
+// Cache structures mapped while `threads` threads sit idle
+static void run_idle(int threads) {
+    pthread_t* ids = malloc(sizeof(pthread_t) * (size_t)threads);
+    int started = 0;
+    idle_release = false;
+    while (started < threads && pthread_create(&ids[started], NULL, idle_worker, NULL) == 0) {
+        started++;
+    }
+    struct timespec settle = { 0, 200 * 1000 * 1000 };
+    nanosleep(&settle, NULL);
+    size_t cache_bytes = atomic_load(&cache_mapped_bytes);
+
+    pthread_mutex_lock(&idle_mutex);
+    idle_release = true;
+    pthread_cond_broadcast(&idle_cond);
+    pthread_mutex_unlock(&idle_mutex);
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    free(ids);
+    printf("  %-10s %5d idle threads: %10zu bytes of cache structures\n", front_names[front], started, cache_bytes);
+}
+
+int main(int argc, char const *argv[])
+{
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    operations_per_thread = argc > 2 ? atol(argv[2]) : operations_per_thread;
+    int idle_threads = argc > 3 ? atoi(argv[3]) : 2000;
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    bool have_per_cpu = my_cache_set_mode(MY_CACHE_PER_CPU);
+    printf("=== Small-object churn, %ld operations per thread, %ld CPUs ===\n",
+           operations_per_thread, sysconf(_SC_NPROCESSORS_ONLN));
+    if (!have_per_cpu) {
+        printf("(rseq is not available, per-CPU caches are skipped)\n");
+    }
+    BenchFront last = have_per_cpu ? FRONT_PER_CPU : FRONT_PER_THREAD;
+    for (int t = 1; t <= threads; t *= 2) {
+        for (front = FRONT_HEAP; front <= last; front++) {
+            if (front != FRONT_HEAP) {
+                my_cache_set_mode(front == FRONT_PER_CPU ? MY_CACHE_PER_CPU : MY_CACHE_PER_THREAD);
+            }
+            run_churn(t);
+        }
+    }
+
+    printf("\n=== Memory with idle threads ===\n");
+    for (front = FRONT_PER_THREAD; front <= last; front++) {
+        my_cache_set_mode(front == FRONT_PER_CPU ? MY_CACHE_PER_CPU : MY_CACHE_PER_THREAD);
+        run_idle(idle_threads);
+    }
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include <sys/mman.h> 
 #include <unistd.h> 
+#include "my_memory.h"
 
 #define PAGE_SIZE 4096
 #define BLOCK_SIZE 16
@@ -89,11 +90,9 @@ MyBlockHeader* create_new_block(size_t size, MyPageHeader* page){
         last_block->next = new_block;
     }
 
-    // This loop correctly implements the "zeroing" part of calloc.
+    // This implements the "zeroing" part of calloc.
     char* data_start = (char*) new_block + sizeof(MyBlockHeader);
-    for(size_t i = 0; i < size; i++ ){
-        data_start[i] = 0;
-    }
+    my_memset(data_start, 0, size);
     
     
     // Update the page's free memory counter
@@ -152,6 +151,8 @@ void* my_calloc(size_t size){
     MyBlockHeader* block_mem = find_free_block(size);
     if(block_mem != NULL){
         block_mem->is_free = false;
+        // A reused block still holds its old contents
+        my_memset((char*)block_mem + sizeof(MyBlockHeader), 0, size);
         return (void*)((char*)block_mem + sizeof(MyBlockHeader));
     }
     
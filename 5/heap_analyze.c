@@ -0,0 +1,172 @@
+// Offline fragmentation analysis of a heap snapshot (see my_snapshot.h,
+// written by my_heap_snapshot in "malloc copy.c"). Reads the snapshot as a
+// stream, so it copes with heaps of millions of blocks.
+//
+// Usage: ./heap_analyze heap.snap
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "my_snapshot.h"
+
+#define EXTENT_BUCKETS 40      // log2 size classes of free extents
+#define OCCUPANCY_BUCKETS 10   // 10% wide page occupancy classes
+
+static const char* pool_names[] = { "default", "short-lived", "long-lived", "bulk" };
+#define POOL_COUNT (sizeof(pool_names) / sizeof(pool_names[0]))
+
+typedef struct PoolTotals{
+    size_t pages;
+    size_t mapped;
+    size_t live;
+}PoolTotals;
+
+static int log2_floor(uint64_t value) {
+    return value == 0 ? 0 : 63 - __builtin_clzll(value);
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <snapshot file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    SnapshotHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not a heap snapshot\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    size_t pages = 0, blocks = 0, live_blocks = 0, free_blocks = 0, handle_blocks = 0;
+    size_t mapped = 0, live_bytes = 0, free_block_bytes = 0, tail_bytes = 0;
+    size_t empty_pages = 0, partial_pages = 0, full_pages = 0;
+    uint64_t largest_extent = 0;
+    size_t extent_count[EXTENT_BUCKETS] = {0};
+    size_t extent_bytes[EXTENT_BUCKETS] = {0};
+    size_t occupancy[OCCUPANCY_BUCKETS] = {0};
+    PoolTotals pools[POOL_COUNT];
+    memset(pools, 0, sizeof(pools));
+
+    SnapshotPage page;
+    bool truncated = false;
+    while (fread(&page, sizeof(page), 1, file) == 1) {
+        size_t page_live = 0;
+        pages++;
+        mapped += page.size;
+
+        for (uint32_t i = 0; i < page.block_count; i++) {
+            SnapshotBlock block;
+            if (fread(&block, sizeof(block), 1, file) != 1) {
+                truncated = true;
+                break;
+            }
+            blocks++;
+            if (block.flags & SNAPSHOT_BLOCK_FREE) {
+                free_blocks++;
+                free_block_bytes += block.size;
+                int bucket = log2_floor(block.size);
+                extent_count[bucket < EXTENT_BUCKETS ? bucket : EXTENT_BUCKETS - 1]++;
+                extent_bytes[bucket < EXTENT_BUCKETS ? bucket : EXTENT_BUCKETS - 1] += block.size;
+                if (block.size > largest_extent) {
+                    largest_extent = block.size;
+                }
+            } else {
+                live_blocks++;
+                page_live += block.size;
+                if (block.flags & SNAPSHOT_BLOCK_HANDLE) {
+                    handle_blocks++;
+                }
+            }
+        }
+        if (truncated) {
+            break;
+        }
+
+        // The unallocated tail is a free extent too, minus the header a block there needs
+        if (page.free_mem > header.block_header_size) {
+            uint64_t tail = page.free_mem - header.block_header_size;
+            tail_bytes += tail;
+            int bucket = log2_floor(tail);
+            extent_count[bucket < EXTENT_BUCKETS ? bucket : EXTENT_BUCKETS - 1]++;
+            extent_bytes[bucket < EXTENT_BUCKETS ? bucket : EXTENT_BUCKETS - 1] += tail;
+            if (tail > largest_extent) {
+                largest_extent = tail;
+            }
+        }
+
+        uint64_t capacity = page.size - header.page_header_size;
+        if (page_live == 0) {
+            empty_pages++;
+        } else if (page_live + (uint64_t)page.block_count * header.block_header_size >= capacity) {
+            full_pages++;
+        } else {
+            partial_pages++;
+        }
+        size_t occupancy_bucket = (size_t)(page_live * OCCUPANCY_BUCKETS / page.size);
+        occupancy[occupancy_bucket < OCCUPANCY_BUCKETS ? occupancy_bucket : OCCUPANCY_BUCKETS - 1]++;
+
+        live_bytes += page_live;
+        if (page.pool < POOL_COUNT) {
+            pools[page.pool].pages++;
+            pools[page.pool].mapped += page.size;
+            pools[page.pool].live += page_live;
+        }
+    }
+    fclose(file);
+
+    size_t total_free = free_block_bytes + tail_bytes;
+    size_t overhead = pages * header.page_header_size + blocks * header.block_header_size;
+
+    printf("=== Heap Snapshot Analysis: %s ===\n", argv[1]);
+    if (truncated) {
+        printf("Warning: snapshot is truncated, results cover the complete pages only\n");
+    }
+    printf("Pages: %zu (empty %zu, partial %zu, full %zu)\n", pages, empty_pages, partial_pages, full_pages);
+    printf("Blocks: %zu (live %zu, free %zu, handle-owned %zu)\n", blocks, live_blocks, free_blocks, handle_blocks);
+    printf("Mapped:              %12zu bytes\n", mapped);
+    printf("  live user data:    %12zu bytes (%.2f%%)\n", live_bytes,
+           mapped ? (double)live_bytes * 100.0 / (double)mapped : 0.0);
+    printf("  free blocks:       %12zu bytes\n", free_block_bytes);
+    printf("  unallocated tails: %12zu bytes\n", tail_bytes);
+    printf("  headers:           %12zu bytes\n", overhead);
+
+    // External fragmentation: how much of the free memory is unusable for
+    // one request of the largest size we could otherwise serve.
+    printf("Largest free extent: %12llu bytes\n", (unsigned long long)largest_extent);
+    printf("External fragmentation: %.2f%% (1 - largest extent / total free)\n",
+           total_free ? (1.0 - (double)largest_extent / (double)total_free) * 100.0 : 0.0);
+
+    printf("\nFree extent histogram:\n");
+    printf("  %-22s %10s %14s\n", "extent size", "count", "bytes");
+    for (int b = 0; b < EXTENT_BUCKETS; b++) {
+        if (extent_count[b] > 0) {
+            char range[32];
+            snprintf(range, sizeof(range), "[%llu, %llu)", 1ULL << b, 1ULL << (b + 1));
+            printf("  %-22s %10zu %14zu\n", range, extent_count[b], extent_bytes[b]);
+        }
+    }
+
+    printf("\nPage occupancy (live user bytes / page size):\n");
+    for (int b = 0; b < OCCUPANCY_BUCKETS; b++) {
+        printf("  %3d-%3d%%  %10zu pages\n", b * 100 / OCCUPANCY_BUCKETS,
+               (b + 1) * 100 / OCCUPANCY_BUCKETS, occupancy[b]);
+    }
+
+    printf("\nPer pool:\n");
+    for (size_t pool = 0; pool < POOL_COUNT; pool++) {
+        if (pools[pool].pages > 0) {
+            printf("  %-12s %8zu pages %12zu mapped %12zu live (%.2f%%)\n", pool_names[pool],
+                   pools[pool].pages, pools[pool].mapped, pools[pool].live,
+                   (double)pools[pool].live * 100.0 / (double)pools[pool].mapped);
+        }
+    }
+    return 0;
+}
@@ -1,25 +1,317 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // mremap
+#endif
 #include <stdio.h>
 #include <stdbool.h>
 #include <sys/mman.h> 
 #include <unistd.h> 
 #include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <execinfo.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <pthread.h>
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define MY_HAVE_RSEQ 1 // glibc 2.35+ registers every thread with the kernel
+#endif
+#endif
+#include "my_trace.h"
+#include "my_snapshot.h"
+#include "my_memory.h"
 
 #define PAGE_SIZE 4096
 #define BLOCK_SIZE 16
 
+// Page index: pages are bucketed by floor(log2(largest free extent))
+#define PAGE_INDEX_BUCKETS 64
+
+// Lifetime hints for my_malloc_hint. Each hint gets its own page pool, so
+// short-lived buffers never share a page with long-lived objects.
+typedef enum MyAllocHint{
+    MY_HINT_DEFAULT,      // what plain my_malloc uses
+    MY_HINT_SHORT_LIVED,  // request buffers, temporaries
+    MY_HINT_LONG_LIVED,   // caches, configuration, anything kept for the process lifetime
+    MY_HINT_BULK,         // large buffers that come and go as a whole
+    MY_HINT_COUNT
+}MyAllocHint;
+
+// Guard-page sampling: how many sampled allocations can be alive at once,
+// and how many freed ones stay poisoned (PROT_NONE) before being unmapped.
+#define GUARD_MAX_SLOTS 64
+#define GUARD_QUARANTINE_SLOTS 16
+
+// Heap profiler: default mean distance between samples, deepest recorded
+// stack, and table sizes (both tables are mmap'd, never my_malloc'd).
+#define PROF_DEFAULT_PERIOD (512 * 1024)
+#define PROF_MAX_DEPTH 32
+#define PROF_MAX_STACKS 4096
+#define PROF_MAX_LIVE 65536
+
+// Movable allocations: size of the handle table, and the occupancy below
+// which a page is considered sparse enough to be emptied by compaction.
+#define HANDLE_MAX 65536
+#define COMPACT_SPARSE_PERCENT 50
+
+// Event tracing: build with -DMY_TRACE_LEVEL=1 for page events, =2 to also
+// trace every malloc/free. At 0 (the default) TRACE() compiles to nothing.
+#ifndef MY_TRACE_LEVEL
+#define MY_TRACE_LEVEL 0
+#endif
+#define TRACE_RING_RECORDS 4096 // per thread, must be a power of two
+
+// Epoch-based reclamation: retired blocks a thread collects before it tries
+// to advance the epoch and hand a batch back to the heap.
+#define EBR_BATCH 64
+
+// Auto-tuning: the size of one allocation in TUNE_SAMPLE_EVERY is sampled,
+// and every TUNE_WINDOW samples of a pool its chunk size and the size-class
+// spacing are derived again from what was seen. A chunk is sized for about
+// TUNE_OBJECTS_PER_CHUNK typical objects, up to TUNE_MAX_CHUNK bytes.
+#define TUNE_SAMPLE_EVERY 64
+#define TUNE_WINDOW 1024
+#define TUNE_OBJECTS_PER_CHUNK 16
+#define TUNE_MAX_CHUNK (256 * PAGE_SIZE)
+#define MAX_SIZE_CLASS_SPACING PAGE_SIZE
+
+// Page reserve: how many pre-mapped regions it can hold, and the size of
+// the regions the refill thread maps.
+#define RESERVE_MAX_REGIONS 64
+#define RESERVE_DEFAULT_REGION (256 * PAGE_SIZE)
+
+// Memory pressure: how often the cgroup files are read at most, and when
+// aggressive mode starts and ends, as a share of the limit and as the
+// percentage of time the cgroup stalled on memory over the last 10 s.
+#define PRESSURE_POLL_NS (10 * 1000 * 1000)
+#define PRESSURE_ENTER_PERCENT 90
+#define PRESSURE_LEAVE_PERCENT 80
+#define PRESSURE_STALL_ENTER 10.0
+#define PRESSURE_STALL_LEAVE 5.0
+
+// Small-object caches in front of the heap (my_cache_malloc): requests up
+// to CACHE_MAX_SIZE are served from CACHE_CLASSES classes BLOCK_SIZE
+// apart. A class holds up to CACHE_CLASS_BYTES of blocks, at most
+// CACHE_MAX_SLOTS and at least CACHE_MIN_SLOTS of them.
+#define CACHE_CLASSES 32
+#define CACHE_MAX_SIZE (CACHE_CLASSES * BLOCK_SIZE)
+#define CACHE_CLASS_BYTES (8 * 1024)
+#define CACHE_MAX_SLOTS 64
+#define CACHE_MIN_SLOTS 8
+
+// Both headers are padded to BLOCK_SIZE, so with block sizes rounded to
+// BLOCK_SIZE every header and every user pointer is BLOCK_SIZE aligned.
 typedef struct MyPageHeader{
-    size_t size;
+    _Alignas(BLOCK_SIZE) size_t size;
     size_t free_mem;
     struct MyPageHeader* next;
+    struct MyPageHeader* prev;
+    size_t largest_free;               // biggest request this page can take right now
+    MyAllocHint pool;                  // which page pool the page belongs to
+    int bucket;                        // page index bucket, -1 when the page is full
+    struct MyPageHeader* bucket_next;
+    struct MyPageHeader* bucket_prev;
 }MyPageHeader;
 
 typedef struct MyBlockHeader{
-    size_t size;
+    _Alignas(BLOCK_SIZE) size_t size;
     bool is_free;
+    bool is_guarded; // lives in its own mapping in front of a guard page
+    bool is_sampled; // tracked by the heap profiler
+    uint32_t handle; // slot in the handle table, 0 for plain my_malloc blocks
     struct MyBlockHeader* next;
+    struct MyBlockHeader* retired_next; // EBR limbo list; lives in the header
+                                        // so readers never see it in the data
 }MyBlockHeader;
 
+// Largest request my_malloc takes: rounding it up to the size-class spacing
+// and adding both headers and a page's worth of slack cannot overflow
+#define MAX_ALLOC_SIZE (SIZE_MAX - PAGE_SIZE - sizeof(MyPageHeader) - sizeof(MyBlockHeader))
+
 static MyPageHeader* first_page = NULL;
+static MyPageHeader* last_page = NULL;
+
+// One lock serializes the heap: taken once per my_malloc/my_free, and once
+// per batch when EBR hands retired blocks back. Spins briefly, then yields.
+static atomic_flag heap_lock = ATOMIC_FLAG_INIT;
+
+static inline void heap_lock_acquire(void) {
+    while (atomic_flag_test_and_set_explicit(&heap_lock, memory_order_acquire)) {
+        sched_yield();
+    }
+}
+
+// Work noticed under the heap lock that must not run inside it, because it
+// can block, read files or allocate (waking or starting the reserve thread,
+// polling the cgroup). It is
+// flagged here and run by whoever releases the lock next.
+#define HEAP_DEFER_RESERVE_WAKE 0x1u
+#define HEAP_DEFER_PRESSURE_POLL 0x2u
+static _Atomic unsigned heap_deferred = 0;
+static void heap_run_deferred(void);
+
+static inline void heap_defer(unsigned work) {
+    atomic_fetch_or_explicit(&heap_deferred, work, memory_order_relaxed);
+}
+
+static inline void heap_lock_release(void) {
+    atomic_flag_clear_explicit(&heap_lock, memory_order_release);
+    if (__builtin_expect(atomic_load_explicit(&heap_deferred, memory_order_relaxed) != 0, 0)) {
+        heap_run_deferred();
+    }
+}
+
+// Pages with free space, bucketed per pool by the size class of
+// largest_free, and a bitmap of the non-empty buckets so a fitting page is
+// found with one ctz.
+static MyPageHeader* page_buckets[MY_HINT_COUNT][PAGE_INDEX_BUCKETS];
+static uint64_t page_bucket_bitmap[MY_HINT_COUNT];
+
+// Every mapped page by address, so my_free finds a block's page with a
+// binary search instead of walking the page list. Kept in its own mapping.
+static MyPageHeader** page_addresses = NULL;
+static size_t page_address_count = 0;
+static size_t page_address_capacity = 0;
+
+// How each pool gets and gives back pages. chunk_size and retain_pages can be
+// changed at runtime (my_malloc_set_config, MY_MALLOC_CONF, auto-tuning);
+// they are only read under the heap lock.
+typedef struct PagePoolPolicy{
+    const char* name;
+    size_t chunk_size;      // smallest mapping for a new page
+    bool best_fit;          // pick the smallest fitting free block in a page
+    size_t retain_pages;    // the pool unmaps empty pages only above this many
+}PagePoolPolicy;
+
+static PagePoolPolicy pool_policies[MY_HINT_COUNT] = {
+    // Short-lived pages are large, so a burst of requests fills few of them
+    // and they all empty out together; one is kept to avoid mmap churn.
+    // Long-lived objects are packed best-fit into small pages. Bulk buffers
+    // get an exact mapping that goes back to the system as soon as freed.
+    [MY_HINT_DEFAULT]     = { "default",     PAGE_SIZE,      false, 1 },
+    [MY_HINT_SHORT_LIVED] = { "short-lived", 16 * PAGE_SIZE, false, 1 },
+    [MY_HINT_LONG_LIVED]  = { "long-lived",  PAGE_SIZE,      true,  0 },
+    [MY_HINT_BULK]        = { "bulk",        PAGE_SIZE,      false, 0 },
+};
+
+// Requests are rounded up to a multiple of this power of two. BLOCK_SIZE
+// wastes least; coarser spacing lets freed blocks fit more later requests.
+static size_t size_class_spacing = BLOCK_SIZE;
+
+// Retired blocks an EBR thread collects before reclaiming; read without the lock
+static _Atomic size_t ebr_batch = EBR_BATCH;
+
+static size_t pool_page_count[MY_HINT_COUNT];
+static size_t mapped_bytes = 0;       // bytes in pages currently mapped
+static size_t peak_mapped_bytes = 0;
+
+// Set while the cgroup is close to its memory limit; see pressure_poll.
+// Read without the lock by the reserve refill thread.
+static _Atomic bool pressure_aggressive = false;
+// Bumped by pressure_purge; each allocation cache flushes itself on its
+// next use once it sees a new value (see cache_check_generation)
+static _Atomic uint64_t cache_generation = 0;
+
+#if MY_TRACE_LEVEL > 0
+// ---- Event tracing ----
+// Every thread writes fixed-size binary records into its own ring, so the
+// hot path takes no lock and makes no syscall besides the vDSO clock read.
+// Rings are pushed onto a global list with a CAS so my_trace_dump can find
+// them; a ring is never freed. Decode a dump with trace_decode.
+typedef struct TraceRing{
+    _Atomic uint64_t head;     // total records ever written
+    uint32_t thread;
+    struct TraceRing* next;
+    TraceRecord records[TRACE_RING_RECORDS];
+}TraceRing;
+
+static _Atomic(TraceRing*) trace_rings = NULL;
+static _Atomic uint32_t trace_thread_count = 0;
+static __thread TraceRing* trace_ring = NULL;
+
+static TraceRing* trace_register_thread(void) {
+    TraceRing* ring = mmap(NULL, sizeof(TraceRing), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+    ring->thread = atomic_fetch_add(&trace_thread_count, 1);
+    TraceRing* head = atomic_load(&trace_rings);
+    do {
+        ring->next = head;
+    } while (!atomic_compare_exchange_weak(&trace_rings, &head, ring));
+    trace_ring = ring;
+    return ring;
+}
+
+static inline void trace_record(uint32_t type, size_t size, const void* addr, const void* page) {
+    TraceRing* ring = trace_ring;
+    if (__builtin_expect(ring == NULL, 0)) {
+        ring = trace_register_thread();
+        if (ring == NULL) {
+            return;
+        }
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // Only this thread writes the ring, so a relaxed read of head is enough;
+    // the release store publishes the record to my_trace_dump.
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    TraceRecord* record = &ring->records[head & (TRACE_RING_RECORDS - 1)];
+    record->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    record->addr = (uint64_t)(uintptr_t)addr;
+    record->page = (uint64_t)(uintptr_t)page;
+    record->size = size;
+    record->type = type;
+    record->thread = ring->thread;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Writes every thread's ring to `fd`, oldest record first. Records written
+// concurrently with the dump may come out torn; dump from a quiet point.
+bool my_trace_dump(int fd) {
+    TraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(TraceRecord);
+    header.thread_count = atomic_load(&trace_thread_count);
+    if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        return false;
+    }
+
+    for (TraceRing* ring = atomic_load(&trace_rings); ring != NULL; ring = ring->next) {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t count = head < TRACE_RING_RECORDS ? head : TRACE_RING_RECORDS;
+        uint64_t start = (head - count) & (TRACE_RING_RECORDS - 1);
+
+        // The live part of the ring may wrap around its end: two writes
+        uint64_t first = count < TRACE_RING_RECORDS - start ? count : TRACE_RING_RECORDS - start;
+        size_t bytes = (size_t)first * sizeof(TraceRecord);
+        if (write(fd, &ring->records[start], bytes) != (ssize_t)bytes) {
+            return false;
+        }
+        bytes = (size_t)(count - first) * sizeof(TraceRecord);
+        if (bytes > 0 && write(fd, &ring->records[0], bytes) != (ssize_t)bytes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define TRACE(level, type, size, addr, page) \
+    do { \
+        if ((level) <= MY_TRACE_LEVEL) { \
+            trace_record((type), (size), (addr), (page)); \
+        } \
+    } while (0)
+#else
+#define TRACE(level, type, size, addr, page) ((void)0)
+#endif
 
 // Helper function to implement strcmp since it's used in main
 int my_strcmp(const char* str1, const char* str2) {
@@ -30,268 +322,2940 @@ int my_strcmp(const char* str1, const char* str2) {
     return *(unsigned char*)str1 - *(unsigned char*)str2;
 }
 
-MyBlockHeader* find_free_block(size_t size) {
-    MyPageHeader* current_page = first_page;
+MyBlockHeader* find_free_block_in_page(size_t size, MyPageHeader* page) {
+    // A page without blocks has nothing to reuse
+    if (page->free_mem == page->size - sizeof(MyPageHeader)) {
+        return NULL;
+    }
     
-    while (current_page != NULL) {
-        MyBlockHeader* current_block = (MyBlockHeader*)((char*)current_page + sizeof(MyPageHeader));
-        
-        // NOTEs: I dunno if this is correct or not aka. redundant maybe?
-        // // Check if there are any blocks in this page
-        // if (current_page->free_mem == current_page->size - sizeof(MyPageHeader)) {
-        //     // No blocks created yet, skip to next page
-        //     current_page = current_page->next;
-        //     continue;
-        // }
-        
-        //cycle through blocks in the page, and make sure we don't go out of page bounds,
-        //if block is out of page bounds, stop the loop and go to next page
-        while (current_block != NULL && 
-               (char*)current_block < (char*)current_page + current_page->size) {
-            if (current_block->is_free && current_block->size >= size) {
-                return current_block;
+    MyBlockHeader* current_block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+    
+    //cycle through blocks in the page, and make sure we don't go out of page bounds,
+    //if block is out of page bounds, stop the loop and go to next page
+    while (current_block != NULL && 
+           (char*)current_block < (char*)page + page->size) {
+        if (current_block->is_free && current_block->size >= size) {
+            return current_block;
+        }
+        current_block = current_block->next;
+    }
+    return NULL;
+}
+
+// Cuts the unused end of a reused free block off into its own free block,
+// when it is big enough to hold a header and a minimum sized block.
+void split_block(MyBlockHeader* block, size_t size) {
+    size = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    if (block->size < size + sizeof(MyBlockHeader) + BLOCK_SIZE) {
+        return;
+    }
+    MyBlockHeader* rest = (MyBlockHeader*)((char*)block + sizeof(MyBlockHeader) + size);
+    rest->size = block->size - size - sizeof(MyBlockHeader);
+    rest->is_free = true;
+    rest->is_guarded = false;
+    rest->is_sampled = false;
+    rest->handle = 0;
+    rest->next = block->next;
+    block->next = rest;
+    block->size = size;
+}
+
+static void page_index_unlink(MyPageHeader* page) {
+    if (page->bucket < 0) {
+        return;
+    }
+    if (page->bucket_prev != NULL) {
+        page->bucket_prev->bucket_next = page->bucket_next;
+    } else {
+        page_buckets[page->pool][page->bucket] = page->bucket_next;
+        if (page->bucket_next == NULL) {
+            page_bucket_bitmap[page->pool] &= ~(1ULL << page->bucket);
+        }
+    }
+    if (page->bucket_next != NULL) {
+        page->bucket_next->bucket_prev = page->bucket_prev;
+    }
+    page->bucket = -1;
+    page->bucket_next = NULL;
+    page->bucket_prev = NULL;
+}
+
+// Recomputes the page's largest free extent (the unallocated tail or the
+// biggest free block) and files the page under the matching bucket. Costs
+// one walk of this page's blocks, never of the page list.
+void page_index_update(MyPageHeader* page) {
+    size_t largest = 0;
+    if (page->free_mem >= sizeof(MyBlockHeader) + BLOCK_SIZE) {
+        largest = page->free_mem - sizeof(MyBlockHeader);
+    }
+    if (page->free_mem != page->size - sizeof(MyPageHeader)) {
+        MyBlockHeader* block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+        while (block != NULL && (char*)block < (char*)page + page->size - page->free_mem) {
+            if (block->is_free && block->size > largest) {
+                largest = block->size;
             }
-            current_block = current_block->next;
+            block = block->next;
         }
-        current_page = current_page->next;
     }
-    return NULL;
+    page->largest_free = largest;
+
+    int bucket = largest >= BLOCK_SIZE ? 63 - __builtin_clzll(largest) : -1;
+    if (bucket == page->bucket) {
+        return;
+    }
+    page_index_unlink(page);
+    if (bucket >= 0) {
+        page->bucket = bucket;
+        page->bucket_prev = NULL;
+        page->bucket_next = page_buckets[page->pool][bucket];
+        if (page->bucket_next != NULL) {
+            page->bucket_next->bucket_prev = page;
+        }
+        page_buckets[page->pool][bucket] = page;
+        page_bucket_bitmap[page->pool] |= 1ULL << bucket;
+    }
+}
+
+// Returns a page of `pool` that can take `size` bytes, or NULL if none can.
+MyPageHeader* page_index_find(size_t size, MyAllocHint pool) {
+    // Pages in floor(log2(size))'s bucket may or may not fit; try its head
+    int floor_bucket = size == 0 ? 0 : 63 - __builtin_clzll(size);
+    MyPageHeader* head = page_buckets[pool][floor_bucket];
+    if (head != NULL && head->largest_free >= size) {
+        return head;
+    }
+
+    // Every page in a bucket above that is guaranteed to fit
+    if (floor_bucket + 1 >= PAGE_INDEX_BUCKETS) {
+        return NULL;
+    }
+    uint64_t candidates = page_bucket_bitmap[pool] & (~0ULL << (floor_bucket + 1));
+    if (candidates == 0) {
+        return NULL;
+    }
+    return page_buckets[pool][__builtin_ctzll(candidates)];
+}
+
+MyBlockHeader* create_new_block(size_t size, MyPageHeader* page) {
+    if (page->free_mem < size + sizeof(MyBlockHeader)) {
+        return NULL;
+    }
+    
+    // Find the end of existing blocks or start of page if no blocks exist.
+    // An empty page has no header at its start yet, so don't walk it.
+    MyBlockHeader* current_block = NULL;
+    MyBlockHeader* last_block = NULL;
+    if (page->free_mem != page->size - sizeof(MyPageHeader)) {
+        current_block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+    }
+    
+    // Find the last block or determine if this is the first block
+    while (current_block != NULL) {
+        //check page boundary
+        if((char*)current_block >= (char*)page + page->size){
+            break;
+        }
+        last_block = current_block;
+        current_block = current_block->next;
+    }
+    
+    // Calculate position for new block
+    char* new_block_pos;
+    if (last_block == NULL) {
+        // First block in the page
+        new_block_pos = (char*)page + sizeof(MyPageHeader);
+    } else {
+        // After the last block
+        new_block_pos = (char*)last_block + sizeof(MyBlockHeader) + last_block->size;
+    }
+    
+    MyBlockHeader* new_block = (MyBlockHeader*)new_block_pos;
+    new_block->size = size;
+    new_block->is_free = false;  // Mark as allocated
+    new_block->is_guarded = false;
+    new_block->is_sampled = false;
+    new_block->handle = 0;
+    new_block->next = NULL;
+    
+    // Link the previous block to this new block
+    if (last_block != NULL) {
+        last_block->next = new_block;
+    }
+    
+    // Update page free memory
+    page->free_mem -= (size + sizeof(MyBlockHeader));
+    
+    return new_block;
+}
+
+// ---- Pre-mapped page reserve ----
+// An optional stock of mapped, already faulted-in memory, so an allocation
+// that needs a new page does not pay for mmap and first-touch faults. A
+// background thread tops it up to reserve_watermark whenever it falls
+// below half of that. create_new_page carves pages off the front of a
+// region; a carved page is an ordinary part of a mapping and is unmapped
+// on its own like any other page.
+typedef struct ReserveRegion{
+    char* base;
+    size_t size;
+}ReserveRegion;
+
+static ReserveRegion reserve_regions[RESERVE_MAX_REGIONS]; // heap lock
+static size_t reserve_region_count = 0;                    // heap lock
+static size_t reserve_pages_served = 0;                    // heap lock
+static _Atomic size_t reserve_bytes = 0;                   // ready in the regions
+static _Atomic size_t reserve_watermark = 0;               // 0 turns the refill thread off
+static _Atomic size_t reserve_region_size = RESERVE_DEFAULT_REGION;
+static pthread_mutex_t reserve_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reserve_cond = PTHREAD_COND_INITIALIZER;
+static bool reserve_thread_started = false;                // reserve_mutex
+
+// Maps `size` bytes and faults every page in up front
+static char* reserve_map_region(size_t size) {
+#ifdef MAP_POPULATE
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+#else
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem != MAP_FAILED) {
+        for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+            ((volatile char*)mem)[offset] = 0;
+        }
+    }
+#endif
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+// The caller holds the heap lock. Fails when the region table is full.
+static bool reserve_add_region(char* base, size_t size) {
+    if (reserve_region_count == RESERVE_MAX_REGIONS) {
+        return false;
+    }
+    reserve_regions[reserve_region_count].base = base;
+    reserve_regions[reserve_region_count].size = size;
+    reserve_region_count++;
+    atomic_fetch_add(&reserve_bytes, size);
+    return true;
+}
+
+// Takes `size` bytes (a multiple of PAGE_SIZE) from the first region that
+// has them, or returns NULL. The caller holds the heap lock.
+static void* reserve_take(size_t size) {
+    for (size_t i = 0; i < reserve_region_count; i++) {
+        ReserveRegion* region = &reserve_regions[i];
+        if (region->size < size) {
+            continue;
+        }
+        void* mem = region->base;
+        region->base += size;
+        region->size -= size;
+        if (region->size == 0) {
+            *region = reserve_regions[--reserve_region_count];
+        }
+        atomic_fetch_sub(&reserve_bytes, size);
+        reserve_pages_served++;
+        return mem;
+    }
+    return NULL;
+}
+
+// Maps regions until the reserve is back at the watermark, then sleeps
+// until create_new_page finds it below half of that. Never holds the heap
+// lock while mapping, so allocations keep going meanwhile. Under memory
+// pressure it stops and drops what it just mapped.
+static void* reserve_refill_thread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&reserve_mutex);
+    for (;;) {
+        while (atomic_load(&reserve_bytes) >= atomic_load(&reserve_watermark) ||
+               atomic_load(&pressure_aggressive)) {
+            pthread_cond_wait(&reserve_cond, &reserve_mutex);
+        }
+        pthread_mutex_unlock(&reserve_mutex);
+
+        size_t size = atomic_load(&reserve_region_size);
+        char* region = reserve_map_region(size);
+        bool added = false;
+        if (region != NULL) {
+            heap_lock_acquire();
+            added = !atomic_load(&pressure_aggressive) && reserve_add_region(region, size);
+            heap_lock_release();
+            if (!added) {
+                munmap(region, size);
+            }
+        }
+
+        pthread_mutex_lock(&reserve_mutex);
+        if (!added) {
+            // Out of memory or region slots; try again on the next wake-up
+            pthread_cond_wait(&reserve_cond, &reserve_mutex);
+        }
+    }
+    return NULL;
+}
+
+// Starts the refill thread on first use, then signals it. Called without the
+// heap lock (pthread_create may allocate); under it, use heap_defer.
+static void reserve_wake_refill(void) {
+    pthread_mutex_lock(&reserve_mutex);
+    if (!reserve_thread_started) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        reserve_thread_started = pthread_create(&thread, &attr, reserve_refill_thread, NULL) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    pthread_cond_signal(&reserve_cond);
+    pthread_mutex_unlock(&reserve_mutex);
+}
+
+static void pressure_poll(bool force);
+
+static void heap_run_deferred(void) {
+    unsigned work = atomic_exchange(&heap_deferred, 0);
+    if (work & HEAP_DEFER_PRESSURE_POLL) {
+        pressure_poll(false);
+    }
+    if (work & HEAP_DEFER_RESERVE_WAKE) {
+        reserve_wake_refill();
+    }
+}
+
+// Maps and pre-faults `bytes` (rounded up to whole pages) into the reserve
+// right away, e.g. to warm up at startup. Works with or without the refill
+// thread. Returns false if the mapping fails or the reserve is full.
+bool my_malloc_reserve(size_t bytes) {
+    if (bytes == 0 || bytes > SIZE_MAX - PAGE_SIZE) {
+        return false;
+    }
+    size_t size = (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    char* region = reserve_map_region(size);
+    if (region == NULL) {
+        return false;
+    }
+    heap_lock_acquire();
+    bool added = reserve_add_region(region, size);
+    heap_lock_release();
+    if (!added) {
+        munmap(region, size);
+    }
+    return added;
+}
+
+// Index of the first page at or above addr
+static size_t page_address_search(const void* addr) {
+    size_t low = 0, high = page_address_count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if ((const char*)page_addresses[mid] < (const char*)addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Makes room for one more page; false if the bigger array cannot be mapped
+static bool page_address_reserve(void) {
+    if (page_address_count < page_address_capacity) {
+        return true;
+    }
+    size_t capacity = page_address_capacity == 0 ? PAGE_SIZE / sizeof(MyPageHeader*) : 2 * page_address_capacity;
+    MyPageHeader** grown = mmap(NULL, capacity * sizeof(MyPageHeader*), PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (grown == MAP_FAILED) {
+        return false;
+    }
+    if (page_addresses != NULL) {
+        memcpy(grown, page_addresses, page_address_count * sizeof(MyPageHeader*));
+        munmap(page_addresses, page_address_capacity * sizeof(MyPageHeader*));
+    }
+    page_addresses = grown;
+    page_address_capacity = capacity;
+    return true;
+}
+
+static void page_address_insert(MyPageHeader* page) {
+    size_t at = page_address_search(page);
+    memmove(page_addresses + at + 1, page_addresses + at, (page_address_count - at) * sizeof(MyPageHeader*));
+    page_addresses[at] = page;
+    page_address_count++;
+}
+
+static void page_address_remove(MyPageHeader* page) {
+    size_t at = page_address_search(page);
+    if (at < page_address_count && page_addresses[at] == page) {
+        memmove(page_addresses + at, page_addresses + at + 1, (page_address_count - at - 1) * sizeof(MyPageHeader*));
+        page_address_count--;
+    }
+}
+
+// Whether `page` is still mapped, without touching its memory
+static bool page_address_contains(MyPageHeader* page) {
+    size_t at = page_address_search(page);
+    return at < page_address_count && page_addresses[at] == page;
+}
+
+MyPageHeader* create_new_page(size_t size, MyAllocHint pool) {
+    size_t needed_size = sizeof(MyPageHeader) + sizeof(MyBlockHeader) + size;
+    // Rounded up without adding first, so a size near MAX_ALLOC_SIZE cannot wrap
+    size_t pages_needed = needed_size / PAGE_SIZE + (needed_size % PAGE_SIZE != 0);
+    size_t total_size = pages_needed * PAGE_SIZE;
+    if (total_size < pool_policies[pool].chunk_size) {
+        total_size = pool_policies[pool].chunk_size;
+    }
+    
+    if (!page_address_reserve()) {
+        return NULL;
+    }
+
+    // Prefer pre-faulted memory from the reserve; ask for a refill when low,
+    // once the heap lock is released
+    void* new_mem = reserve_take(total_size);
+    size_t watermark = atomic_load_explicit(&reserve_watermark, memory_order_relaxed);
+    if (watermark != 0 && atomic_load_explicit(&reserve_bytes, memory_order_relaxed) < watermark / 2 &&
+        !atomic_load_explicit(&pressure_aggressive, memory_order_relaxed)) {
+        heap_defer(HEAP_DEFER_RESERVE_WAKE);
+    }
+    if (new_mem == NULL) {
+        new_mem = mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (new_mem == MAP_FAILED) {
+            return NULL;
+        }
+    }
+    
+    MyPageHeader* new_page_header = (MyPageHeader*)new_mem;
+    new_page_header->size = total_size;
+    new_page_header->free_mem = total_size - sizeof(MyPageHeader);
+    new_page_header->next = NULL;
+    new_page_header->prev = last_page;
+    new_page_header->largest_free = 0;
+    new_page_header->pool = pool;
+    new_page_header->bucket = -1;
+    new_page_header->bucket_next = NULL;
+    new_page_header->bucket_prev = NULL;
+    TRACE(1, TRACE_PAGE_MAP, total_size, NULL, new_page_header);
+    
+    // Link to existing pages; keeping the tail avoids walking the list
+    if (first_page == NULL) {
+        first_page = new_page_header;
+    } else {
+        last_page->next = new_page_header;
+    }
+    last_page = new_page_header;
+    page_index_update(new_page_header);
+    page_address_insert(new_page_header);
+    
+    pool_page_count[pool]++;
+    mapped_bytes += total_size;
+    if (mapped_bytes > peak_mapped_bytes) {
+        peak_mapped_bytes = mapped_bytes;
+    }
+    
+    return new_page_header;
+}
+
+// ---- Sampled guard-page allocations ----
+// Roughly 1 in guard_sample_rate allocations is placed at the very end of its
+// own mapping, right in front of a PROT_NONE page, so an overflow faults
+// immediately. When such a block is freed the whole mapping is made PROT_NONE
+// and kept in quarantine for a while, so a use-after-free faults as well.
+typedef enum GuardSlotState{
+    GUARD_SLOT_UNUSED,
+    GUARD_SLOT_LIVE,
+    GUARD_SLOT_QUARANTINED
+}GuardSlotState;
+
+typedef struct GuardSlot{
+    char* region;        // start of the mapping (data pages + guard page)
+    size_t region_size;
+    char* ptr;           // what my_malloc handed out
+    size_t size;
+    size_t freed_seq;    // order of my_free calls, oldest is evicted first
+    GuardSlotState state;
+}GuardSlot;
+
+static size_t guard_sample_rate = 0;      // 0 means sampling is off
+static size_t guard_countdown = SIZE_MAX; // my_malloc only decrements this
+static uint64_t guard_rng_state = 0x9E3779B97F4A7C15ULL;
+static size_t guard_freed_seq = 0;
+static GuardSlot guard_slots[GUARD_MAX_SLOTS];
+static struct sigaction guard_old_segv;
+static bool guard_handler_installed = false;
+
+static size_t guard_next_countdown(void) {
+    if (guard_sample_rate == 0) {
+        return SIZE_MAX;
+    }
+    // xorshift64, then pick uniformly in [1, 2N-1] so the mean interval is N
+    guard_rng_state ^= guard_rng_state << 13;
+    guard_rng_state ^= guard_rng_state >> 7;
+    guard_rng_state ^= guard_rng_state << 17;
+    if (guard_sample_rate == 1) {
+        return 1;
+    }
+    return 1 + (size_t)(guard_rng_state % (2 * guard_sample_rate - 1));
+}
+
+static GuardSlot* guard_find_slot(const char* addr) {
+    for (size_t i = 0; i < GUARD_MAX_SLOTS; i++) {
+        GuardSlot* slot = &guard_slots[i];
+        if (slot->state != GUARD_SLOT_UNUSED &&
+            addr >= slot->region && addr < slot->region + slot->region_size) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+// The handler may interrupt libc itself, so it formats its message by hand
+// (snprintf is not async-signal-safe) and sends it with write alone
+static size_t guard_put_text(char* buf, size_t at, const char* text) {
+    while (*text != '\0') {
+        buf[at++] = *text++;
+    }
+    return at;
+}
+
+static size_t guard_put_hex(char* buf, size_t at, uintptr_t value) {
+    char digits[2 * sizeof(uintptr_t)];
+    int count = 0;
+    do {
+        digits[count++] = "0123456789abcdef"[value & 15];
+        value >>= 4;
+    } while (value != 0);
+    buf[at++] = '0';
+    buf[at++] = 'x';
+    while (count > 0) {
+        buf[at++] = digits[--count];
+    }
+    return at;
+}
+
+static size_t guard_put_decimal(char* buf, size_t at, size_t value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    while (count > 0) {
+        buf[at++] = digits[--count];
+    }
+    return at;
+}
+
+// Reports which sampled allocation was hit, then lets the fault happen again
+// with the previous handler so the process still dies at the faulting access.
+static void guard_segv_handler(int sig, siginfo_t* info, void* context) {
+    (void)context;
+    GuardSlot* slot = guard_find_slot((const char*)info->si_addr);
+    if (slot != NULL) {
+        char msg[160];   // the longest kind, two pointers and a size fit
+        const char* kind = slot->state == GUARD_SLOT_QUARANTINED ? "use-after-free"
+                         : (char*)info->si_addr >= slot->ptr + slot->size ? "heap-buffer-overflow"
+                         : "invalid access";
+        size_t len = guard_put_text(msg, 0, "GUARD: ");
+        len = guard_put_text(msg, len, kind);
+        len = guard_put_text(msg, len, " at ");
+        len = guard_put_hex(msg, len, (uintptr_t)info->si_addr);
+        len = guard_put_text(msg, len, " (");
+        len = guard_put_decimal(msg, len, slot->size);
+        len = guard_put_text(msg, len, " byte block at ");
+        len = guard_put_hex(msg, len, (uintptr_t)slot->ptr);
+        len = guard_put_text(msg, len, ")\n");
+        write(STDERR_FILENO, msg, len);
+    }
+    (void)sig;
+    sigaction(SIGSEGV, &guard_old_segv, NULL);
+}
+
+// Sets how often allocations are sampled: about 1 in `rate`, 0 turns it off.
+// Can be called at any time; the new rate applies from the next allocation.
+void my_malloc_set_guard_sample_rate(size_t rate) {
+    guard_sample_rate = rate;
+    guard_countdown = guard_next_countdown();
+
+    if (rate != 0 && !guard_handler_installed) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = guard_segv_handler;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, &guard_old_segv);
+        guard_handler_installed = true;
+    }
+}
+
+static GuardSlot* guard_take_slot(void) {
+    GuardSlot* oldest = NULL;
+    for (size_t i = 0; i < GUARD_MAX_SLOTS; i++) {
+        GuardSlot* slot = &guard_slots[i];
+        if (slot->state == GUARD_SLOT_UNUSED) {
+            return slot;
+        }
+        if (slot->state == GUARD_SLOT_QUARANTINED) {
+            if (oldest == NULL || slot->freed_seq < oldest->freed_seq) {
+                oldest = slot;
+            }
+        }
+    }
+    // Every slot is taken; recycle the block that has been poisoned longest
+    if (oldest != NULL) {
+        munmap(oldest->region, oldest->region_size);
+        oldest->state = GUARD_SLOT_UNUSED;
+    }
+    return oldest;
+}
+
+// Slow path of the sampling countdown. Returns NULL when the allocation should
+// go through the normal page list instead (no free slot or mmap failed).
+static void* guard_sample_alloc(size_t size) {
+    guard_countdown = guard_next_countdown();
+    if (guard_sample_rate == 0) {
+        return NULL;
+    }
+
+    GuardSlot* slot = guard_take_slot();
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    // Keep the user pointer BLOCK_SIZE aligned, so overflows smaller than the
+    // alignment padding are not caught.
+    size_t aligned_size = (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    size_t data_size = (sizeof(MyBlockHeader) + aligned_size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    size_t region_size = data_size + PAGE_SIZE;
+
+    char* region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+    if (mprotect(region + data_size, PAGE_SIZE, PROT_NONE) != 0) {
+        munmap(region, region_size);
+        return NULL;
+    }
+
+    char* ptr = region + data_size - aligned_size;
+    MyBlockHeader* block = (MyBlockHeader*)(ptr - sizeof(MyBlockHeader));
+    block->size = size;
+    block->is_free = false;
+    block->is_guarded = true;
+    block->is_sampled = false;
+    block->handle = 0;
+    block->next = NULL;
+
+    slot->region = region;
+    slot->region_size = region_size;
+    slot->ptr = ptr;
+    slot->size = size;
+    slot->state = GUARD_SLOT_LIVE;
+    TRACE(1, TRACE_GUARD_ALLOC, size, ptr, region);
+    return ptr;
+}
+
+static void guard_free(void* ptr) {
+    GuardSlot* slot = guard_find_slot((const char*)ptr);
+    if (slot == NULL || slot->state != GUARD_SLOT_LIVE) {
+        printf("Error: %p is not a live guarded allocation\n", ptr);
+        return;
+    }
+
+    // Poison the whole mapping; the oldest poisoned block is unmapped once
+    // more than GUARD_QUARANTINE_SLOTS are waiting.
+    mprotect(slot->region, slot->region_size, PROT_NONE);
+    slot->state = GUARD_SLOT_QUARANTINED;
+    TRACE(1, TRACE_GUARD_FREE, slot->size, ptr, slot->region);
+    slot->freed_seq = guard_freed_seq++;
+
+    GuardSlot* oldest = NULL;
+    size_t quarantined = 0;
+    for (size_t i = 0; i < GUARD_MAX_SLOTS; i++) {
+        if (guard_slots[i].state == GUARD_SLOT_QUARANTINED) {
+            quarantined++;
+            if (oldest == NULL || guard_slots[i].freed_seq < oldest->freed_seq) {
+                oldest = &guard_slots[i];
+            }
+        }
+    }
+    if (quarantined > GUARD_QUARANTINE_SLOTS) {
+        munmap(oldest->region, oldest->region_size);
+        oldest->state = GUARD_SLOT_UNUSED;
+    }
+}
+
+// ---- Sampled heap profiler ----
+// Instead of sampling every Nth allocation, we sample about one allocation
+// every prof_sample_period bytes: the distance to the next sample is drawn
+// from an exponential distribution, so big allocations are proportionally
+// more likely to be caught. Each sample records a call stack; live samples
+// are accounted per stack and can be dumped as a pprof heap profile.
+typedef struct ProfStack{
+    uint64_t hash;
+    int depth;
+    void* pcs[PROF_MAX_DEPTH];
+    size_t live_count;
+    size_t live_bytes;
+    size_t alloc_count;
+    size_t alloc_bytes;
+}ProfStack;
+
+typedef struct ProfLive{
+    void* ptr;            // NULL marks an empty slot
+    size_t size;
+    ProfStack* stack;
+}ProfLive;
+
+static bool prof_enabled = false;
+static size_t prof_sample_period = PROF_DEFAULT_PERIOD;
+static int64_t prof_bytes_until_sample = INT64_MAX; // my_malloc only subtracts from this
+static uint64_t prof_rng_state = 0x2545F4914F6CDD1DULL;
+static ProfStack* prof_stacks = NULL;   // open addressing on the stack hash
+static ProfLive* prof_live = NULL;      // open addressing on the pointer
+static size_t prof_dropped = 0;         // samples lost because a table was full
+
+// log2 from the IEEE-754 bits: the exponent is the integer part and a
+// quadratic fit of the mantissa the fraction. Good to ~0.01, which is
+// plenty for picking sample distances, and keeps us off libm.
+static double prof_fast_log2(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+    bits = (bits & ((1ULL << 52) - 1)) | (1023ULL << 52);
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    return exponent + (-0.34484843 * m + 2.02466578) * m - 0.67487759;
+}
+
+static int64_t prof_next_sample_distance(void) {
+    if (!prof_enabled) {
+        return INT64_MAX;
+    }
+    prof_rng_state ^= prof_rng_state << 13;
+    prof_rng_state ^= prof_rng_state >> 7;
+    prof_rng_state ^= prof_rng_state << 17;
+    // u in (0, 1], distance = -ln(u) * period
+    double u = (double)((prof_rng_state >> 11) + 1) / (double)(1ULL << 53);
+    double distance = -prof_fast_log2(u) * 0.6931471805599453 * (double)prof_sample_period;
+    return (int64_t)distance + 1;
+}
+
+static size_t prof_ptr_slot(const void* ptr) {
+    uint64_t h = (uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ULL;
+    return (size_t)(h >> 32) & (PROF_MAX_LIVE - 1);
+}
+
+// Starts sampling about one allocation every `period` bytes (0 = default).
+// Returns false if the profiler tables could not be mapped.
+bool my_heap_profile_start(size_t period) {
+    if (prof_stacks == NULL) {
+        void* stacks = mmap(NULL, PROF_MAX_STACKS * sizeof(ProfStack), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void* live = mmap(NULL, PROF_MAX_LIVE * sizeof(ProfLive), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (stacks == MAP_FAILED || live == MAP_FAILED) {
+            if (stacks != MAP_FAILED) munmap(stacks, PROF_MAX_STACKS * sizeof(ProfStack));
+            if (live != MAP_FAILED) munmap(live, PROF_MAX_LIVE * sizeof(ProfLive));
+            return false;
+        }
+        prof_stacks = stacks;
+        prof_live = live;
+    }
+    prof_sample_period = period != 0 ? period : PROF_DEFAULT_PERIOD;
+    prof_enabled = true;
+    prof_bytes_until_sample = prof_next_sample_distance();
+    return true;
+}
+
+// Stops taking new samples. Live samples keep being accounted on my_free so a
+// later dump still shows what is left.
+void my_heap_profile_stop(void) {
+    prof_enabled = false;
+    prof_bytes_until_sample = INT64_MAX;
+}
+
+// Slow path of the byte countdown. noinline keeps the frames we skip fixed.
+static __attribute__((noinline)) void prof_record_alloc(void* ptr, size_t size) {
+    prof_bytes_until_sample = prof_next_sample_distance();
+    if (!prof_enabled || ptr == NULL) {
+        return;
+    }
+
+    // Skip prof_record_alloc and my_malloc themselves
+    void* pcs[PROF_MAX_DEPTH + 2];
+    int depth = backtrace(pcs, PROF_MAX_DEPTH + 2) - 2;
+    if (depth < 0) {
+        depth = 0;
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (uint64_t)(uintptr_t)pcs[i + 2]) * 1099511628211ULL;
+    }
+
+    ProfStack* stack = NULL;
+    size_t idx = (size_t)hash & (PROF_MAX_STACKS - 1);
+    for (size_t probe = 0; probe < PROF_MAX_STACKS; probe++) {
+        ProfStack* candidate = &prof_stacks[(idx + probe) & (PROF_MAX_STACKS - 1)];
+        if (candidate->depth == 0 && candidate->alloc_count == 0) {
+            candidate->hash = hash;
+            candidate->depth = depth;
+            memcpy(candidate->pcs, pcs + 2, (size_t)depth * sizeof(void*));
+            stack = candidate;
+            break;
+        }
+        if (candidate->hash == hash && candidate->depth == depth &&
+            memcmp(candidate->pcs, pcs + 2, (size_t)depth * sizeof(void*)) == 0) {
+            stack = candidate;
+            break;
+        }
+    }
+
+    size_t slot = prof_ptr_slot(ptr);
+    size_t probe = 0;
+    while (probe < PROF_MAX_LIVE && prof_live[slot].ptr != NULL) {
+        slot = (slot + 1) & (PROF_MAX_LIVE - 1);
+        probe++;
+    }
+    if (stack == NULL || probe == PROF_MAX_LIVE) {
+        prof_dropped++;
+        return;
+    }
+
+    prof_live[slot].ptr = ptr;
+    prof_live[slot].size = size;
+    prof_live[slot].stack = stack;
+    stack->live_count++;
+    stack->live_bytes += size;
+    stack->alloc_count++;
+    stack->alloc_bytes += size;
+
+    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
+    block->is_sampled = true;
+}
+
+static void prof_record_free(void* ptr) {
+    size_t slot = prof_ptr_slot(ptr);
+    for (size_t probe = 0; probe < PROF_MAX_LIVE; probe++) {
+        if (prof_live[slot].ptr == NULL) {
+            return;
+        }
+        if (prof_live[slot].ptr == ptr) {
+            break;
+        }
+        slot = (slot + 1) & (PROF_MAX_LIVE - 1);
+    }
+    if (prof_live[slot].ptr != ptr) {
+        return;
+    }
+
+    ProfStack* stack = prof_live[slot].stack;
+    stack->live_count--;
+    stack->live_bytes -= prof_live[slot].size;
+
+    // Backward-shift deletion keeps linear probing chains intact without tombstones
+    size_t hole = slot;
+    size_t next = (hole + 1) & (PROF_MAX_LIVE - 1);
+    while (prof_live[next].ptr != NULL) {
+        size_t home = prof_ptr_slot(prof_live[next].ptr);
+        if (((next - home) & (PROF_MAX_LIVE - 1)) >= ((next - hole) & (PROF_MAX_LIVE - 1))) {
+            prof_live[hole] = prof_live[next];
+            hole = next;
+        }
+        next = (next + 1) & (PROF_MAX_LIVE - 1);
+    }
+    prof_live[hole].ptr = NULL;
+
+    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
+    block->is_sampled = false;
+}
+
+// A sampled block moved by compaction: its live sample follows it to new_ptr,
+// so the bytes still come off the profile when the block is finally freed
+static void prof_move_sample(void* old_ptr, void* new_ptr) {
+    size_t slot = prof_ptr_slot(old_ptr);
+    for (size_t probe = 0; probe < PROF_MAX_LIVE && prof_live[slot].ptr != old_ptr; probe++) {
+        if (prof_live[slot].ptr == NULL) {
+            return;
+        }
+        slot = (slot + 1) & (PROF_MAX_LIVE - 1);
+    }
+    if (prof_live[slot].ptr != old_ptr) {
+        return;
+    }
+    ProfStack* stack = prof_live[slot].stack;
+    size_t size = prof_live[slot].size;
+    prof_record_free(old_ptr);
+
+    // The slot prof_record_free emptied guarantees room
+    slot = prof_ptr_slot(new_ptr);
+    while (prof_live[slot].ptr != NULL) {
+        slot = (slot + 1) & (PROF_MAX_LIVE - 1);
+    }
+    prof_live[slot].ptr = new_ptr;
+    prof_live[slot].size = size;
+    prof_live[slot].stack = stack;
+    stack->live_count++;
+    stack->live_bytes += size;
+    ((MyBlockHeader*)((char*)new_ptr - sizeof(MyBlockHeader)))->is_sampled = true;
+}
+
+static bool prof_write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written <= 0) {
+            return false;
+        }
+        buf += written;
+        len -= (size_t)written;
+    }
+    return true;
+}
+
+// Writes the live samples to `fd` in the gperftools "heap_v2" text format,
+// which `pprof <binary> <file>` reads (pprof does the unsampling). Uses only
+// stack buffers and write(), so it never allocates from the heap it describes.
+bool my_heap_profile_dump(int fd) {
+    char line[64 + PROF_MAX_DEPTH * 20];
+    size_t live_count = 0, live_bytes = 0, alloc_count = 0, alloc_bytes = 0;
+
+    for (size_t i = 0; prof_stacks != NULL && i < PROF_MAX_STACKS; i++) {
+        live_count += prof_stacks[i].live_count;
+        live_bytes += prof_stacks[i].live_bytes;
+        alloc_count += prof_stacks[i].alloc_count;
+        alloc_bytes += prof_stacks[i].alloc_bytes;
+    }
+
+    int len = snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+                       live_count, live_bytes, alloc_count, alloc_bytes, prof_sample_period);
+    if (!prof_write_all(fd, line, (size_t)len)) {
+        return false;
+    }
+    // pprof has no place for this in the header, so a truncated profile is
+    // flagged on stderr instead of passing for a complete one
+    if (prof_dropped != 0) {
+        len = snprintf(line, sizeof(line), "heap profile: %zu samples dropped, the profiler tables were full\n",
+                       prof_dropped);
+        prof_write_all(STDERR_FILENO, line, (size_t)len);
+    }
+
+    for (size_t i = 0; prof_stacks != NULL && i < PROF_MAX_STACKS; i++) {
+        ProfStack* stack = &prof_stacks[i];
+        if (stack->alloc_count == 0) {
+            continue;
+        }
+        len = snprintf(line, sizeof(line), "%zu: %zu [%zu: %zu] @",
+                       stack->live_count, stack->live_bytes, stack->alloc_count, stack->alloc_bytes);
+        for (int d = 0; d < stack->depth; d++) {
+            len += snprintf(line + len, sizeof(line) - (size_t)len, " %p", stack->pcs[d]);
+        }
+        len += snprintf(line + len, sizeof(line) - (size_t)len, "\n");
+        if (!prof_write_all(fd, line, (size_t)len)) {
+            return false;
+        }
+    }
+
+    // pprof needs the mappings to symbolize the addresses
+    const char* maps_header = "\nMAPPED_LIBRARIES:\n";
+    if (!prof_write_all(fd, maps_header, strlen(maps_header))) {
+        return false;
+    }
+#ifdef __linux__
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if (maps >= 0) {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(maps, buf, sizeof(buf))) > 0) {
+            prof_write_all(fd, buf, (size_t)n);
+        }
+        close(maps);
+    }
+#endif
+    return true;
+}
+
+// Smallest free block in the page that fits, to keep long-lived pages dense.
+MyBlockHeader* find_best_free_block_in_page(size_t size, MyPageHeader* page) {
+    MyBlockHeader* best = NULL;
+    if (page->free_mem == page->size - sizeof(MyPageHeader)) {
+        return NULL;
+    }
+    MyBlockHeader* block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+    while (block != NULL && (char*)block < (char*)page + page->size - page->free_mem) {
+        if (block->is_free && block->size >= size && (best == NULL || block->size < best->size)) {
+            best = block;
+            if (best->size == size) {
+                break;
+            }
+        }
+        block = block->next;
+    }
+    return best;
+}
+
+// ---- Runtime configuration and auto-tuning ----
+typedef struct MyMallocConfig{
+    size_t chunk_size[MY_HINT_COUNT];   // smallest mapping for a new page, per pool
+    size_t retain_pages[MY_HINT_COUNT]; // pages a pool keeps mapped when they empty out
+    size_t size_class_spacing;          // power of two, BLOCK_SIZE to MAX_SIZE_CLASS_SPACING
+    size_t ebr_batch;                   // retired blocks per EBR reclaim attempt
+    size_t reserve_watermark;           // pre-faulted bytes kept ready, 0 for no refill thread
+    size_t reserve_region_size;         // mapping size the refill thread uses
+    bool auto_tune;
+}MyMallocConfig;
+
+static bool auto_tune = false;
+static size_t tune_countdown = SIZE_MAX;            // allocations until the next sample
+static uint32_t tune_histogram[MY_HINT_COUNT][64];  // samples per floor(log2(size))
+static uint32_t tune_samples[MY_HINT_COUNT];
+static size_t tune_adjustments = 0;
+
+// Smallest size that at least `percent` of the pool's samples did not exceed,
+// rounded up to the end of its log2 bucket.
+static size_t tune_percentile(MyAllocHint pool, uint32_t percent) {
+    uint64_t wanted = ((uint64_t)tune_samples[pool] * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < 64; bucket++) {
+        seen += tune_histogram[pool][bucket];
+        if (seen >= wanted && seen > 0) {
+            return bucket >= 62 ? SIZE_MAX / 2 : ((size_t)2 << bucket) - 1;
+        }
+    }
+    return SIZE_MAX / 2;
+}
+
+// Re-derives the pool's chunk size and the size-class spacing from the last
+// window of samples. Runs under the heap lock on the allocating thread and
+// only changes what the next page or the next request gets, so nothing is
+// paused or walked. Bulk pages stay exact mappings.
+static void tune_pool(MyAllocHint pool) {
+    size_t median = tune_percentile(pool, 50);
+    size_t p90 = tune_percentile(pool, 90);
+
+    if (pool != MY_HINT_BULK) {
+        size_t chunk = p90 <= TUNE_MAX_CHUNK / TUNE_OBJECTS_PER_CHUNK
+                     ? (p90 * TUNE_OBJECTS_PER_CHUNK + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE
+                     : TUNE_MAX_CHUNK;
+        if (chunk < PAGE_SIZE) {
+            chunk = PAGE_SIZE;
+        }
+        if (chunk != pool_policies[pool].chunk_size) {
+            pool_policies[pool].chunk_size = chunk;
+            tune_adjustments++;
+        }
+    }
+
+    // Spacing of about 1/8 of the typical size keeps rounding waste near 12%
+    if (pool == MY_HINT_DEFAULT) {
+        size_t spacing = BLOCK_SIZE;
+        while (spacing < MAX_SIZE_CLASS_SPACING && spacing * 16 <= median + 1) {
+            spacing *= 2;
+        }
+        if (spacing != size_class_spacing) {
+            size_class_spacing = spacing;
+            tune_adjustments++;
+        }
+    }
+
+    // Halve the history so the tuner follows a workload that changes
+    for (int bucket = 0; bucket < 64; bucket++) {
+        tune_histogram[pool][bucket] /= 2;
+    }
+    tune_samples[pool] /= 2;
+}
+
+static void tune_sample(size_t size, MyAllocHint hint) {
+    tune_countdown = auto_tune ? TUNE_SAMPLE_EVERY : SIZE_MAX;
+    tune_histogram[hint][63 - __builtin_clzll(size)]++;
+    if (++tune_samples[hint] >= TUNE_WINDOW) {
+        tune_pool(hint);
+    }
+}
+
+void my_malloc_get_config(MyMallocConfig* config) {
+    heap_lock_acquire();
+    for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+        config->chunk_size[pool] = pool_policies[pool].chunk_size;
+        config->retain_pages[pool] = pool_policies[pool].retain_pages;
+    }
+    config->size_class_spacing = size_class_spacing;
+    config->ebr_batch = atomic_load(&ebr_batch);
+    config->reserve_watermark = atomic_load(&reserve_watermark);
+    config->reserve_region_size = atomic_load(&reserve_region_size);
+    config->auto_tune = auto_tune;
+    heap_lock_release();
+}
+
+// Applies `config` from the next allocation or free on. Existing pages and
+// blocks keep their sizes, so this only holds the heap lock for a moment.
+// Returns false and changes nothing if a value is out of range.
+bool my_malloc_set_config(const MyMallocConfig* config) {
+    size_t spacing = config->size_class_spacing;
+    if (spacing < BLOCK_SIZE || spacing > MAX_SIZE_CLASS_SPACING || (spacing & (spacing - 1)) != 0) {
+        printf("Error: size class spacing %zu must be a power of two from %d to %d\n",
+               spacing, BLOCK_SIZE, MAX_SIZE_CLASS_SPACING);
+        return false;
+    }
+    if (config->ebr_batch == 0) {
+        printf("Error: EBR batch size must be at least 1\n");
+        return false;
+    }
+    if (config->reserve_region_size == 0 || config->reserve_region_size > SIZE_MAX / 2) {
+        printf("Error: invalid reserve region size %zu\n", config->reserve_region_size);
+        return false;
+    }
+    for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+        if (config->chunk_size[pool] == 0 || config->chunk_size[pool] > SIZE_MAX / 2) {
+            printf("Error: invalid chunk size %zu for the %s pool\n",
+                   config->chunk_size[pool], pool_policies[pool].name);
+            return false;
+        }
+    }
+
+    heap_lock_acquire();
+    for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+        pool_policies[pool].chunk_size = (config->chunk_size[pool] + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        pool_policies[pool].retain_pages = config->retain_pages[pool];
+    }
+    size_class_spacing = spacing;
+    atomic_store(&ebr_batch, config->ebr_batch);
+    atomic_store(&reserve_region_size, (config->reserve_region_size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE);
+    atomic_store(&reserve_watermark, config->reserve_watermark);
+    if (config->auto_tune != auto_tune) {
+        auto_tune = config->auto_tune;
+        tune_countdown = auto_tune ? TUNE_SAMPLE_EVERY : SIZE_MAX;
+    }
+    heap_lock_release();
+
+    // Start filling a newly enabled reserve now, not at the next new page
+    if (config->reserve_watermark != 0 && atomic_load(&reserve_bytes) < config->reserve_watermark) {
+        reserve_wake_refill();
+    }
+    return true;
+}
+
+// Reads MY_MALLOC_CONF before main, e.g.
+//   MY_MALLOC_CONF="spacing=64,chunk_size.short-lived=262144,retain_pages=2,auto_tune=1"
+// Keys are spacing, chunk_size, retain_pages, ebr_batch, reserve,
+// reserve_region and auto_tune; the per-pool ones apply to every pool, or
+// to one with a ".<pool name>" suffix.
+__attribute__((constructor)) static void load_config_from_env(void) {
+    const char* env = getenv("MY_MALLOC_CONF");
+    if (env == NULL) {
+        return;
+    }
+    MyMallocConfig config;
+    my_malloc_get_config(&config);
+
+    char options[512];
+    snprintf(options, sizeof(options), "%s", env);
+    char* options_at;
+    for (char* option = strtok_r(options, ",", &options_at); option != NULL;
+         option = strtok_r(NULL, ",", &options_at)) {
+        char* value = strchr(option, '=');
+        if (value == NULL) {
+            printf("Warning: MY_MALLOC_CONF: '%s' has no value\n", option);
+            continue;
+        }
+        *value++ = '\0';
+        size_t number = strtoull(value, NULL, 0);
+
+        // Split off an optional pool name
+        int first_pool = 0, last_pool = MY_HINT_COUNT - 1;
+        char* pool_name = strchr(option, '.');
+        if (pool_name != NULL) {
+            *pool_name++ = '\0';
+            first_pool = -1;
+            for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+                if (my_strcmp(pool_name, pool_policies[pool].name) == 0) {
+                    first_pool = last_pool = pool;
+                }
+            }
+            if (first_pool < 0) {
+                printf("Warning: MY_MALLOC_CONF: unknown pool '%s'\n", pool_name);
+                continue;
+            }
+        }
+
+        if (my_strcmp(option, "chunk_size") == 0 || my_strcmp(option, "retain_pages") == 0) {
+            for (int pool = first_pool; pool <= last_pool; pool++) {
+                if (option[0] == 'c') {
+                    config.chunk_size[pool] = number;
+                } else {
+                    config.retain_pages[pool] = number;
+                }
+            }
+        } else if (my_strcmp(option, "spacing") == 0) {
+            config.size_class_spacing = number;
+        } else if (my_strcmp(option, "ebr_batch") == 0) {
+            config.ebr_batch = number;
+        } else if (my_strcmp(option, "reserve") == 0) {
+            config.reserve_watermark = number;
+        } else if (my_strcmp(option, "reserve_region") == 0) {
+            config.reserve_region_size = number;
+        } else if (my_strcmp(option, "auto_tune") == 0) {
+            config.auto_tune = number != 0;
+        } else {
+            printf("Warning: MY_MALLOC_CONF: unknown option '%s'\n", option);
+        }
+    }
+    my_malloc_set_config(&config);
+}
+
+void print_malloc_config(void) {
+    MyMallocConfig config;
+    my_malloc_get_config(&config);
+    printf("\n=== Allocator Configuration ===\n");
+    printf("size class spacing: %zu, EBR batch: %zu, auto-tune: %s (%zu adjustments)\n",
+           config.size_class_spacing, config.ebr_batch, config.auto_tune ? "on" : "off", tune_adjustments);
+    printf("page reserve: %zu bytes ready, watermark %zu, regions of %zu bytes, %zu pages served\n",
+           atomic_load(&reserve_bytes), config.reserve_watermark, config.reserve_region_size, reserve_pages_served);
+    for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+        printf("  %-12s chunk %8zu bytes, retains %zu page%s\n", pool_policies[pool].name,
+               config.chunk_size[pool], config.retain_pages[pool], config.retain_pages[pool] == 1 ? "" : "s");
+    }
+}
+
+// ---- Memory pressure ----
+// In a container the process is killed when its cgroup goes over
+// memory.max, however many empty pages the allocator is still holding on
+// to. So before mapping a new page allocate_block polls the cgroup, and
+// once usage reaches PRESSURE_ENTER_PERCENT of the limit (the lower of the
+// hard and soft one) or the cgroup spends PRESSURE_STALL_ENTER percent of
+// its time stalled on memory, the allocator turns aggressive until usage
+// drops below PRESSURE_LEAVE_PERCENT: empty pages are unmapped whatever the
+// pool's retain_pages says, the page reserve is handed back and not
+// refilled, and a request that its own pool cannot fit takes free space
+// from another pool before anything new is mapped.
+//
+// Limits are read from cgroup v2 (memory.max, memory.high, memory.current,
+// memory.pressure) or, failing that, v1 (memory.limit_in_bytes,
+// memory.soft_limit_in_bytes, memory.usage_in_bytes). MY_MALLOC_CGROUP or
+// my_malloc_set_cgroup_dir replace the cgroup with any directory holding
+// the same files, so the behaviour can be tried with hand-written ones.
+typedef struct MyPressureState{
+    char cgroup_dir[256];     // empty when there is no limit to watch
+    uint64_t limit;           // UINT64_MAX when unlimited
+    uint64_t usage;
+    double stall_avg10;       // memory.pressure "some avg10", -1 if not available
+    bool aggressive;
+    size_t episodes;          // times aggressive mode was entered
+    size_t pages_purged;      // empty pages unmapped on entering it
+    size_t bytes_purged;      // those pages plus the reserve handed back
+    size_t cross_pool_reuses; // allocations served from another pool's pages
+}MyPressureState;
+
+static MyPressureState pressure = { .limit = UINT64_MAX, .stall_avg10 = -1.0 }; // heap lock
+static int pressure_source = 0;         // heap lock; 0 not looked up yet, 1 found, -1 none
+static _Atomic uint64_t pressure_next_poll_ns = 0;
+
+// What one read of the cgroup files gives
+typedef struct PressureSample{
+    uint64_t limit;
+    uint64_t usage;
+    double stall_avg10;
+}PressureSample;
+
+// Defined with my_free; the purge reuses them
+bool is_page_empty(MyPageHeader* page);
+void remove_empty_page(MyPageHeader* page_to_remove);
+
+// Reads a small file from `dir` into `buf`; false if it cannot be read.
+// Uses plain read(2), so it never allocates.
+static bool pressure_read_file(const char* dir, const char* name, char* buf, size_t size) {
+    char path[320];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t length = read(fd, buf, size - 1);
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buf[length] = '\0';
+    return true;
+}
+
+// A byte count from a cgroup file; "max" is no limit
+static bool pressure_read_bytes(const char* dir, const char* name, uint64_t* value) {
+    char buf[64];
+    if (!pressure_read_file(dir, name, buf, sizeof(buf))) {
+        return false;
+    }
+    *value = buf[0] == 'm' ? UINT64_MAX : strtoull(buf, NULL, 10);
+    return true;
+}
+
+// Puts the process's memory cgroup in `dir`, from /proc/self/cgroup: the
+// v2 entry "0::/path" if its directory has memory.max, else the v1 entry
+// "N:memory:/path". Returns 1 if one was found, -1 (dir empty) if not.
+// Reads files, so it runs without the heap lock.
+static int pressure_find_cgroup(char* dir, size_t size) {
+    dir[0] = '\0';
+    const char* env = getenv("MY_MALLOC_CGROUP");
+    if (env != NULL) {
+        if (env[0] == '\0') {
+            return -1;
+        }
+        snprintf(dir, size, "%s", env);
+        return 1;
+    }
+
+    char buf[4096];
+    if (!pressure_read_file("/proc/self", "cgroup", buf, sizeof(buf))) {
+        return -1;
+    }
+    char v2_dir[256] = "", v1_dir[256] = "";
+    char* lines_at;
+    for (char* line = strtok_r(buf, "\n", &lines_at); line != NULL; line = strtok_r(NULL, "\n", &lines_at)) {
+        if (line[0] == '0' && line[1] == ':' && line[2] == ':') {
+            snprintf(v2_dir, sizeof(v2_dir), "/sys/fs/cgroup%s", line + 3);
+        } else {
+            char* controllers = strchr(line, ':');
+            char* path = controllers != NULL ? strchr(controllers + 1, ':') : NULL;
+            if (path != NULL && path - controllers == 7 && memcmp(controllers + 1, "memory", 6) == 0) {
+                snprintf(v1_dir, sizeof(v1_dir), "/sys/fs/cgroup/memory%s", path + 1);
+            }
+        }
+    }
+    uint64_t limit;
+    if (v2_dir[0] != '\0' && pressure_read_bytes(v2_dir, "memory.max", &limit)) {
+        snprintf(dir, size, "%s", v2_dir);
+    } else if (v1_dir[0] != '\0' && pressure_read_bytes(v1_dir, "memory.limit_in_bytes", &limit)) {
+        snprintf(dir, size, "%s", v1_dir);
+    } else {
+        return -1;
+    }
+    return 1;
+}
+
+// Reads limit, usage and stall time from `dir`; false if the files are
+// gone. Runs without the heap lock.
+static bool pressure_sample(const char* dir, PressureSample* sample) {
+    uint64_t hard = UINT64_MAX, soft = UINT64_MAX, usage;
+    bool ok;
+    if (pressure_read_bytes(dir, "memory.max", &hard)) {
+        pressure_read_bytes(dir, "memory.high", &soft);
+        ok = pressure_read_bytes(dir, "memory.current", &usage);
+    } else {
+        pressure_read_bytes(dir, "memory.limit_in_bytes", &hard);
+        pressure_read_bytes(dir, "memory.soft_limit_in_bytes", &soft);
+        ok = pressure_read_bytes(dir, "memory.usage_in_bytes", &usage);
+    }
+    if (!ok) {
+        return false;
+    }
+    sample->limit = hard < soft ? hard : soft;
+    sample->usage = usage;
+
+    // "some avg10=1.23 avg60=..." on the first line
+    char buf[256];
+    char* avg10 = NULL;
+    if (pressure_read_file(dir, "memory.pressure", buf, sizeof(buf))) {
+        avg10 = strstr(buf, "avg10=");
+    }
+    sample->stall_avg10 = avg10 != NULL ? strtod(avg10 + 6, NULL) : -1.0;
+    return true;
+}
+
+// Unmaps every empty page, whatever its pool retains, and the unused part
+// of the page reserve, and tells the allocation caches to hand back their
+// blocks. The caller holds the heap lock.
+static void pressure_purge(void) {
+    atomic_fetch_add(&cache_generation, 1);
+    MyPageHeader* page = first_page;
+    while (page != NULL) {
+        MyPageHeader* next = page->next;
+        if (is_page_empty(page)) {
+            pressure.pages_purged++;
+            pressure.bytes_purged += page->size;
+            remove_empty_page(page);
+        }
+        page = next;
+    }
+    for (size_t i = 0; i < reserve_region_count; i++) {
+        munmap(reserve_regions[i].base, reserve_regions[i].size);
+        atomic_fetch_sub(&reserve_bytes, reserve_regions[i].size);
+        pressure.bytes_purged += reserve_regions[i].size;
+    }
+    reserve_region_count = 0;
+}
+
+// Records a sample and enters or leaves aggressive mode. The caller holds
+// the heap lock.
+static void pressure_apply(const PressureSample* sample) {
+    pressure.limit = sample->limit;
+    pressure.usage = sample->usage;
+    pressure.stall_avg10 = sample->stall_avg10;
+
+    uint64_t limit = pressure.limit;
+    bool near_limit = limit != UINT64_MAX && pressure.usage >= limit / 100 * PRESSURE_ENTER_PERCENT;
+    bool below_limit = limit == UINT64_MAX || pressure.usage < limit / 100 * PRESSURE_LEAVE_PERCENT;
+    if (!pressure.aggressive && (near_limit || pressure.stall_avg10 >= PRESSURE_STALL_ENTER)) {
+        pressure.aggressive = true;
+        pressure.episodes++;
+        atomic_store(&pressure_aggressive, true);
+        TRACE(1, TRACE_PRESSURE_ON, pressure.usage, NULL, NULL);
+        pressure_purge();
+    } else if (pressure.aggressive && below_limit && pressure.stall_avg10 < PRESSURE_STALL_LEAVE) {
+        pressure.aggressive = false;
+        atomic_store(&pressure_aggressive, false);
+        TRACE(1, TRACE_PRESSURE_OFF, pressure.usage, NULL, NULL);
+        if (atomic_load(&reserve_watermark) != 0) {
+            heap_defer(HEAP_DEFER_RESERVE_WAKE);
+        }
+    }
+}
+
+static uint64_t pressure_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Re-reads the cgroup, at most every PRESSURE_POLL_NS unless `force`, and
+// enters or leaves aggressive mode. Called without the heap lock: the files
+// are read outside it and only the result is applied under it.
+static void pressure_poll(bool force) {
+    uint64_t now_ns = pressure_now_ns();
+    uint64_t due = atomic_load(&pressure_next_poll_ns);
+    if (force) {
+        atomic_store(&pressure_next_poll_ns, now_ns + PRESSURE_POLL_NS);
+    } else if (now_ns < due || !atomic_compare_exchange_strong(&pressure_next_poll_ns, &due, now_ns + PRESSURE_POLL_NS)) {
+        return; // not due, or another thread is polling
+    }
+
+    char dir[sizeof(pressure.cgroup_dir)];
+    heap_lock_acquire();
+    int source = pressure_source;
+    memcpy(dir, pressure.cgroup_dir, sizeof(dir));
+    heap_lock_release();
+    if (source == 0) {
+        int found = pressure_find_cgroup(dir, sizeof(dir));
+        heap_lock_acquire();
+        // my_malloc_set_cgroup_dir may have picked one meanwhile
+        if (pressure_source == 0) {
+            pressure_source = found;
+            memcpy(pressure.cgroup_dir, dir, sizeof(dir));
+        }
+        source = pressure_source;
+        memcpy(dir, pressure.cgroup_dir, sizeof(dir));
+        heap_lock_release();
+    }
+    PressureSample sample;
+    if (source < 0 || !pressure_sample(dir, &sample)) {
+        return;
+    }
+    heap_lock_acquire();
+    // Drop the sample if the directory was switched while it was read
+    if (strcmp(dir, pressure.cgroup_dir) == 0) {
+        pressure_apply(&sample);
+    }
+    heap_lock_release();
+}
+
+// The allocation miss path holds the heap lock, so it only asks for a poll
+// when one is due; heap_lock_release runs it.
+static inline void pressure_request_poll(void) {
+    if (pressure_source >= 0 && pressure_now_ns() >= atomic_load_explicit(&pressure_next_poll_ns, memory_order_relaxed)) {
+        heap_defer(HEAP_DEFER_PRESSURE_POLL);
+    }
+}
+
+// In aggressive mode: a page of any other pool that can take `size` bytes
+static MyPageHeader* pressure_find_any_pool(size_t size, MyAllocHint hint) {
+    for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+        if (pool == (int)hint) {
+            continue;
+        }
+        MyPageHeader* page = page_index_find(size, (MyAllocHint)pool);
+        if (page != NULL) {
+            pressure.cross_pool_reuses++;
+            return page;
+        }
+    }
+    return NULL;
+}
+
+// Watches `dir` instead of the process's cgroup; NULL goes back to the
+// cgroup (or MY_MALLOC_CGROUP), "" stops watching. Returns false if the
+// directory has no usage to read.
+bool my_malloc_set_cgroup_dir(const char* dir) {
+    char found[sizeof(pressure.cgroup_dir)] = "";
+    int source;
+    if (dir == NULL) {
+        source = pressure_find_cgroup(found, sizeof(found));
+    } else {
+        snprintf(found, sizeof(found), "%s", dir);
+        source = dir[0] != '\0' ? 1 : -1;
+    }
+    PressureSample sample;
+    bool ok = source > 0 && pressure_sample(found, &sample);
+
+    heap_lock_acquire();
+    memcpy(pressure.cgroup_dir, found, sizeof(found));
+    pressure_source = source;
+    if (ok) {
+        pressure_apply(&sample);
+    } else if (pressure.aggressive) {
+        pressure.aggressive = false;
+        atomic_store(&pressure_aggressive, false);
+    }
+    heap_lock_release();
+    return ok;
+}
+
+// Polls the cgroup now instead of at the next new page, e.g. after a big
+// allocation the allocator does not see.
+void my_malloc_check_pressure(void) {
+    pressure_poll(true);
+}
+
+void my_malloc_pressure_state(MyPressureState* state) {
+    heap_lock_acquire();
+    bool unknown = pressure_source == 0;
+    heap_lock_release();
+    if (unknown) {
+        pressure_poll(true);
+    }
+    heap_lock_acquire();
+    *state = pressure;
+    heap_lock_release();
+}
+
+void print_pressure_state(void) {
+    MyPressureState state;
+    my_malloc_pressure_state(&state);
+    printf("\n=== Memory Pressure ===\n");
+    if (state.cgroup_dir[0] == '\0') {
+        printf("no cgroup memory limit found\n");
+        return;
+    }
+    printf("cgroup: %s\n", state.cgroup_dir);
+    if (state.limit == UINT64_MAX) {
+        printf("usage %llu bytes, no limit", (unsigned long long)state.usage);
+    } else {
+        printf("usage %llu of %llu bytes (%.1f%%)", (unsigned long long)state.usage,
+               (unsigned long long)state.limit, 100.0 * (double)state.usage / (double)state.limit);
+    }
+    if (state.stall_avg10 >= 0) {
+        printf(", stalled %.2f%% of the last 10 s", state.stall_avg10);
+    }
+    printf("\nmode: %s, %zu episode(s), %zu pages / %zu bytes purged, %zu cross-pool reuses\n",
+           state.aggressive ? "aggressive" : "normal", state.episodes, state.pages_purged,
+           state.bytes_purged, state.cross_pool_reuses);
+}
+
+// Picks a block for `size` bytes from the pool of `hint`: a sampled guarded
+// block, a reused free block, or a fresh block carved from a page.
+static void* allocate_block(size_t size, MyAllocHint hint) {
+    // Auto-tuning; with it off this is only a decrement
+    if (__builtin_expect(--tune_countdown == 0, 0)) {
+        tune_sample(size, hint);
+    }
+    
+    // Round size up to the size-class spacing, a multiple of BLOCK_SIZE that keeps alignment.
+    // The spacing is at most PAGE_SIZE, so below MAX_ALLOC_SIZE this cannot wrap.
+    if (size > MAX_ALLOC_SIZE) {
+        return NULL;
+    }
+    size = (size + size_class_spacing - 1) & ~(size_class_spacing - 1);
+    
+    // Guard-page sampling; with sampling off this is only a decrement
+    if (__builtin_expect(--guard_countdown == 0, 0)) {
+        void* guarded = guard_sample_alloc(size);
+        if (guarded != NULL) {
+            return guarded;
+        }
+    }
+    
+    // Ask the page index for a page with a big enough free extent
+    MyPageHeader* page = page_index_find(size, hint);
+    
+    // Before mapping more, ask for a cgroup poll (it runs once the lock is
+    // released); close to the limit last read, any pool's free space will do
+    if (page == NULL) {
+        pressure_request_poll();
+        if (pressure.aggressive) {
+            page = pressure_find_any_pool(size, hint);
+        }
+    }
+    
+    // Create new page if needed
+    if (page == NULL) {
+        page = create_new_page(size, hint);
+        if (page == NULL) {
+            return NULL; // Out of memory
+        }
+    }
+    
+    // Reuse a free block in that page, or carve a new one from its tail
+    MyBlockHeader* block = pool_policies[hint].best_fit ? find_best_free_block_in_page(size, page)
+                                                        : find_free_block_in_page(size, page);
+    if (block != NULL) {
+        block->is_free = false;
+        block->handle = 0;
+        split_block(block, size);
+    } else {
+        block = create_new_block(size, page);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+    page_index_update(page);
+    
+    return (void*)((char*)block + sizeof(MyBlockHeader));
+}
+
+// Shared body of my_malloc and my_malloc_hint. Always inlined, so the heap
+// profiler sees exactly one allocator frame above prof_record_alloc.
+static inline __attribute__((always_inline)) void* malloc_with_hint(size_t size, MyAllocHint hint) {
+    if (size == 0 || size > MAX_ALLOC_SIZE) {
+        return NULL;
+    }
+    
+    heap_lock_acquire();
+    void* ptr = allocate_block(size, hint);
+    
+    // Heap profiling; an allocation that is not sampled only pays this
+    // subtraction. Failed requests, which can be larger than INT64_MAX, do
+    // not count.
+    if (__builtin_expect(ptr != NULL && (prof_bytes_until_sample -= (int64_t)size) < 0, 0)) {
+        prof_record_alloc(ptr, size);
+    }
+    heap_lock_release();
+    TRACE(2, TRACE_MALLOC, size, ptr, NULL);
+    return ptr;
+}
+
+void* my_malloc(size_t size) {
+    return malloc_with_hint(size, MY_HINT_DEFAULT);
+}
+
+// Like my_malloc, but places the block in the page pool for the expected
+// lifetime `hint`. Free it with my_free as usual.
+void* my_malloc_hint(size_t size, MyAllocHint hint) {
+    if ((unsigned)hint >= MY_HINT_COUNT) {
+        hint = MY_HINT_DEFAULT;
+    }
+    return malloc_with_hint(size, hint);
+}
+
+// Helper function to coalesce adjacent free blocks
+void coalesce_blocks(MyPageHeader* page) {
+    MyBlockHeader* current = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+    
+    while (current != NULL && current->next != NULL) {
+        if (current->is_free && current->next->is_free) {
+            // Merge current block with next block
+            MyBlockHeader* next_block = current->next;
+            current->size += sizeof(MyBlockHeader) + next_block->size;
+            current->next = next_block->next;
+            
+            // free_mem only counts the unallocated tail; the merged header
+            // becomes part of this block, not of the tail
+            
+            // Continue checking from current block (don't advance)
+            continue;
+        }
+        current = current->next;
+    }
+}
+
+// Helper function to check if a page is completely free
+bool is_page_empty(MyPageHeader* page) {
+    MyBlockHeader* current = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+    
+    // If free memory equals total memory minus page header, page is empty
+    if (page->free_mem == page->size - sizeof(MyPageHeader)) {
+        return true;
+    }
+    
+    // Check if all blocks are free
+    while (current != NULL && 
+           (char*)current < (char*)page + page->size - page->free_mem) {
+        if (!current->is_free) {
+            return false;
+        }
+        current = current->next;
+    }
+    return true;
+}
+
+// Helper function to remove an empty page from the page list
+void remove_empty_page(MyPageHeader* page_to_remove) {
+    if (page_to_remove->prev != NULL) {
+        page_to_remove->prev->next = page_to_remove->next;
+    } else {
+        // Removing the first page
+        first_page = page_to_remove->next;
+    }
+    if (page_to_remove->next != NULL) {
+        page_to_remove->next->prev = page_to_remove->prev;
+    } else {
+        last_page = page_to_remove->prev;
+    }
+    page_index_unlink(page_to_remove);
+    page_address_remove(page_to_remove);
+    pool_page_count[page_to_remove->pool]--;
+    mapped_bytes -= page_to_remove->size;
+    
+    // Unmap the page from memory
+    TRACE(1, TRACE_PAGE_UNMAP, page_to_remove->size, NULL, page_to_remove);
+    munmap(page_to_remove, page_to_remove->size);
+}
+
+// The page a block was carved from, or NULL if it is on none of them.
+static MyPageHeader* find_page_of_block(MyBlockHeader* block) {
+    // The last page that starts at or below the block
+    size_t at = page_address_search((char*)block + 1);
+    if (at == 0) {
+        return NULL;
+    }
+    MyPageHeader* page = page_addresses[at - 1];
+    return (char*)block < (char*)page + page->size ? page : NULL;
+}
+
+// my_free without the heap lock; the caller holds it.
+static void free_block(void* ptr) {
+    // Find the block header
+    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
+    
+    if (block->is_sampled) {
+        prof_record_free(ptr);
+    }
+    
+    // Sampled blocks are not on any page; a quarantined one faults right here
+    if (block->is_guarded) {
+        guard_free(ptr);
+        return;
+    }
+    
+    // Validate that this is a valid allocated block
+    if (block->is_free) {
+        printf("Warning: Attempting to free already freed memory at %p\n", ptr);
+        return;
+    }
+    
+    // Find which page this block belongs to
+    MyPageHeader* block_page = find_page_of_block(block);
+    if (block_page == NULL) {
+        printf("Error: Could not find page for block at %p\n", ptr);
+        return;
+    }
+    
+    TRACE(2, TRACE_FREE, block->size, ptr, block_page);
+    
+    // Mark block as free (DON'T update free_mem counter here - it's misleading)
+    // The free_mem represents unallocated space, not freed blocks
+    block->is_free = true;
+    
+    // Coalesce adjacent free blocks to reduce fragmentation
+    coalesce_blocks(block_page);
+    
+    // Check if the entire page is now free and can be returned to system.
+    // Pools don't shrink below the pages they are told to retain, unless
+    // the cgroup is running out of memory.
+    if (is_page_empty(block_page) &&
+        (pool_page_count[block_page->pool] > pool_policies[block_page->pool].retain_pages ||
+         pressure.aggressive)) {
+        remove_empty_page(block_page);
+    } else {
+        page_index_update(block_page);
+    }
+}
+
+void my_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    heap_lock_acquire();
+    free_block(ptr);
+    heap_lock_release();
+}
+
+// ---- In-place growth ----
+// Bytes the caller may use at `ptr`; at least what was asked for, since
+// requests are rounded up to BLOCK_SIZE.
+size_t my_usable_size(void* ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    return ((MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader)))->size;
+}
+
+// Extends the mapping of `page` by at least `extra` bytes without moving it.
+// Only works where the kernel can grow a mapping in place (Linux mremap) and
+// the address range right after the page is unused.
+static bool grow_page_mapping(MyPageHeader* page, size_t extra) {
+#ifdef MREMAP_MAYMOVE
+    size_t new_size = (page->size + extra + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    if (new_size < page->size || mremap(page, page->size, new_size, 0) == MAP_FAILED) {
+        return false;
+    }
+    TRACE(1, TRACE_PAGE_MAP, new_size - page->size, NULL, page);
+    mapped_bytes += new_size - page->size;
+    if (mapped_bytes > peak_mapped_bytes) {
+        peak_mapped_bytes = mapped_bytes;
+    }
+    page->free_mem += new_size - page->size;
+    page->size = new_size;
+    return true;
+#else
+    (void)page;
+    (void)extra;
+    return false;
+#endif
+}
+
+// Grows the block at `ptr` where it is, to `preferred_size` if possible and
+// to no less than `min_size`, by absorbing a free block right after it and,
+// for the last block of a page, the page's unallocated tail (extending the
+// mapping when that is not enough). Returns the new usable size, or 0 if the
+// block cannot reach `min_size` without moving; it is left untouched then.
+size_t my_try_expand(void* ptr, size_t min_size, size_t preferred_size) {
+    if (ptr == NULL || min_size > SIZE_MAX - BLOCK_SIZE || preferred_size > SIZE_MAX - BLOCK_SIZE) {
+        return 0;
+    }
+    min_size = (min_size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    preferred_size = (preferred_size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    if (preferred_size < min_size) {
+        preferred_size = min_size;
+    }
+
+    heap_lock_acquire();
+    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
+    if (block->size >= min_size) {
+        size_t size = block->size;
+        heap_lock_release();
+        return size;
+    }
+    // Guarded blocks sit right against their guard page
+    MyPageHeader* page = block->is_guarded ? NULL : find_page_of_block(block);
+    if (page == NULL || block->is_free) {
+        heap_lock_release();
+        return 0;
+    }
+
+    // Free neighbours are always coalesced, so there is at most one to absorb
+    MyBlockHeader* next = block->next;
+    char* blocks_end = (char*)page + page->size - page->free_mem;
+    bool next_is_free = next != NULL && (char*)next < blocks_end && next->is_free;
+    MyBlockHeader* last = next_is_free ? next : block;
+    bool touches_tail = (char*)last + sizeof(MyBlockHeader) + last->size == blocks_end;
+
+    size_t available = block->size;
+    if (next_is_free) {
+        available += sizeof(MyBlockHeader) + next->size;
+    }
+    if (touches_tail) {
+        available += page->free_mem;
+        if (available < preferred_size && !grow_page_mapping(page, preferred_size - available) &&
+            available < min_size && !grow_page_mapping(page, min_size - available)) {
+            heap_lock_release();
+            return 0;
+        }
+        available = block->size + page->free_mem +
+                    (next_is_free ? sizeof(MyBlockHeader) + next->size : 0);
+    }
+    if (available < min_size) {
+        heap_lock_release();
+        return 0;
+    }
+
+    if (next_is_free) {
+        block->size += sizeof(MyBlockHeader) + next->size;
+        block->next = next->next;
+    }
+    if (touches_tail && block->size < preferred_size) {
+        size_t take = preferred_size - block->size;
+        if (take > page->free_mem) {
+            take = page->free_mem;
+        }
+        block->size += take;
+        page->free_mem -= take;
+    }
+    // Hand back what an absorbed free block had beyond the preferred size
+    split_block(block, preferred_size);
+    page_index_update(page);
+
+    size_t size = block->size;
+    heap_lock_release();
+    TRACE(2, TRACE_EXPAND, size, ptr, page);
+    return size;
+}
+
+// Resizes the block at `ptr`, in place when my_try_expand can, otherwise by
+// moving it to a new block. NULL and a size of 0 behave as in realloc.
+void* my_realloc(void* ptr, size_t size) {
+    if (ptr == NULL) {
+        return my_malloc(size);
+    }
+    if (size == 0) {
+        my_free(ptr);
+        return NULL;
+    }
+    if (my_try_expand(ptr, size, size) != 0) {
+        return ptr;
+    }
+    void* moved = my_malloc(size);
+    if (moved == NULL) {
+        return NULL;
+    }
+    size_t old_size = my_usable_size(ptr);
+    my_memcpy(moved, ptr, old_size < size ? old_size : size);
+    my_free(ptr);
+    return moved;
+}
+
+void* my_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* ptr = my_malloc(count * size);
+    if (ptr != NULL) {
+        my_memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+// ---- Per-CPU allocation caches ----
+// my_cache_malloc/my_cache_free are a front end for small objects that
+// keeps freed blocks in a cache and only takes the heap lock to move half
+// a cache's worth at a time. By default there is one cache per CPU: the
+// pop and push are restartable sequences (rseq), so they run without
+// atomics or locks and the kernel restarts them if the thread is preempted
+// or migrated before the final store. With thousands of mostly idle
+// threads, cache memory stays bounded by the number of CPUs. Without rseq
+// (not x86-64, old glibc, or glibc.pthread.rseq=0) every thread gets its
+// own cache instead, drained back to the heap when the thread exits.
+//
+// Cached blocks are ordinary allocated heap blocks, so my_free,
+// my_realloc and my_usable_size work on them, and my_cache_free takes any
+// block. Under memory pressure frees bypass the cache and drain it.
+typedef enum MyCacheMode{
+    MY_CACHE_AUTO,       // per CPU when rseq is available, else per thread
+    MY_CACHE_PER_CPU,
+    MY_CACHE_PER_THREAD,
+}MyCacheMode;
+
+// A stack of free blocks of one class; count is the only word a push or
+// pop commits, so the rseq sequences end in a single store.
+typedef struct CacheClass{
+    uint64_t count;
+    void* slots[CACHE_MAX_SLOTS];
+}CacheClass;
+
+typedef struct BlockCache{
+    CacheClass classes[CACHE_CLASSES];
+    _Atomic uint64_t generation;     // cache_generation when last flushed
+}BlockCache;
+
+static MyCacheMode cache_mode = MY_CACHE_AUTO;   // resolved on first use
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static BlockCache* cpu_caches = NULL;            // one per possible CPU
+static size_t cpu_cache_count = 0;
+static uint64_t cache_capacity[CACHE_CLASSES];
+static __thread BlockCache* thread_cache = NULL;
+static pthread_key_t thread_cache_key;
+static _Atomic size_t cache_mapped_bytes = 0;    // cache structures, not the blocks
+
+static inline size_t cache_class_size(int cache_class) {
+    return (size_t)(cache_class + 1) * BLOCK_SIZE;
+}
+
+static void thread_cache_destroy(void* cache);
+
+static void cache_init(void) {
+    for (int c = 0; c < CACHE_CLASSES; c++) {
+        uint64_t slots = CACHE_CLASS_BYTES / cache_class_size(c);
+        cache_capacity[c] = slots < CACHE_MIN_SLOTS ? CACHE_MIN_SLOTS
+                          : slots > CACHE_MAX_SLOTS ? CACHE_MAX_SLOTS : slots;
+    }
+    pthread_key_create(&thread_cache_key, thread_cache_destroy);
+
+#ifdef MY_HAVE_RSEQ
+    // glibc leaves __rseq_size at 0 when it did not register rseq
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (__rseq_size > 0 && cpus > 0) {
+        size_t size = (size_t)cpus * sizeof(BlockCache);
+        void* caches = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (caches != MAP_FAILED) {
+            cpu_caches = caches;
+            cpu_cache_count = (size_t)cpus;
+            atomic_fetch_add(&cache_mapped_bytes, size);
+        }
+    }
+#endif
+    if (cache_mode == MY_CACHE_AUTO || (cache_mode == MY_CACHE_PER_CPU && cpu_caches == NULL)) {
+        cache_mode = cpu_caches != NULL ? MY_CACHE_PER_CPU : MY_CACHE_PER_THREAD;
+    }
+}
+
+// Picks per-CPU or per-thread caches. Blocks already in caches of the other
+// kind stay there until the thread exits or calls my_cache_flush under
+// that mode. Returns false if per-CPU caches are not available.
+bool my_cache_set_mode(MyCacheMode mode) {
+    pthread_once(&cache_once, cache_init);
+    if (mode == MY_CACHE_AUTO) {
+        mode = cpu_caches != NULL ? MY_CACHE_PER_CPU : MY_CACHE_PER_THREAD;
+    }
+    if (mode == MY_CACHE_PER_CPU && cpu_caches == NULL) {
+        return false;
+    }
+    cache_mode = mode;
+    return true;
+}
+
+const char* my_cache_mode_name(void) {
+    pthread_once(&cache_once, cache_init);
+    return cache_mode == MY_CACHE_PER_CPU ? "per-CPU (rseq)" : "per-thread";
+}
+
+#ifdef MY_HAVE_RSEQ
+static inline struct rseq* rseq_area(void) {
+    return (struct rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+}
+
+// Both sequences check that the thread is still on `cpu`, do their work on
+// that CPU's class, and commit by storing the new count. The descriptor in
+// __rseq_cs tells the kernel where the sequence starts, where it commits
+// and where to resume (abort) if it was interrupted in between; the abort
+// handler must be preceded by RSEQ_SIG.
+#define RSEQ_CS_BEGIN \
+    ".pushsection __rseq_cs, \"aw\"\n\t" \
+    ".balign 32\n\t" \
+    "3:\n\t" \
+    ".long 0x0, 0x0\n\t" \
+    ".quad 1f, (2f - 1f), 4f\n\t" \
+    ".popsection\n\t" \
+    "leaq 3b(%%rip), %%rax\n\t" \
+    "movq %%rax, %c[rseq_cs](%[rseq])\n\t" \
+    "1:\n\t" \
+    "cmpl %[cpu], %c[cpu_id](%[rseq])\n\t" \
+    "jnz 4f\n\t"
+#define RSEQ_CS_END \
+    "2:\n\t" \
+    ".pushsection __rseq_failure, \"ax\"\n\t" \
+    ".byte 0x0f, 0xb9, 0x3d\n\t" \
+    ".long 0x53053053\n\t" \
+    "4:\n\t" \
+    "jmp %l[restart]\n\t" \
+    ".popsection\n\t"
+
+// Pops a block of `cache_class` from this CPU's cache; NULL if it is empty
+static inline void* cpu_cache_pop(int cache_class) {
+    struct rseq* rseq = rseq_area();
+    void* block;
+restart:
+    block = NULL;
+    uint32_t cpu = __atomic_load_n(&rseq->cpu_id_start, __ATOMIC_RELAXED);
+    if (__builtin_expect(cpu >= cpu_cache_count, 0)) {
+        return NULL;
+    }
+    CacheClass* stack = &cpu_caches[cpu].classes[cache_class];
+    __asm__ goto(
+        RSEQ_CS_BEGIN
+        "movq (%[stack]), %%rax\n\t"
+        "testq %%rax, %%rax\n\t"
+        "jz 2f\n\t"
+        "movq (%[stack], %%rax, 8), %%rcx\n\t" // slots[count - 1]
+        "movq %%rcx, (%[block])\n\t"
+        "decq %%rax\n\t"
+        "movq %%rax, (%[stack])\n\t"
+        RSEQ_CS_END
+        :
+        : [rseq] "r"(rseq), [cpu] "r"(cpu), [stack] "r"(stack), [block] "r"(&block),
+          [rseq_cs] "i"(offsetof(struct rseq, rseq_cs)), [cpu_id] "i"(offsetof(struct rseq, cpu_id))
+        : "rax", "rcx", "memory", "cc"
+        : restart);
+    return block;
+}
+
+// Pushes `block` onto this CPU's cache; false if the class is full
+static inline bool cpu_cache_push(int cache_class, void* block) {
+    struct rseq* rseq = rseq_area();
+    bool pushed;
+restart:
+    pushed = false;
+    uint32_t cpu = __atomic_load_n(&rseq->cpu_id_start, __ATOMIC_RELAXED);
+    if (__builtin_expect(cpu >= cpu_cache_count, 0)) {
+        return false;
+    }
+    CacheClass* stack = &cpu_caches[cpu].classes[cache_class];
+    __asm__ goto(
+        RSEQ_CS_BEGIN
+        "movq (%[stack]), %%rax\n\t"
+        "cmpq %[capacity], %%rax\n\t"
+        "jae 2f\n\t"
+        "movq %[value], 8(%[stack], %%rax, 8)\n\t" // slots[count]
+        "movb $1, (%[pushed])\n\t"
+        "incq %%rax\n\t"
+        "movq %%rax, (%[stack])\n\t"
+        RSEQ_CS_END
+        :
+        : [rseq] "r"(rseq), [cpu] "r"(cpu), [stack] "r"(stack), [value] "r"(block),
+          [capacity] "r"(cache_capacity[cache_class]), [pushed] "r"(&pushed),
+          [rseq_cs] "i"(offsetof(struct rseq, rseq_cs)), [cpu_id] "i"(offsetof(struct rseq, cpu_id))
+        : "rax", "memory", "cc"
+        : restart);
+    return pushed;
+}
+#endif
+
+static BlockCache* thread_cache_create(void) {
+    BlockCache* cache = mmap(NULL, sizeof(BlockCache), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) {
+        return NULL;
+    }
+    atomic_fetch_add(&cache_mapped_bytes, sizeof(BlockCache));
+    atomic_init(&cache->generation, atomic_load(&cache_generation));
+    thread_cache = cache;
+    pthread_setspecific(thread_cache_key, cache);
+    return cache;
+}
+
+// The cache cache_pop and cache_push would use now; NULL if there is none
+static inline BlockCache* cache_current(void) {
+#ifdef MY_HAVE_RSEQ
+    if (cache_mode == MY_CACHE_PER_CPU) {
+        uint32_t cpu = __atomic_load_n(&rseq_area()->cpu_id_start, __ATOMIC_RELAXED);
+        return cpu < cpu_cache_count ? &cpu_caches[cpu] : NULL;
+    }
+#endif
+    return thread_cache;
+}
+
+static inline void* cache_pop(int cache_class) {
+#ifdef MY_HAVE_RSEQ
+    if (cache_mode == MY_CACHE_PER_CPU) {
+        return cpu_cache_pop(cache_class);
+    }
+#endif
+    BlockCache* cache = thread_cache;
+    if (cache == NULL || cache->classes[cache_class].count == 0) {
+        return NULL;
+    }
+    CacheClass* stack = &cache->classes[cache_class];
+    return stack->slots[--stack->count];
+}
+
+static inline bool cache_push(int cache_class, void* block) {
+#ifdef MY_HAVE_RSEQ
+    if (cache_mode == MY_CACHE_PER_CPU) {
+        return cpu_cache_push(cache_class, block);
+    }
+#endif
+    BlockCache* cache = thread_cache;
+    if (cache == NULL && (cache = thread_cache_create()) == NULL) {
+        return false;
+    }
+    CacheClass* stack = &cache->classes[cache_class];
+    if (stack->count == cache_capacity[cache_class]) {
+        return false;
+    }
+    stack->slots[stack->count++] = block;
+    return true;
+}
+
+// Gives `count` blocks back to the heap under one lock acquisition
+static void cache_release(void** blocks, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    heap_lock_acquire();
+    for (size_t i = 0; i < count; i++) {
+        free_block(blocks[i]);
+    }
+    heap_lock_release();
+}
+
+// Empties the current CPU's (or thread's) class into the heap, or only
+// half of it when `all` is false.
+static void cache_drain(int cache_class, bool all) {
+    void* blocks[CACHE_MAX_SLOTS];
+    size_t count = 0;
+    size_t target = all ? CACHE_MAX_SLOTS : cache_capacity[cache_class] / 2;
+    while (count < target && (blocks[count] = cache_pop(cache_class)) != NULL) {
+        count++;
+    }
+    cache_release(blocks, count);
+}
+
+// Empties the current cache if pressure_purge ran since it was last
+// flushed, so a purge reaches every cache, not only the classes still
+// being freed into. The thread that moves a per-CPU cache to the new
+// generation flushes it; if it migrates meanwhile, the rest of that cache
+// waits for the next purge or my_cache_flush.
+static inline void cache_check_generation(void) {
+    uint64_t generation = atomic_load_explicit(&cache_generation, memory_order_relaxed);
+    BlockCache* cache = cache_current();
+    if (cache == NULL) {
+        return;
+    }
+    uint64_t seen = atomic_load_explicit(&cache->generation, memory_order_relaxed);
+    if (__builtin_expect(seen == generation, 1) ||
+        !atomic_compare_exchange_strong(&cache->generation, &seen, generation)) {
+        return;
+    }
+    for (int c = 0; c < CACHE_CLASSES; c++) {
+        cache_drain(c, true);
+    }
+}
+
+static void thread_cache_destroy(void* cache) {
+    BlockCache* self = cache;
+    for (int c = 0; c < CACHE_CLASSES; c++) {
+        cache_release(self->classes[c].slots, self->classes[c].count);
+    }
+    munmap(self, sizeof(BlockCache));
+    atomic_fetch_sub(&cache_mapped_bytes, sizeof(BlockCache));
+    thread_cache = NULL;
+}
+
+// Cache miss: takes half a cache's worth of blocks from the heap in one go,
+// keeps all but one and returns that one. Under memory pressure only the
+// one is allocated.
+//
+// Every block counts towards the profiler's byte countdown and is traced,
+// as my_malloc would. A block that gets sampled or guarded cannot be
+// cached (my_cache_free sends those to my_free), so it ends the batch and
+// is the one returned; the profiler then records the caller's stack for
+// it. always_inline keeps the frames prof_record_alloc skips the same as
+// for my_malloc.
+static inline __attribute__((always_inline)) void* cache_refill(int cache_class) {
+    void* blocks[CACHE_MAX_SLOTS];
+    size_t size = cache_class_size(cache_class);
+    size_t want = atomic_load_explicit(&pressure_aggressive, memory_order_relaxed) ? 1
+                : cache_capacity[cache_class] / 2;
+    size_t count = 0;
+    heap_lock_acquire();
+    while (count < want && (blocks[count] = allocate_block(size, MY_HINT_DEFAULT)) != NULL) {
+        void* block = blocks[count++];
+        if (__builtin_expect((prof_bytes_until_sample -= (int64_t)size) < 0, 0)) {
+            prof_record_alloc(block, size);
+        }
+        MyBlockHeader* header = (MyBlockHeader*)((char*)block - sizeof(MyBlockHeader));
+        if (__builtin_expect(header->is_sampled || header->is_guarded, 0)) {
+            blocks[count - 1] = blocks[0];
+            blocks[0] = block;
+            break;
+        }
+    }
+    heap_lock_release();
+    if (count == 0) {
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        TRACE(2, TRACE_MALLOC, size, blocks[i], NULL);
+    }
+    size_t kept = 1;
+    while (kept < count && cache_push(cache_class, blocks[kept])) {
+        kept++;
+    }
+    cache_release(blocks + kept, count - kept);
+    return blocks[0];
+}
+
+void* my_cache_malloc(size_t size) {
+    if (size == 0 || size > CACHE_MAX_SIZE) {
+        return my_malloc(size);
+    }
+    pthread_once(&cache_once, cache_init);
+    cache_check_generation();
+    int cache_class = (int)((size - 1) / BLOCK_SIZE);
+    void* block = cache_pop(cache_class);
+    return block != NULL ? block : cache_refill(cache_class);
+}
+
+void my_cache_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
+    // Blocks the profiler, the guard sampler or a handle track go the long way
+    if (block->size > CACHE_MAX_SIZE || block->is_free || block->is_guarded ||
+        block->is_sampled || block->handle != 0) {
+        my_free(ptr);
+        return;
+    }
+    pthread_once(&cache_once, cache_init);
+    cache_check_generation();
+    // The block may be bigger than the class it came from; file it under
+    // the largest class it can serve
+    int cache_class = (int)(block->size / BLOCK_SIZE) - 1;
+    if (__builtin_expect(atomic_load_explicit(&pressure_aggressive, memory_order_relaxed), 0)) {
+        cache_drain(cache_class, true);
+        my_free(ptr);
+        return;
+    }
+    if (!cache_push(cache_class, ptr)) {
+        // Full: hand half of the class back to the heap and try once more
+        cache_drain(cache_class, false);
+        if (!cache_push(cache_class, ptr)) {
+            my_free(ptr);
+        }
+    }
+}
+
+// Returns every block cached for this CPU (or this thread) to the heap
+void my_cache_flush(void) {
+    pthread_once(&cache_once, cache_init);
+    for (int c = 0; c < CACHE_CLASSES; c++) {
+        cache_drain(c, true);
+    }
+}
+
+// ---- Epoch-based reclamation ----
+// For lock-free structures whose nodes may still be read by other threads
+// after they are unlinked. Readers bracket every access with my_ebr_enter
+// and my_ebr_exit. Writers hand unlinked nodes to my_ebr_retire instead of
+// my_free. A node retired in epoch E is only freed once the global epoch
+// reaches E + 2: by then every thread has been seen outside a critical
+// section or inside a newer epoch, so nobody can still hold the node.
+//
+// Retired blocks are chained through their header (retired_next) in one of
+// three per-thread limbo lists, so retiring never allocates, and each ripe
+// list goes back to the heap under a single lock acquisition.
+typedef struct EbrThread{
+    _Atomic uint64_t local_epoch;  // epoch << 1 | 1 while inside a critical section
+    uint32_t nesting;
+    MyBlockHeader* limbo[3];       // indexed by retire epoch % 3
+    uint64_t limbo_epoch[3];
+    size_t retired_count;          // blocks waiting in all three lists
+    struct EbrThread* next;
+}EbrThread;
+
+static _Atomic uint64_t ebr_global_epoch = 0;
+static _Atomic(EbrThread*) ebr_threads = NULL;
+static __thread EbrThread* ebr_self = NULL;
+static _Atomic size_t ebr_reclaimed_blocks = 0;
+
+// This thread's record, registered on first use. Aborts if the record
+// cannot be mapped, so callers never see NULL.
+static EbrThread* ebr_thread(void) {
+    EbrThread* self = ebr_self;
+    if (__builtin_expect(self != NULL, 1)) {
+        return self;
+    }
+    // Thread records are mmap'd, never freed, and reused once their thread
+    // has called my_ebr_thread_exit.
+    for (EbrThread* t = atomic_load(&ebr_threads); t != NULL; t = t->next) {
+        uint64_t released = 2; // marker left by my_ebr_thread_exit
+        if (atomic_compare_exchange_strong(&t->local_epoch, &released, 0)) {
+            ebr_self = t;
+            return t;
+        }
+    }
+    self = mmap(NULL, sizeof(EbrThread), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (self == MAP_FAILED) {
+        // Without a record the thread cannot announce its reads, so neither
+        // entering nor retiring can go on safely
+        perror("Fatal: cannot map an EBR thread record");
+        abort();
+    }
+    EbrThread* head = atomic_load(&ebr_threads);
+    do {
+        self->next = head;
+    } while (!atomic_compare_exchange_weak(&ebr_threads, &head, self));
+    ebr_self = self;
+    return self;
+}
+
+void my_ebr_enter(void) {
+    EbrThread* self = ebr_thread();
+    if (self->nesting++ == 0) {
+        // seq_cst so the announcement is visible before any read of shared nodes
+        atomic_store(&self->local_epoch, (atomic_load(&ebr_global_epoch) << 1) | 1);
+    }
+}
+
+void my_ebr_exit(void) {
+    EbrThread* self = ebr_self;
+    // Without a matching my_ebr_enter there is nothing to leave
+    if (self == NULL || self->nesting == 0) {
+        return;
+    }
+    if (--self->nesting == 0) {
+        atomic_store_explicit(&self->local_epoch, 0, memory_order_release);
+    }
+}
+
+// Moves the global epoch forward if every active thread has caught up to it.
+static uint64_t ebr_try_advance(void) {
+    uint64_t epoch = atomic_load(&ebr_global_epoch);
+    for (EbrThread* t = atomic_load(&ebr_threads); t != NULL; t = t->next) {
+        uint64_t local = atomic_load(&t->local_epoch);
+        if ((local & 1) != 0 && (local >> 1) != epoch) {
+            return epoch;
+        }
+    }
+    if (atomic_compare_exchange_strong(&ebr_global_epoch, &epoch, epoch + 1)) {
+        return epoch + 1;
+    }
+    return epoch; // someone else advanced it; the CAS reloaded epoch
+}
+
+// Frees this thread's limbo lists that are at least two epochs old.
+static void ebr_reclaim(EbrThread* self, uint64_t epoch) {
+    MyBlockHeader* ripe = NULL;
+    size_t count = 0;
+    for (int i = 0; i < 3; i++) {
+        if (self->limbo[i] != NULL && self->limbo_epoch[i] + 2 <= epoch) {
+            MyBlockHeader* tail = self->limbo[i];
+            count++;
+            while (tail->retired_next != NULL) {
+                tail = tail->retired_next;
+                count++;
+            }
+            tail->retired_next = ripe;
+            ripe = self->limbo[i];
+            self->limbo[i] = NULL;
+        }
+    }
+    if (ripe == NULL) {
+        return;
+    }
+
+    heap_lock_acquire();
+    while (ripe != NULL) {
+        MyBlockHeader* next = ripe->retired_next;
+        free_block((char*)ripe + sizeof(MyBlockHeader));
+        ripe = next;
+    }
+    heap_lock_release();
+    self->retired_count -= count;
+    atomic_fetch_add(&ebr_reclaimed_blocks, count);
+}
+
+// Frees `ptr` once no thread can still be reading it. Call after the block
+// has been unlinked from the shared structure; never allocates.
+void my_ebr_retire(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    EbrThread* self = ebr_thread();
+    uint64_t epoch = atomic_load(&ebr_global_epoch);
+    int slot = (int)(epoch % 3);
+
+    // This slot still holds a list from three epochs ago: it is ripe by now
+    // if the epoch moved on, otherwise keep appending to it.
+    if (self->limbo[slot] != NULL && self->limbo_epoch[slot] != epoch) {
+        ebr_reclaim(self, epoch);
+    }
+
+    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
+    block->retired_next = self->limbo[slot];
+    self->limbo[slot] = block;
+    self->limbo_epoch[slot] = epoch;
+    self->retired_count++;
+
+    if (self->retired_count >= atomic_load_explicit(&ebr_batch, memory_order_relaxed)) {
+        ebr_reclaim(self, ebr_try_advance());
+    }
+}
+
+// Reclaims everything this thread has retired, waiting for other threads to
+// leave their critical sections. Must not be called inside one.
+void my_ebr_flush(void) {
+    EbrThread* self = ebr_thread();
+    while (self->retired_count > 0) {
+        ebr_reclaim(self, ebr_try_advance());
+        if (self->retired_count > 0) {
+            sched_yield();
+        }
+    }
+}
+
+// Call before a thread that used EBR exits: flushes its limbo lists and
+// releases its record for reuse by a later thread.
+void my_ebr_thread_exit(void) {
+    if (ebr_self == NULL) {
+        return;
+    }
+    my_ebr_flush();
+    atomic_store(&ebr_self->local_epoch, 2);
+    ebr_self = NULL;
+}
+
+// ---- Movable allocations and heap compaction ----
+// Memory from my_handle_alloc is reached through a handle instead of a raw
+// pointer. While a handle is not pinned the allocator is free to move its
+// block, which lets my_heap_compact empty sparse pages and unmap them.
+// The handle table and compaction are guarded by the heap lock, so both
+// work alongside my_malloc/my_free on other threads.
+typedef uint64_t MyHandle; // generation << 32 | slot, 0 is never a valid handle
+
+typedef struct HandleEntry{
+    void* ptr;            // current location of the block, NULL if the slot is free
+    size_t size;
+    uint32_t generation;  // bumped on free so stale handles are rejected
+    uint32_t pin_count;
+    uint32_t next_free;   // free list of slots
+}HandleEntry;
+
+typedef struct MyCompactStats{
+    size_t pages_scanned;
+    size_t blocks_moved;
+    size_t bytes_moved;
+    size_t pages_released;
+    size_t bytes_reclaimed;
+    double pause_ms;
+}MyCompactStats;
+
+static HandleEntry* handle_table = NULL;
+static uint32_t handle_free_list = 0; // 0 means empty, slots start at 1
+static uint32_t handle_high_water = 0;
+
+static HandleEntry* handle_lookup(MyHandle handle) {
+    uint32_t slot = (uint32_t)handle;
+    if (handle_table == NULL || slot == 0 || slot > handle_high_water) {
+        return NULL;
+    }
+    HandleEntry* entry = &handle_table[slot];
+    if (entry->ptr == NULL || entry->generation != (uint32_t)(handle >> 32)) {
+        return NULL;
+    }
+    return entry;
 }
 
-MyBlockHeader* create_new_block(size_t size, MyPageHeader* page) {
-    if (page->free_mem < size + sizeof(MyBlockHeader)) {
-        return NULL;
+MyHandle my_handle_alloc(size_t size) {
+    // Allocated first, through my_malloc's profiling and tracing
+    void* ptr = my_malloc(size);
+    if (ptr == NULL) {
+        return 0;
     }
-    
-    // Find the end of existing blocks or start of page if no blocks exist
-    MyBlockHeader* current_block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
-    MyBlockHeader* last_block = NULL;
-    
-    // Find the last block or determine if this is the first block
-    while (current_block != NULL) {
-        //check page boundary
-        if(current_block>= (char*)page + page->size){
-            break;
+
+    heap_lock_acquire();
+    if (handle_table == NULL) {
+        void* table = mmap(NULL, HANDLE_MAX * sizeof(HandleEntry), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (table != MAP_FAILED) {
+            handle_table = table;
         }
-        last_block = current_block;
-        current_block = current_block->next;
     }
-    
-    // Calculate position for new block
-    char* new_block_pos;
-    if (last_block == NULL) {
-        // First block in the page
-        new_block_pos = (char*)page + sizeof(MyPageHeader);
-    } else {
-        // After the last block
-        new_block_pos = (char*)last_block + sizeof(MyBlockHeader) + last_block->size;
+    uint32_t slot = 0;
+    if (handle_table != NULL && handle_free_list != 0) {
+        slot = handle_free_list;
+        handle_free_list = handle_table[slot].next_free;
+    } else if (handle_table != NULL && handle_high_water + 1 < HANDLE_MAX) {
+        slot = ++handle_high_water;
     }
-    
-    MyBlockHeader* new_block = (MyBlockHeader*)new_block_pos;
-    new_block->size = size;
-    new_block->is_free = false;  // Mark as allocated
-    new_block->next = NULL;
-    
-    // Link the previous block to this new block
-    if (last_block != NULL) {
-        last_block->next = new_block;
+    if (slot == 0) {
+        // No table or out of handles
+        free_block(ptr);
+        heap_lock_release();
+        return 0;
     }
-    
-    // Update page free memory
-    page->free_mem -= (size + sizeof(MyBlockHeader));
-    
-    return new_block;
+
+    HandleEntry* entry = &handle_table[slot];
+    entry->ptr = ptr;
+    entry->size = size;
+    entry->pin_count = 0;
+    ((MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader)))->handle = slot;
+    MyHandle handle = ((MyHandle)entry->generation << 32) | slot;
+    heap_lock_release();
+    return handle;
 }
 
-MyPageHeader* create_new_page(size_t size) {
-    size_t needed_size = sizeof(MyPageHeader) + sizeof(MyBlockHeader) + size;
-    size_t pages_needed = (needed_size + PAGE_SIZE - 1) / PAGE_SIZE;
-    size_t total_size = pages_needed * PAGE_SIZE;
-    
-    void* new_mem = mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (new_mem == MAP_FAILED) {
-        return NULL;
+// Returns the block's current address and keeps it there until the matching
+// my_handle_unpin. Pins nest.
+void* my_handle_pin(MyHandle handle) {
+    heap_lock_acquire();
+    HandleEntry* entry = handle_lookup(handle);
+    void* ptr = NULL;
+    if (entry != NULL) {
+        entry->pin_count++;
+        ptr = entry->ptr;
     }
-    
-    MyPageHeader* new_page_header = (MyPageHeader*)new_mem;
-    new_page_header->size = total_size;
-    new_page_header->free_mem = total_size - sizeof(MyPageHeader);
-    new_page_header->next = NULL;
-    
-    // Link to existing pages
-    if (first_page == NULL) {
-        first_page = new_page_header;
-    } else {
-        MyPageHeader* current = first_page;
-        while (current->next != NULL) {
-            current = current->next;
-        }
-        current->next = new_page_header;
+    heap_lock_release();
+    if (entry == NULL) {
+        printf("Error: invalid handle %#llx\n", (unsigned long long)handle);
     }
-    
-    return new_page_header;
+    return ptr;
 }
 
-void* my_malloc(size_t size) {
-    if (size == 0) {
-        return NULL;
+void my_handle_unpin(MyHandle handle) {
+    heap_lock_acquire();
+    HandleEntry* entry = handle_lookup(handle);
+    bool valid = entry != NULL && entry->pin_count != 0;
+    if (valid) {
+        entry->pin_count--;
     }
-    
-    // Align size to minimum block size
-    if (size < BLOCK_SIZE) {
-        size = BLOCK_SIZE;
+    heap_lock_release();
+    if (!valid) {
+        printf("Error: unpin of invalid or unpinned handle %#llx\n", (unsigned long long)handle);
     }
-    
-    // Try to find a free block first
-    MyBlockHeader* block = find_free_block(size);
-    
-    if (block != NULL) {
-        block->is_free = false;
-        return (void*)((char*)block + sizeof(MyBlockHeader));
+}
+
+void my_handle_free(MyHandle handle) {
+    heap_lock_acquire();
+    HandleEntry* entry = handle_lookup(handle);
+    if (entry == NULL) {
+        heap_lock_release();
+        printf("Warning: Attempting to free invalid handle %#llx\n", (unsigned long long)handle);
+        return;
     }
-    
-    // No suitable free block found, need a new page
-    MyPageHeader* page = NULL;
-    
-    // Check if we can use an existing page
-    if (first_page != NULL) {
-        MyPageHeader* current_page = first_page;
-        while (current_page != NULL) {
-            if (current_page->free_mem >= size + sizeof(MyBlockHeader)) {
-                page = current_page;
-                break;
+    bool pinned = entry->pin_count != 0;
+    void* ptr = entry->ptr;
+    uint32_t slot = (uint32_t)handle;
+    entry->ptr = NULL;
+    entry->generation++;
+    entry->next_free = handle_free_list;
+    handle_free_list = slot;
+    free_block(ptr);
+    heap_lock_release();
+    if (pinned) {
+        printf("Warning: freeing handle %#llx while it is still pinned\n", (unsigned long long)handle);
+    }
+}
+
+// Bytes held by allocated blocks (headers included) and whether every one of
+// them is an unpinned handle block, i.e. whether the page can be emptied.
+// The caller holds the heap lock.
+static size_t page_used_bytes(MyPageHeader* page, bool* all_movable) {
+    size_t used = 0;
+    *all_movable = true;
+    if (page->free_mem == page->size - sizeof(MyPageHeader)) {
+        return 0;
+    }
+    MyBlockHeader* block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+    while (block != NULL && (char*)block < (char*)page + page->size - page->free_mem) {
+        if (!block->is_free) {
+            used += sizeof(MyBlockHeader) + block->size;
+            if (block->handle == 0 || handle_table[block->handle].pin_count != 0) {
+                *all_movable = false;
             }
-            current_page = current_page->next;
         }
+        block = block->next;
     }
-    
-    // Create new page if needed
-    if (page == NULL) {
-        page = create_new_page(size);
-        if (page == NULL) {
-            return NULL; // Out of memory
+    return used;
+}
+
+// Moves one handle block into `target`; returns false if it does not fit.
+// The caller holds the heap lock.
+static bool compact_move_block(MyBlockHeader* block, MyPageHeader* target, MyCompactStats* stats) {
+    MyBlockHeader* dest = find_free_block_in_page(block->size, target);
+    if (dest != NULL) {
+        dest->is_free = false;
+        split_block(dest, block->size);
+    } else {
+        dest = create_new_block(block->size, target);
+        if (dest == NULL) {
+            return false;
         }
     }
-    
-    // Create new block in the page
-    block = create_new_block(size, page);
-    if (block == NULL) {
-        return NULL;
+    page_index_update(target);
+
+    uint32_t slot = block->handle;
+    void* old_ptr = (char*)block + sizeof(MyBlockHeader);
+    void* new_ptr = (char*)dest + sizeof(MyBlockHeader);
+    my_memcpy(new_ptr, old_ptr, block->size);
+    dest->handle = slot;
+    handle_table[slot].ptr = new_ptr;
+    if (block->is_sampled) {
+        prof_move_sample(old_ptr, new_ptr);
     }
-    
-    return (void*)((char*)block + sizeof(MyBlockHeader));
+    TRACE(1, TRACE_COMPACT_MOVE, block->size, new_ptr, target);
+
+    stats->blocks_moved++;
+    stats->bytes_moved += block->size;
+
+    block->handle = 0;
+    free_block(old_ptr);
+    return true;
 }
 
-// Helper function to coalesce adjacent free blocks
-void coalesce_blocks(MyPageHeader* page) {
-    MyBlockHeader* current = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
-    
-    while (current != NULL && current->next != NULL) {
-        if (current->is_free && current->next->is_free) {
-            // Merge current block with next block
-            MyBlockHeader* next_block = current->next;
-            current->size += sizeof(MyBlockHeader) + next_block->size;
-            current->next = next_block->next;
-            
-            // Update page free memory (we're removing one block header)
-            page->free_mem += sizeof(MyBlockHeader);
-            
-            // Continue checking from current block (don't advance)
+typedef struct CompactTarget{
+    MyPageHeader* page;
+    size_t used_permille;  // share of the page's usable bytes in live blocks
+}CompactTarget;
+
+static int compact_by_density(const void* a, const void* b) {
+    size_t da = ((const CompactTarget*)a)->used_permille;
+    size_t db = ((const CompactTarget*)b)->used_permille;
+    return da > db ? -1 : da < db ? 1 : 0;
+}
+
+// Pages of the source's pool that are denser than the source, densest first,
+// in a scratch mapping the caller unmaps. Filling the dense pages keeps the
+// sparse ones emptying instead of taking in what compaction moves.
+static CompactTarget* compact_rank_targets(MyPageHeader* source, size_t source_used, size_t* count,
+                                           size_t* mapped) {
+    size_t pages = 0;
+    for (MyPageHeader* page = first_page; page != NULL; page = page->next) {
+        pages++;
+    }
+    *count = 0;
+    *mapped = (pages * sizeof(CompactTarget) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    CompactTarget* targets = mmap(NULL, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (targets == MAP_FAILED) {
+        return NULL;
+    }
+    size_t source_permille = source_used * 1000 / (source->size - sizeof(MyPageHeader));
+    for (MyPageHeader* page = first_page; page != NULL; page = page->next) {
+        if (page == source || page->pool != source->pool) {
             continue;
         }
-        current = current->next;
+        bool all_movable;
+        size_t permille = page_used_bytes(page, &all_movable) * 1000 / (page->size - sizeof(MyPageHeader));
+        if (permille > source_permille) {
+            targets[(*count)++] = (CompactTarget){ page, permille };
+        }
     }
+    qsort(targets, *count, sizeof(CompactTarget), compact_by_density);
+    return targets;
 }
 
-// Helper function to check if a page is completely free
-bool is_page_empty(MyPageHeader* page) {
-    MyBlockHeader* current = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
-    
-    // If free memory equals total memory minus page header, page is empty
-    if (page->free_mem == page->size - sizeof(MyPageHeader)) {
-        return true;
+// Relocates unpinned handle blocks out of sparse pages into denser ones and
+// unmaps the pages this empties. Only pages whose live blocks are all
+// unpinned handles are evacuated; anything else could not be emptied anyway.
+// Holds the heap lock for the whole pass, so other threads wait for it.
+MyCompactStats my_heap_compact(void) {
+    MyCompactStats stats;
+    memset(&stats, 0, sizeof(stats));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    heap_lock_acquire();
+
+    // Evacuate the sparsest candidate first, retry until nothing moves.
+    bool progress = true;
+    while (progress && handle_table != NULL) {
+        progress = false;
+        MyPageHeader* source = NULL;
+        size_t source_used = 0;
+
+        for (MyPageHeader* page = first_page; page != NULL; page = page->next) {
+            bool all_movable;
+            size_t used = page_used_bytes(page, &all_movable);
+            stats.pages_scanned++;
+            if (used == 0 || !all_movable ||
+                used * 100 >= (page->size - sizeof(MyPageHeader)) * COMPACT_SPARSE_PERCENT) {
+                continue;
+            }
+            if (source == NULL || used < source_used) {
+                source = page;
+                source_used = used;
+            }
+        }
+        if (source == NULL) {
+            break;
+        }
+
+        size_t target_count, targets_mapped;
+        CompactTarget* targets = compact_rank_targets(source, source_used, &target_count, &targets_mapped);
+        if (targets == NULL) {
+            break;
+        }
+
+        // Everything must fit elsewhere, otherwise moving would not free the page
+        size_t page_size = source->size;
+        MyBlockHeader* first_block = (MyBlockHeader*)((char*)source + sizeof(MyPageHeader));
+        MyBlockHeader* block = first_block;
+        bool emptied = true;
+        while (block != NULL && (char*)block < (char*)source + source->size - source->free_mem) {
+            if (block->is_free) {
+                block = block->next;
+                continue;
+            }
+            bool moved = false;
+            for (size_t t = 0; t < target_count && !moved; t++) {
+                moved = compact_move_block(block, targets[t].page, &stats);
+            }
+            if (!moved) {
+                emptied = false;
+                break;
+            }
+            // free_block may have unmapped the source page once it became empty
+            if (!page_address_contains(source)) {
+                stats.pages_released++;
+                stats.bytes_reclaimed += page_size;
+                progress = true;
+                break;
+            }
+            // The freed block may have merged with its neighbours, so its
+            // `next` is stale; walk the page again from the start
+            block = first_block;
+        }
+        munmap(targets, targets_mapped);
+        if (!emptied) {
+            break; // the remaining pages are too full to take the rest
+        }
     }
-    
-    // Check if all blocks are free
-    while (current != NULL && 
-           (char*)current < (char*)page + page->size - page->free_mem) {
-        if (!current->is_free) {
-            return false;
+    heap_lock_release();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats.pause_ms = (double)(end.tv_sec - start.tv_sec) * 1000.0 +
+                     (double)(end.tv_nsec - start.tv_nsec) / 1e6;
+    return stats;
+}
+
+void print_compact_stats(const MyCompactStats* stats) {
+    printf("Compaction: moved %zu blocks (%zu bytes), released %zu pages, "
+           "reclaimed %zu bytes, pause %.3f ms\n",
+           stats->blocks_moved, stats->bytes_moved, stats->pages_released,
+           stats->bytes_reclaimed, stats->pause_ms);
+}
+
+// Page occupancy per lifetime pool. A partial page holds both live blocks
+// and free space; those are the pages that fragmentation keeps mapped.
+void print_pool_usage(void) {
+    printf("\n=== Page Pools ===\n");
+    printf("%-12s %7s %7s %7s %12s %12s %9s\n",
+           "pool", "pages", "partial", "empty", "mapped", "live", "occupancy");
+
+    heap_lock_acquire();
+    for (int pool = 0; pool < MY_HINT_COUNT; pool++) {
+        size_t pages = 0, partial = 0, empty = 0, mapped = 0, live = 0;
+        for (MyPageHeader* page = first_page; page != NULL; page = page->next) {
+            if (page->pool != (MyAllocHint)pool) {
+                continue;
+            }
+            bool all_movable;
+            size_t used = page_used_bytes(page, &all_movable);
+            pages++;
+            mapped += page->size;
+            live += used;
+            if (used == 0) {
+                empty++;
+            } else if (used < page->size - sizeof(MyPageHeader)) {
+                partial++;
+            }
         }
-        current = current->next;
+        printf("%-12s %7zu %7zu %7zu %12zu %12zu %8.1f%%\n",
+               pool_policies[pool].name, pages, partial, empty, mapped, live,
+               mapped > 0 ? (double)live * 100.0 / (double)mapped : 0.0);
     }
-    return true;
+    heap_lock_release();
+    printf("Mapped now: %zu bytes, peak: %zu bytes\n", mapped_bytes, peak_mapped_bytes);
 }
 
-// Helper function to remove an empty page from the page list
-void remove_empty_page(MyPageHeader* page_to_remove) {
-    if (first_page == page_to_remove) {
-        // Removing the first page
-        first_page = page_to_remove->next;
-    } else {
-        // Find the previous page
-        MyPageHeader* prev = first_page;
-        while (prev != NULL && prev->next != page_to_remove) {
-            prev = prev->next;
+// ---- Heap walking and snapshots ----
+typedef struct MyHeapPageInfo{
+    void* address;
+    size_t size;
+    size_t free_mem;        // unallocated tail
+    size_t largest_free;
+    MyAllocHint pool;
+    size_t block_count;
+}MyHeapPageInfo;
+
+typedef struct MyHeapBlockInfo{
+    void* address;          // what my_malloc returned
+    size_t offset;          // of the block header from the page start
+    size_t size;
+    bool is_free;
+    bool is_handle;
+}MyHeapBlockInfo;
+
+typedef void (*MyHeapPageVisitor)(const MyHeapPageInfo* page, void* context);
+typedef void (*MyHeapBlockVisitor)(const MyHeapPageInfo* page, const MyHeapBlockInfo* block, void* context);
+
+// Calls `on_page` for every page and then `on_block` for each of its blocks,
+// in address order within the page. Either callback may be NULL. The heap
+// lock is held throughout, so callbacks must not call my_malloc or my_free.
+void my_heap_walk(MyHeapPageVisitor on_page, MyHeapBlockVisitor on_block, void* context) {
+    heap_lock_acquire();
+    for (MyPageHeader* page = first_page; page != NULL; page = page->next) {
+        MyBlockHeader* first_block = NULL;
+        char* blocks_end = (char*)page + page->size - page->free_mem;
+        if (page->free_mem != page->size - sizeof(MyPageHeader)) {
+            first_block = (MyBlockHeader*)((char*)page + sizeof(MyPageHeader));
+        }
+
+        MyHeapPageInfo page_info;
+        page_info.address = page;
+        page_info.size = page->size;
+        page_info.free_mem = page->free_mem;
+        page_info.largest_free = page->largest_free;
+        page_info.pool = page->pool;
+        page_info.block_count = 0;
+        for (MyBlockHeader* b = first_block; b != NULL && (char*)b < blocks_end; b = b->next) {
+            page_info.block_count++;
         }
-        if (prev != NULL) {
-            prev->next = page_to_remove->next;
+        if (on_page != NULL) {
+            on_page(&page_info, context);
+        }
+        if (on_block == NULL) {
+            continue;
+        }
+
+        for (MyBlockHeader* b = first_block; b != NULL && (char*)b < blocks_end; b = b->next) {
+            MyHeapBlockInfo block_info;
+            block_info.address = (char*)b + sizeof(MyBlockHeader);
+            block_info.offset = (size_t)((char*)b - (char*)page);
+            block_info.size = b->size;
+            block_info.is_free = b->is_free;
+            block_info.is_handle = b->handle != 0;
+            on_block(&page_info, &block_info, context);
         }
     }
-    
-    // Unmap the page from memory
-    munmap(page_to_remove, page_to_remove->size);
+    heap_lock_release();
 }
 
-void my_free(void* ptr) {
-    if (ptr == NULL) {
-        return;
-    }
-    
-    // Find the block header
-    MyBlockHeader* block = (MyBlockHeader*)((char*)ptr - sizeof(MyBlockHeader));
-    
-    // Validate that this is a valid allocated block
-    if (block->is_free) {
-        printf("Warning: Attempting to free already freed memory at %p\n", ptr);
-        return;
-    }
-    
-    // Find which page this block belongs to
-    MyPageHeader* current_page = first_page;
-    MyPageHeader* block_page = NULL;
-    
-    while (current_page != NULL) {
-        char* page_start = (char*)current_page;
-        char* page_end = page_start + current_page->size;
-        
-        if ((char*)block >= page_start && (char*)block < page_end) {
-            block_page = current_page;
-            break;
+// Snapshot records are gathered in a stack buffer and written out when it
+// fills up, so taking a snapshot never allocates from the heap it describes.
+typedef struct SnapshotWriter{
+    int fd;
+    bool failed;
+    size_t used;
+    char buffer[16384];
+}SnapshotWriter;
+
+static void snapshot_emit(SnapshotWriter* writer, const void* record, size_t size) {
+    if (writer->used + size > sizeof(writer->buffer)) {
+        if (!writer->failed && !prof_write_all(writer->fd, writer->buffer, writer->used)) {
+            writer->failed = true;
         }
-        current_page = current_page->next;
-    }
-    
-    if (block_page == NULL) {
-        printf("Error: Could not find page for block at %p\n", ptr);
-        return;
+        writer->used = 0;
     }
-    
-    printf("Freeing %zu bytes at %p (block header at %p)\n", block->size, ptr, (void*)block);
-    
-    // Mark block as free (DON'T update free_mem counter here - it's misleading)
-    // The free_mem represents unallocated space, not freed blocks
-    block->is_free = true;
-    
-    // Coalesce adjacent free blocks to reduce fragmentation
-    coalesce_blocks(block_page);
-    
-    // Check if the entire page is now free and can be returned to system
-    if (is_page_empty(block_page) && first_page != NULL && first_page->next != NULL) {
-        // Only remove page if it's not the last page (keep at least one page)
-        printf("Page is completely free, returning %zu bytes to system\n", block_page->size);
-        remove_empty_page(block_page);
+    memcpy(writer->buffer + writer->used, record, size);
+    writer->used += size;
+}
+
+static void snapshot_page(const MyHeapPageInfo* page, void* context) {
+    SnapshotPage record;
+    record.address = (uint64_t)(uintptr_t)page->address;
+    record.size = page->size;
+    record.free_mem = page->free_mem;
+    record.pool = (uint32_t)page->pool;
+    record.block_count = (uint32_t)page->block_count;
+    snapshot_emit(context, &record, sizeof(record));
+}
+
+static void snapshot_block(const MyHeapPageInfo* page, const MyHeapBlockInfo* block, void* context) {
+    (void)page;
+    SnapshotBlock record;
+    record.offset = block->offset;
+    record.size = block->size;
+    record.flags = (block->is_free ? SNAPSHOT_BLOCK_FREE : 0) | (block->is_handle ? SNAPSHOT_BLOCK_HANDLE : 0);
+    record.reserved = 0;
+    snapshot_emit(context, &record, sizeof(record));
+}
+
+// Streams a binary snapshot of every page and block to `fd` (format in
+// my_snapshot.h, analyze it with heap_analyze).
+bool my_heap_snapshot(int fd) {
+    SnapshotWriter writer;
+    writer.fd = fd;
+    writer.failed = false;
+    writer.used = 0;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.page_header_size = sizeof(MyPageHeader);
+    header.block_header_size = sizeof(MyBlockHeader);
+    snapshot_emit(&writer, &header, sizeof(header));
+
+    my_heap_walk(snapshot_page, snapshot_block, &writer);
+    if (!writer.failed && !prof_write_all(fd, writer.buffer, writer.used)) {
+        writer.failed = true;
     }
+    return !writer.failed;
 }
 
 // Function to print detailed memory usage statistics
@@ -398,6 +3362,8 @@ void print_memory_usage() {
     printf("=============================\n\n");
 }
 
+#ifndef MY_MALLOC_NO_MAIN
+// Build with -DMY_MALLOC_NO_MAIN to link the allocator into other programs
 int main() {
     printf("=== Testing Custom Memory Allocator ===\n\n");
     
@@ -446,6 +3412,8 @@ int main() {
     my_free(ptr3);
     my_free(ptr4);
     print_memory_usage();
+
+    printf("Allocating SIZE_MAX bytes: %s\n", my_malloc(SIZE_MAX) == NULL ? "NULL" : "NOT NULL");
     
     // Test double free detection
     printf("Testing double free detection...\n");
@@ -465,5 +3433,195 @@ int main() {
         printf("String '%s' comes before '%s' lexically\n", s_1, s_2);
     }
     
+    // Test guard-page sampling (every allocation sampled)
+    printf("\n=== Testing Guard-Page Sampling ===\n");
+    my_malloc_set_guard_sample_rate(1);
+    char* guarded = my_malloc(40);
+    printf("Guarded ptr: %p (%zu bytes left before the guard page)\n",
+           (void*)guarded, (size_t)(PAGE_SIZE - ((uintptr_t)guarded % PAGE_SIZE)));
+    memset(guarded, 'A', 40);
+    // guarded[48] = 'X'; // Should fault: heap-buffer-overflow
+    my_free(guarded);
+    // guarded[0] = 'X'; // Should fault: use-after-free
+    my_malloc_set_guard_sample_rate(0);
+    
+    // Test the heap profiler (sample roughly every 4 KB)
+    printf("\n=== Testing Heap Profiler ===\n");
+    my_heap_profile_start(4096);
+    void* kept[64];
+    for (int i = 0; i < 64; i++) {
+        kept[i] = my_malloc(1024);
+    }
+    for (int i = 0; i < 64; i += 2) {
+        my_free(kept[i]);
+    }
+    int profile_fd = open("heap.prof", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (profile_fd >= 0) {
+        my_heap_profile_dump(profile_fd);
+        close(profile_fd);
+        printf("Heap profile written to heap.prof (view with: pprof <binary> heap.prof)\n");
+    }
+    my_heap_profile_stop();
+    for (int i = 1; i < 64; i += 2) {
+        my_free(kept[i]);
+    }
+    
+    // Test compaction: fill pages with handles, free most of them, compact
+    printf("\n=== Testing Heap Compaction ===\n");
+    MyHandle handles[96];
+    for (int i = 0; i < 96; i++) {
+        handles[i] = my_handle_alloc(200);
+        char* data = my_handle_pin(handles[i]);
+        snprintf(data, 200, "handle %d", i);
+        my_handle_unpin(handles[i]);
+    }
+    for (int i = 0; i < 96; i++) {
+        if (i % 6 != 0) {
+            my_handle_free(handles[i]);
+        }
+    }
+    MyCompactStats stats = my_heap_compact();
+    print_compact_stats(&stats);
+    for (int i = 0; i < 96; i += 6) {
+        char* data = my_handle_pin(handles[i]);
+        printf("Still intact after compaction: %s\n", data);
+        my_handle_unpin(handles[i]);
+        my_handle_free(handles[i]);
+    }
+    
+    // Test lifetime hints: each hint lands in its own page pool
+    printf("\n=== Testing Lifetime Hints ===\n");
+    void* cache_entry = my_malloc_hint(96, MY_HINT_LONG_LIVED);
+    void* request_buffer = my_malloc_hint(512, MY_HINT_SHORT_LIVED);
+    void* bulk_buffer = my_malloc_hint(64 * 1024, MY_HINT_BULK);
+    print_pool_usage();
+
+    // Snapshot the heap for offline analysis
+    int snapshot_fd = open("heap.snap", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (snapshot_fd >= 0) {
+        my_heap_snapshot(snapshot_fd);
+        close(snapshot_fd);
+        printf("Heap snapshot written to heap.snap (analyze with: ./heap_analyze heap.snap)\n");
+    }
+    my_free(request_buffer);
+    my_free(bulk_buffer);
+    my_free(cache_entry);
+
+    // Test in-place growth: a block at the end of its page takes over the tail,
+    // one in front of a live block cannot grow until that block is freed
+    printf("\n=== Testing In-Place Growth ===\n");
+    char* growing = my_malloc(100);
+    strcpy(growing, "still here");
+    printf("Usable size of a 100 byte block: %zu\n", my_usable_size(growing));
+    size_t grown = my_try_expand(growing, 1000, 2000);
+    printf("Expanded at the page end to %zu bytes, same address: %s\n", grown, growing);
+    void* neighbour = my_malloc(500);
+    printf("Expand with a live neighbour: %zu (0 means it would have to move)\n",
+           my_try_expand(growing, 4000, 4000));
+    my_free(neighbour);
+    printf("Expand after the neighbour is freed: %zu\n", my_try_expand(growing, 2400, 2400));
+    my_free(growing);
+
+    // Test auto-tuning: a workload of mostly 64 KB objects gets coarser size
+    // classes and bigger chunks, then the defaults are restored
+    printf("\n=== Testing Auto-Tuning ===\n");
+    MyMallocConfig defaults;
+    my_malloc_get_config(&defaults);
+    MyMallocConfig tuned = defaults;
+    tuned.auto_tune = true;
+    my_malloc_set_config(&tuned);
+    for (int i = 0; i < TUNE_SAMPLE_EVERY * TUNE_WINDOW; i++) {
+        my_free(my_malloc(60 * 1024 + (size_t)(i % 7) * 1024));
+    }
+    print_malloc_config();
+    my_malloc_set_config(&defaults);
+
+    // Test realloc and calloc on top of the bulk memory kernels
+    printf("\n=== Testing my_realloc / my_calloc (%s kernels) ===\n", my_memory_impl_name());
+    int* numbers = my_calloc(1000, sizeof(int));
+    int zeroes = 0;
+    for (int i = 0; i < 1000; i++) {
+        zeroes += numbers[i] == 0;
+        numbers[i] = i;
+    }
+    void* behind = my_malloc(64); // takes the space behind numbers, so growing has to move it
+    numbers = my_realloc(numbers, 100000 * sizeof(int));
+    printf("calloc'd ints that were zero: %d, numbers[999] after realloc: %d\n", zeroes, numbers[999]);
+    printf("Oversized realloc keeps the block: %s, oversized calloc: %s\n",
+           my_realloc(numbers, SIZE_MAX - BLOCK_SIZE) == NULL && numbers[999] == 999 ? "yes" : "no",
+           my_calloc(SIZE_MAX / 2, 2) == NULL && my_calloc(1, SIZE_MAX) == NULL ? "NULL" : "NOT NULL");
+    my_free(numbers);
+    my_free(behind);
+
+    // Test the page reserve: warm it up, then new pages come from it without mmap
+    printf("\n=== Testing Page Reserve ===\n");
+    my_malloc_reserve(64 * PAGE_SIZE);
+    void* from_reserve = my_malloc_hint(8 * PAGE_SIZE, MY_HINT_BULK);
+    printf("Reserve served %zu page(s), %zu bytes still ready\n",
+           reserve_pages_served, atomic_load(&reserve_bytes));
+    my_free(from_reserve);
+
+    printf("\n=== Testing Memory Pressure ===\n");
+    // A stand-in cgroup: a directory with memory.max and memory.current
+    char cgroup_dir[] = "/tmp/my_malloc_cgroupXXXXXX";
+    if (mkdtemp(cgroup_dir) != NULL) {
+        char cgroup_file[64];
+        snprintf(cgroup_file, sizeof(cgroup_file), "%s/memory.max", cgroup_dir);
+        int max_fd = open(cgroup_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dprintf(max_fd, "%d\n", 100 << 20);
+        close(max_fd);
+        snprintf(cgroup_file, sizeof(cgroup_file), "%s/memory.current", cgroup_dir);
+
+        int current_fd = open(cgroup_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dprintf(current_fd, "%d\n", 50 << 20);
+        close(current_fd);
+        my_malloc_set_cgroup_dir(cgroup_dir);
+        void* retained = my_malloc_hint(PAGE_SIZE, MY_HINT_SHORT_LIVED);
+        void* long_lived = my_malloc_hint(64, MY_HINT_LONG_LIVED);
+        my_free(retained); // the short-lived pool keeps its empty page
+        printf("At 50%% of the limit: %zu short-lived page(s) mapped\n", pool_page_count[MY_HINT_SHORT_LIVED]);
+
+        current_fd = open(cgroup_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dprintf(current_fd, "%d\n", 95 << 20);
+        close(current_fd);
+        my_malloc_check_pressure();
+        printf("At 95%% of the limit: %zu short-lived page(s) mapped\n", pool_page_count[MY_HINT_SHORT_LIVED]);
+        void* borrowed = my_malloc_hint(64, MY_HINT_SHORT_LIVED); // fits on the long-lived page
+        print_pressure_state();
+        my_free(borrowed);
+        my_free(long_lived);
+
+        my_malloc_set_cgroup_dir(NULL);
+        unlink(cgroup_file);
+        snprintf(cgroup_file, sizeof(cgroup_file), "%s/memory.max", cgroup_dir);
+        unlink(cgroup_file);
+        rmdir(cgroup_dir);
+    }
+
+    printf("\n=== Testing Allocation Caches (%s) ===\n", my_cache_mode_name());
+    void* cached[100];
+    for (int i = 0; i < 100; i++) {
+        cached[i] = my_cache_malloc(48);
+    }
+    for (int i = 0; i < 100; i++) {
+        my_cache_free(cached[i]);
+    }
+    void* reused = my_cache_malloc(40); // same class, straight from the cache
+    printf("Cache handed back %s block, %zu bytes usable\n",
+           reused == cached[99] ? "the last freed" : "another", my_usable_size(reused));
+    my_cache_free(reused);
+    my_cache_flush();
+
+#if MY_TRACE_LEVEL > 0
+    // Decode with: ./trace_decode alloc.trace
+    int trace_fd = open("alloc.trace", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd >= 0) {
+        my_trace_dump(trace_fd);
+        close(trace_fd);
+        printf("\nAllocator trace written to alloc.trace\n");
+    }
+#endif
+    
     return 0;
-}
\ No newline at end of file
+}
+#endif
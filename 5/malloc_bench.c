@@ -0,0 +1,185 @@
+// Micro-benchmarks for the allocator in "malloc copy.c".
+//
+// Build: gcc -O2 malloc_bench.c -o malloc_bench
+// Usage: ./malloc_bench [pages]
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define MY_MALLOC_NO_MAIN
+#include "malloc copy.c"
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// Fills `pages` pages with one block each, leaving no room anywhere, then
+// times small allocations that have to get past all of those full pages.
+static void bench_miss_path(size_t pages) {
+    size_t fill_size = PAGE_SIZE - sizeof(MyPageHeader) - sizeof(MyBlockHeader);
+    void** fillers = malloc(pages * sizeof(void*));
+    if (fillers == NULL) {
+        return;
+    }
+
+    double start = now_ns();
+    for (size_t i = 0; i < pages; i++) {
+        fillers[i] = my_malloc(fill_size);
+    }
+    double fill_ns = now_ns() - start;
+
+    enum { SMALL_ALLOCS = 1000 };
+    void* small[SMALL_ALLOCS];
+    start = now_ns();
+    for (int i = 0; i < SMALL_ALLOCS; i++) {
+        small[i] = my_malloc(64);
+    }
+    double miss_ns = now_ns() - start;
+
+    printf("Miss path with %zu full pages:\n", pages);
+    printf("  filling pages:        %10.1f ns/alloc\n", fill_ns / (double)pages);
+    printf("  64 byte allocations:  %10.1f ns/alloc\n", miss_ns / SMALL_ALLOCS);
+
+    for (int i = 0; i < SMALL_ALLOCS; i++) {
+        my_free(small[i]);
+    }
+    for (size_t i = 0; i < pages; i++) {
+        my_free(fillers[i]);
+    }
+    free(fillers);
+}
+
+// Replays a server-like mix: every request allocates a few buffers that die
+// a few requests later, now and then a big bulk buffer, and sometimes a cache
+// entry that lives until the end. With `use_hints` the same sequence goes
+// through my_malloc_hint instead of my_malloc.
+static void replay_mixed_workload(bool use_hints, size_t requests) {
+    enum { BUFFERS_PER_REQUEST = 6, IN_FLIGHT = 8 };
+    void* in_flight[IN_FLIGHT][BUFFERS_PER_REQUEST] = {{0}};
+    void** cache = malloc(requests * sizeof(void*));
+    size_t cache_entries = 0;
+    uint64_t rng = 42;
+    if (cache == NULL) {
+        return;
+    }
+
+    for (size_t r = 0; r < requests; r++) {
+        void** slot = in_flight[r % IN_FLIGHT];
+        for (int b = 0; b < BUFFERS_PER_REQUEST; b++) {
+            my_free(slot[b]);
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t size = 64 + (size_t)(rng >> 33) % 2048;
+            slot[b] = use_hints ? my_malloc_hint(size, MY_HINT_SHORT_LIVED) : my_malloc(size);
+        }
+        if (r % 64 == 0) {
+            size_t size = 64 * 1024 + (size_t)(rng >> 40) % (192 * 1024);
+            void* bulk = use_hints ? my_malloc_hint(size, MY_HINT_BULK) : my_malloc(size);
+            my_free(bulk);
+        }
+        if (r % 4 == 0) {
+            size_t size = 32 + (size_t)(rng >> 45) % 224;
+            cache[cache_entries++] = use_hints ? my_malloc_hint(size, MY_HINT_LONG_LIVED) : my_malloc(size);
+        }
+    }
+    for (int i = 0; i < IN_FLIGHT; i++) {
+        for (int b = 0; b < BUFFERS_PER_REQUEST; b++) {
+            my_free(in_flight[i][b]);
+        }
+    }
+
+    // Only the cache entries are alive now
+    printf("\nReplay of %zu requests %s lifetime hints:", requests, use_hints ? "with" : "without");
+    print_pool_usage();
+    free(cache);
+}
+
+// Runs the replay in a child so both variants start from an empty heap.
+static void bench_lifetime_hints(size_t requests) {
+    for (int use_hints = 0; use_hints <= 1; use_hints++) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            peak_mapped_bytes = mapped_bytes; // don't report the parent's peak
+            replay_mixed_workload(use_hints, requests);
+            fflush(stdout);
+            _exit(0);
+        }
+        if (child > 0) {
+            waitpid(child, NULL, 0);
+        }
+    }
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Times every my_malloc of a growing heap, where about one allocation in
+// four needs a new page, with and without the pre-mapped page reserve. The
+// slow tail is the allocations that hit mmap and first-touch page faults.
+// Allocations come in requests of 16 with a short wait between requests,
+// which is when the refill thread gets to run.
+static void bench_page_reserve(size_t allocs) {
+    for (int use_reserve = 0; use_reserve <= 1; use_reserve++) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child != 0) {
+            if (child > 0) {
+                waitpid(child, NULL, 0);
+            }
+            continue;
+        }
+
+        double* latency = malloc(allocs * sizeof(double));
+        if (latency == NULL) {
+            _exit(1);
+        }
+        if (use_reserve) {
+            MyMallocConfig config;
+            my_malloc_get_config(&config);
+            config.reserve_watermark = 32 * 1024 * 1024;
+            config.reserve_region_size = 1024 * 1024;
+            my_malloc_set_config(&config);
+            my_malloc_reserve(32 * 1024 * 1024); // startup warm-up
+        }
+
+        uint64_t rng = 7;
+        for (size_t i = 0; i < allocs; i++) {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t size = 512 + (size_t)(rng >> 33) % 1536;
+            double start = now_ns();
+            char* p = my_malloc(size);
+            latency[i] = now_ns() - start;
+            p[0] = 1; // the caller touches the memory right away
+            if (i % 16 == 15) {
+                struct timespec wait = { 0, 50 * 1000 };
+                nanosleep(&wait, NULL);
+            }
+        }
+
+        qsort(latency, allocs, sizeof(double), compare_doubles);
+        printf("\nAllocation latency %s the page reserve (%zu allocs):\n",
+               use_reserve ? "with" : "without", allocs);
+        printf("  p50 %8.0f ns   p99 %8.0f ns   p99.9 %8.0f ns   max %10.0f ns\n",
+               latency[allocs / 2], latency[allocs * 99 / 100], latency[allocs * 999 / 1000],
+               latency[allocs - 1]);
+        if (use_reserve) {
+            printf("  %zu pages came from the reserve\n", reserve_pages_served);
+        }
+        fflush(stdout);
+        _exit(0);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    size_t pages = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+
+    printf("=== Allocator Benchmarks ===\n");
+    bench_miss_path(pages);
+    bench_lifetime_hints(20000);
+    bench_page_reserve(100000);
+    return 0;
+}
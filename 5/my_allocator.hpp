@@ -0,0 +1,176 @@
+// C++ adapters for the allocator in "malloc copy.c".
+//
+//   my_alloc::MyMemoryResource   std::pmr::memory_resource over my_malloc/my_free
+//   my_alloc::MyAllocator<T>     std::allocator compatible, for plain containers
+//   global operator new/delete   define MY_ALLOCATOR_REPLACE_GLOBAL_NEW in exactly
+//                                one translation unit before including this
+//
+// Link against the allocator compiled as C, without its demo main:
+//   gcc -O2 -c -DMY_MALLOC_NO_MAIN "malloc copy.c" -o my_malloc.o
+//   g++ -O2 -std=c++17 your_program.cpp my_malloc.o
+//
+// my_malloc and my_free serialize on the allocator's heap lock, so the
+// adapters can be used from several threads.
+#ifndef MY_ALLOCATOR_HPP
+#define MY_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+extern "C" {
+void* my_malloc(size_t size);
+void my_free(void* ptr);
+}
+
+namespace my_alloc {
+
+// my_malloc hands out BLOCK_SIZE (16) aligned pointers; anything stricter is
+// over-allocated and the original pointer is stored right before the result.
+inline constexpr std::size_t kNaturalAlignment = 16;
+
+inline void* allocate_aligned(std::size_t bytes, std::size_t alignment) {
+    if (bytes == 0) {
+        bytes = 1; // my_malloc(0) is NULL, but C++ wants a unique pointer
+    }
+    if (alignment <= kNaturalAlignment) {
+        return my_malloc(bytes);
+    }
+    if (bytes > std::numeric_limits<std::size_t>::max() - alignment - sizeof(void*)) {
+        return nullptr;
+    }
+    void* raw = my_malloc(bytes + alignment + sizeof(void*));
+    if (raw == nullptr) {
+        return nullptr;
+    }
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+    std::uintptr_t aligned = (start + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+    reinterpret_cast<void**>(aligned)[-1] = raw;
+    return reinterpret_cast<void*>(aligned);
+}
+
+inline void deallocate_aligned(void* ptr, std::size_t alignment) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (alignment <= kNaturalAlignment) {
+        my_free(ptr);
+    } else {
+        my_free(static_cast<void**>(ptr)[-1]);
+    }
+}
+
+class MyMemoryResource : public std::pmr::memory_resource {
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        void* ptr = allocate_aligned(bytes, alignment);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    // The allocator finds the block size in its header, so `bytes` is unused
+    void do_deallocate(void* ptr, std::size_t, std::size_t alignment) override {
+        deallocate_aligned(ptr, alignment);
+    }
+
+    // There is one heap, so every instance can free what another allocated
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return dynamic_cast<const MyMemoryResource*>(&other) != nullptr;
+    }
+};
+
+inline MyMemoryResource* my_memory_resource() noexcept {
+    static MyMemoryResource resource;
+    return &resource;
+}
+
+template <class T>
+class MyAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    MyAllocator() noexcept = default;
+    template <class U>
+    MyAllocator(const MyAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void* ptr = allocate_aligned(n * sizeof(T), alignof(T));
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    // Sized deallocation: the size is known to the allocator already
+    void deallocate(T* ptr, std::size_t) noexcept {
+        deallocate_aligned(ptr, alignof(T));
+    }
+};
+
+template <class T, class U>
+bool operator==(const MyAllocator<T>&, const MyAllocator<U>&) noexcept { return true; }
+template <class T, class U>
+bool operator!=(const MyAllocator<T>&, const MyAllocator<U>&) noexcept { return false; }
+
+} // namespace my_alloc
+
+#ifdef MY_ALLOCATOR_REPLACE_GLOBAL_NEW
+// Replacement global operator new/delete. The unaligned forms rely on
+// my_malloc's 16 byte alignment, which matches __STDCPP_DEFAULT_NEW_ALIGNMENT__
+// on the 64-bit targets we build for.
+static_assert(__STDCPP_DEFAULT_NEW_ALIGNMENT__ <= my_alloc::kNaturalAlignment,
+              "my_malloc alignment is below the default new alignment");
+
+void* operator new(std::size_t size) {
+    void* ptr = my_alloc::allocate_aligned(size, my_alloc::kNaturalAlignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return my_alloc::allocate_aligned(size, my_alloc::kNaturalAlignment);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return my_alloc::allocate_aligned(size, my_alloc::kNaturalAlignment);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    void* ptr = my_alloc::allocate_aligned(size, static_cast<std::size_t>(alignment));
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return ::operator new(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept { my_free(ptr); }
+void operator delete[](void* ptr) noexcept { my_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { my_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { my_free(ptr); }
+void operator delete(void* ptr, std::align_val_t alignment) noexcept {
+    my_alloc::deallocate_aligned(ptr, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept {
+    my_alloc::deallocate_aligned(ptr, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+    my_alloc::deallocate_aligned(ptr, static_cast<std::size_t>(alignment));
+}
+void operator delete[](void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+    my_alloc::deallocate_aligned(ptr, static_cast<std::size_t>(alignment));
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+// Growable byte buffer on the allocator in "malloc copy.c". Before it falls
+// back to allocate-copy-free, it asks my_try_expand to grow the block where
+// it is. The counters show how often that worked.
+//
+// Either include this after "malloc copy.c", or link the allocator built
+// with -DMY_MALLOC_NO_MAIN.
+#ifndef MY_BUFFER_H
+#define MY_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "my_memory.h"
+
+void* my_malloc(size_t size);
+void my_free(void* ptr);
+size_t my_usable_size(void* ptr);
+size_t my_try_expand(void* ptr, size_t min_size, size_t preferred_size);
+
+typedef struct MyBuffer{
+    char* data;
+    size_t length;
+    size_t capacity;
+    size_t grown_in_place;  // growths my_try_expand satisfied
+    size_t grown_by_copy;   // growths that had to move the data
+    size_t bytes_copied;
+}MyBuffer;
+
+static inline void my_buffer_init(MyBuffer* buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static inline void my_buffer_free(MyBuffer* buffer) {
+    my_free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+// Makes room for at least `min_capacity` bytes. Aims for double the current
+// capacity, in place if the allocator can, and only copies otherwise.
+static inline bool my_buffer_reserve(MyBuffer* buffer, size_t min_capacity) {
+    if (min_capacity <= buffer->capacity) {
+        return true;
+    }
+    size_t preferred = buffer->capacity * 2;
+    if (preferred < min_capacity) {
+        preferred = min_capacity;
+    }
+
+    if (buffer->data != NULL) {
+        size_t expanded = my_try_expand(buffer->data, min_capacity, preferred);
+        if (expanded != 0) {
+            buffer->capacity = expanded;
+            buffer->grown_in_place++;
+            return true;
+        }
+    }
+
+    char* data = my_malloc(preferred);
+    if (data == NULL) {
+        return false;
+    }
+    if (buffer->data != NULL) {
+        my_memcpy(data, buffer->data, buffer->length);
+        my_free(buffer->data);
+        buffer->grown_by_copy++;
+        buffer->bytes_copied += buffer->length;
+    }
+    buffer->data = data;
+    buffer->capacity = my_usable_size(data);
+    return true;
+}
+
+static inline bool my_buffer_append(MyBuffer* buffer, const void* bytes, size_t size) {
+    if (size > buffer->capacity - buffer->length &&
+        (buffer->length + size < buffer->length || !my_buffer_reserve(buffer, buffer->length + size))) {
+        return false;
+    }
+    my_memcpy(buffer->data + buffer->length, bytes, size);
+    buffer->length += size;
+    return true;
+}
+
+#endif
@@ -0,0 +1,572 @@
+// Bulk memory kernels: my_memcpy, my_memmove and my_memset.
+//
+// A constructor picks the widest implementation the CPU supports: AVX2
+// (32 byte vectors), SSE2 (16 byte vectors) or a portable word-at-a-time
+// loop. Every version moves the unaligned head and tail with two overlapping
+// accesses and runs its main loop on an aligned destination. Copies and
+// fills bigger than the last-level cache use non-temporal stores, so that
+// one huge copy does not push everything else out of the cache.
+//
+// Header-only like my_buffer.h, so a program that includes "malloc copy.c"
+// needs nothing extra. Each translation unit gets its own dispatch.
+#ifndef MY_MEMORY_H
+#define MY_MEMORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Used when the last-level cache size cannot be queried
+#define MEM_DEFAULT_NT_THRESHOLD (8u * 1024 * 1024)
+
+typedef void* (*MyMemcpyFn)(void* dst, const void* src, size_t n);
+typedef void* (*MyMemsetFn)(void* dst, int c, size_t n);
+
+static size_t mem_nt_threshold = MEM_DEFAULT_NT_THRESHOLD;
+
+// ---- Fixed-size unaligned accesses; the compiler turns these into single moves ----
+static inline uint64_t mem_load64(const unsigned char* p) { uint64_t v; __builtin_memcpy(&v, p, 8); return v; }
+static inline uint32_t mem_load32(const unsigned char* p) { uint32_t v; __builtin_memcpy(&v, p, 4); return v; }
+static inline uint16_t mem_load16(const unsigned char* p) { uint16_t v; __builtin_memcpy(&v, p, 2); return v; }
+static inline void mem_store64(unsigned char* p, uint64_t v) { __builtin_memcpy(p, &v, 8); }
+static inline void mem_store32(unsigned char* p, uint32_t v) { __builtin_memcpy(p, &v, 4); }
+static inline void mem_store16(unsigned char* p, uint16_t v) { __builtin_memcpy(p, &v, 2); }
+
+// Copies n < 16 bytes. Everything is loaded before anything is stored, so
+// the ranges may overlap.
+static inline void mem_copy_small(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n >= 8) {
+        uint64_t head = mem_load64(s), tail = mem_load64(s + n - 8);
+        mem_store64(d, head);
+        mem_store64(d + n - 8, tail);
+    } else if (n >= 4) {
+        uint32_t head = mem_load32(s), tail = mem_load32(s + n - 4);
+        mem_store32(d, head);
+        mem_store32(d + n - 4, tail);
+    } else if (n >= 2) {
+        uint16_t head = mem_load16(s), tail = mem_load16(s + n - 2);
+        mem_store16(d, head);
+        mem_store16(d + n - 2, tail);
+    } else if (n == 1) {
+        *d = *s;
+    }
+}
+
+// Fills n < 16 bytes with the byte repeated in `pattern`
+static inline void mem_set_small(unsigned char* d, uint64_t pattern, size_t n) {
+    if (n >= 8) {
+        mem_store64(d, pattern);
+        mem_store64(d + n - 8, pattern);
+    } else if (n >= 4) {
+        mem_store32(d, (uint32_t)pattern);
+        mem_store32(d + n - 4, (uint32_t)pattern);
+    } else if (n >= 2) {
+        mem_store16(d, (uint16_t)pattern);
+        mem_store16(d + n - 2, (uint16_t)pattern);
+    } else if (n == 1) {
+        *d = (unsigned char)pattern;
+    }
+}
+
+// ---- Word at a time (any CPU) ----
+// Front to back. Safe when dst is below src, even if they overlap: each
+// store only lands on source bytes that have been read already.
+static void mem_copy_forward_swar(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n < 16) {
+        mem_copy_small(d, s, n);
+        return;
+    }
+    uint64_t head = mem_load64(s), tail = mem_load64(s + n - 8);
+    size_t i = 8 - ((uintptr_t)d & 7);
+    for (; i + 32 <= n; i += 32) {
+        uint64_t a = mem_load64(s + i), b = mem_load64(s + i + 8);
+        uint64_t c = mem_load64(s + i + 16), e = mem_load64(s + i + 24);
+        mem_store64(d + i, a);
+        mem_store64(d + i + 8, b);
+        mem_store64(d + i + 16, c);
+        mem_store64(d + i + 24, e);
+    }
+    for (; i + 8 <= n; i += 8) {
+        mem_store64(d + i, mem_load64(s + i));
+    }
+    mem_store64(d + n - 8, tail);
+    mem_store64(d, head);
+}
+
+// Back to front, for dst above an overlapping src
+static void mem_copy_backward_swar(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n < 16) {
+        mem_copy_small(d, s, n);
+        return;
+    }
+    uint64_t head = mem_load64(s), tail = mem_load64(s + n - 8);
+    size_t misalign = (uintptr_t)(d + n) & 7;
+    size_t i = n - (misalign != 0 ? misalign : 8);
+    for (; i >= 32; i -= 32) {
+        uint64_t a = mem_load64(s + i - 32), b = mem_load64(s + i - 24);
+        uint64_t c = mem_load64(s + i - 16), e = mem_load64(s + i - 8);
+        mem_store64(d + i - 8, e);
+        mem_store64(d + i - 16, c);
+        mem_store64(d + i - 24, b);
+        mem_store64(d + i - 32, a);
+    }
+    for (; i >= 8; i -= 8) {
+        mem_store64(d + i - 8, mem_load64(s + i - 8));
+    }
+    mem_store64(d, head);
+    mem_store64(d + n - 8, tail);
+}
+
+static void* memcpy_swar(void* dst, const void* src, size_t n) {
+    mem_copy_forward_swar(dst, src, n);
+    return dst;
+}
+
+static void* memmove_swar(void* dst, const void* src, size_t n) {
+    if ((uintptr_t)dst - (uintptr_t)src >= n) {
+        mem_copy_forward_swar(dst, src, n);
+    } else {
+        mem_copy_backward_swar(dst, src, n);
+    }
+    return dst;
+}
+
+static void* memset_swar(void* dst, int c, size_t n) {
+    unsigned char* d = dst;
+    uint64_t pattern = (uint64_t)(unsigned char)c * 0x0101010101010101ULL;
+    if (n < 16) {
+        mem_set_small(d, pattern, n);
+        return dst;
+    }
+    mem_store64(d, pattern);
+    mem_store64(d + n - 8, pattern);
+    size_t i = 8 - ((uintptr_t)d & 7);
+    for (; i + 32 <= n; i += 32) {
+        mem_store64(d + i, pattern);
+        mem_store64(d + i + 8, pattern);
+        mem_store64(d + i + 16, pattern);
+        mem_store64(d + i + 24, pattern);
+    }
+    for (; i + 8 <= n; i += 8) {
+        mem_store64(d + i, pattern);
+    }
+    return dst;
+}
+
+#if defined(__x86_64__)
+// ---- SSE2, 16 byte vectors ----
+// The vector loops start at a cache-line aligned destination; chunks that
+// straddle lines run up to twice slower once the copy spills out of L1.
+
+// Copies 16 to 64 bytes, loading everything before storing
+__attribute__((target("sse2")))
+static inline void mem_copy_16_64_sse2(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n <= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + n - 16));
+        _mm_storeu_si128((__m128i*)d, a);
+        _mm_storeu_si128((__m128i*)(d + n - 16), b);
+    } else {
+        __m128i a = _mm_loadu_si128((const __m128i*)s);
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + n - 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + n - 16));
+        _mm_storeu_si128((__m128i*)d, a);
+        _mm_storeu_si128((__m128i*)(d + 16), b);
+        _mm_storeu_si128((__m128i*)(d + n - 32), c);
+        _mm_storeu_si128((__m128i*)(d + n - 16), e);
+    }
+}
+
+__attribute__((target("sse2")))
+static void mem_copy_forward_sse2(unsigned char* d, const unsigned char* s, size_t n, bool stream) {
+    if (n < 16) {
+        mem_copy_small(d, s, n);
+        return;
+    }
+    if (n <= 64) {
+        mem_copy_16_64_sse2(d, s, n);
+        return;
+    }
+    __m128i h0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i h1 = _mm_loadu_si128((const __m128i*)(s + 16));
+    __m128i h2 = _mm_loadu_si128((const __m128i*)(s + 32));
+    __m128i h3 = _mm_loadu_si128((const __m128i*)(s + 48));
+    __m128i tail = _mm_loadu_si128((const __m128i*)(s + n - 16));
+    size_t i = 64 - ((uintptr_t)d & 63);
+    if (stream) {
+        for (; i + 64 <= n; i += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(s + i + 32));
+            __m128i e = _mm_loadu_si128((const __m128i*)(s + i + 48));
+            _mm_stream_si128((__m128i*)(d + i), a);
+            _mm_stream_si128((__m128i*)(d + i + 16), b);
+            _mm_stream_si128((__m128i*)(d + i + 32), c);
+            _mm_stream_si128((__m128i*)(d + i + 48), e);
+        }
+        _mm_sfence();
+    }
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + i + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + i + 48));
+        _mm_store_si128((__m128i*)(d + i), a);
+        _mm_store_si128((__m128i*)(d + i + 16), b);
+        _mm_store_si128((__m128i*)(d + i + 32), c);
+        _mm_store_si128((__m128i*)(d + i + 48), e);
+    }
+    for (; i + 16 <= n; i += 16) {
+        _mm_store_si128((__m128i*)(d + i), _mm_loadu_si128((const __m128i*)(s + i)));
+    }
+    _mm_storeu_si128((__m128i*)(d + n - 16), tail);
+    _mm_storeu_si128((__m128i*)d, h0);
+    _mm_storeu_si128((__m128i*)(d + 16), h1);
+    _mm_storeu_si128((__m128i*)(d + 32), h2);
+    _mm_storeu_si128((__m128i*)(d + 48), h3);
+}
+
+__attribute__((target("sse2")))
+static void mem_copy_backward_sse2(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n < 16) {
+        mem_copy_small(d, s, n);
+        return;
+    }
+    if (n <= 64) {
+        mem_copy_16_64_sse2(d, s, n);
+        return;
+    }
+    __m128i head = _mm_loadu_si128((const __m128i*)s);
+    __m128i t0 = _mm_loadu_si128((const __m128i*)(s + n - 64));
+    __m128i t1 = _mm_loadu_si128((const __m128i*)(s + n - 48));
+    __m128i t2 = _mm_loadu_si128((const __m128i*)(s + n - 32));
+    __m128i t3 = _mm_loadu_si128((const __m128i*)(s + n - 16));
+    size_t misalign = (uintptr_t)(d + n) & 63;
+    size_t i = n - (misalign != 0 ? misalign : 64);
+    for (; i >= 64; i -= 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s + i - 64));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i - 48));
+        __m128i c = _mm_loadu_si128((const __m128i*)(s + i - 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(s + i - 16));
+        _mm_store_si128((__m128i*)(d + i - 16), e);
+        _mm_store_si128((__m128i*)(d + i - 32), c);
+        _mm_store_si128((__m128i*)(d + i - 48), b);
+        _mm_store_si128((__m128i*)(d + i - 64), a);
+    }
+    for (; i >= 16; i -= 16) {
+        _mm_store_si128((__m128i*)(d + i - 16), _mm_loadu_si128((const __m128i*)(s + i - 16)));
+    }
+    _mm_storeu_si128((__m128i*)d, head);
+    _mm_storeu_si128((__m128i*)(d + n - 64), t0);
+    _mm_storeu_si128((__m128i*)(d + n - 48), t1);
+    _mm_storeu_si128((__m128i*)(d + n - 32), t2);
+    _mm_storeu_si128((__m128i*)(d + n - 16), t3);
+}
+
+__attribute__((target("sse2")))
+static void* memcpy_sse2(void* dst, const void* src, size_t n) {
+    mem_copy_forward_sse2(dst, src, n, n >= mem_nt_threshold);
+    return dst;
+}
+
+__attribute__((target("sse2")))
+static void* memmove_sse2(void* dst, const void* src, size_t n) {
+    uintptr_t distance = (uintptr_t)dst - (uintptr_t)src;
+    if (distance >= n) {
+        // Streaming only when the ranges are disjoint
+        mem_copy_forward_sse2(dst, src, n, n >= mem_nt_threshold && (uintptr_t)src - (uintptr_t)dst >= n);
+    } else {
+        mem_copy_backward_sse2(dst, src, n);
+    }
+    return dst;
+}
+
+__attribute__((target("sse2")))
+static void* memset_sse2(void* dst, int c, size_t n) {
+    unsigned char* d = dst;
+    if (n < 16) {
+        mem_set_small(d, (uint64_t)(unsigned char)c * 0x0101010101010101ULL, n);
+        return dst;
+    }
+    __m128i v = _mm_set1_epi8((char)c);
+    _mm_storeu_si128((__m128i*)d, v);
+    _mm_storeu_si128((__m128i*)(d + n - 16), v);
+    if (n <= 32) {
+        return dst;
+    }
+    _mm_storeu_si128((__m128i*)(d + 16), v);
+    _mm_storeu_si128((__m128i*)(d + n - 32), v);
+    if (n <= 64) {
+        return dst;
+    }
+    _mm_storeu_si128((__m128i*)(d + 32), v);
+    _mm_storeu_si128((__m128i*)(d + 48), v);
+    size_t i = 64 - ((uintptr_t)d & 63);
+    if (n >= mem_nt_threshold) {
+        for (; i + 64 <= n; i += 64) {
+            _mm_stream_si128((__m128i*)(d + i), v);
+            _mm_stream_si128((__m128i*)(d + i + 16), v);
+            _mm_stream_si128((__m128i*)(d + i + 32), v);
+            _mm_stream_si128((__m128i*)(d + i + 48), v);
+        }
+        _mm_sfence();
+    }
+    for (; i + 64 <= n; i += 64) {
+        _mm_store_si128((__m128i*)(d + i), v);
+        _mm_store_si128((__m128i*)(d + i + 16), v);
+        _mm_store_si128((__m128i*)(d + i + 32), v);
+        _mm_store_si128((__m128i*)(d + i + 48), v);
+    }
+    for (; i + 16 <= n; i += 16) {
+        _mm_store_si128((__m128i*)(d + i), v);
+    }
+    return dst;
+}
+
+// ---- AVX2, 32 byte vectors ----
+// Copies 32 to 128 bytes, loading everything before storing
+__attribute__((target("avx2")))
+static inline void mem_copy_32_128_avx2(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n <= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)s);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+        _mm256_storeu_si256((__m256i*)d, a);
+        _mm256_storeu_si256((__m256i*)(d + n - 32), b);
+    } else {
+        __m256i a = _mm256_loadu_si256((const __m256i*)s);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s + n - 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+        _mm256_storeu_si256((__m256i*)d, a);
+        _mm256_storeu_si256((__m256i*)(d + 32), b);
+        _mm256_storeu_si256((__m256i*)(d + n - 64), c);
+        _mm256_storeu_si256((__m256i*)(d + n - 32), e);
+    }
+}
+
+__attribute__((target("avx2")))
+static void mem_copy_forward_avx2(unsigned char* d, const unsigned char* s, size_t n, bool stream) {
+    if (n < 32) {
+        mem_copy_forward_sse2(d, s, n, false);
+        return;
+    }
+    if (n <= 128) {
+        mem_copy_32_128_avx2(d, s, n);
+        return;
+    }
+    __m256i h0 = _mm256_loadu_si256((const __m256i*)s);
+    __m256i h1 = _mm256_loadu_si256((const __m256i*)(s + 32));
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+    size_t i = 64 - ((uintptr_t)d & 63);
+    if (stream) {
+        for (; i + 128 <= n; i += 128) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(s + i + 32));
+            __m256i c = _mm256_loadu_si256((const __m256i*)(s + i + 64));
+            __m256i e = _mm256_loadu_si256((const __m256i*)(s + i + 96));
+            _mm256_stream_si256((__m256i*)(d + i), a);
+            _mm256_stream_si256((__m256i*)(d + i + 32), b);
+            _mm256_stream_si256((__m256i*)(d + i + 64), c);
+            _mm256_stream_si256((__m256i*)(d + i + 96), e);
+        }
+        _mm_sfence();
+    }
+    for (; i + 128 <= n; i += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s + i + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(s + i + 96));
+        _mm256_store_si256((__m256i*)(d + i), a);
+        _mm256_store_si256((__m256i*)(d + i + 32), b);
+        _mm256_store_si256((__m256i*)(d + i + 64), c);
+        _mm256_store_si256((__m256i*)(d + i + 96), e);
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm256_store_si256((__m256i*)(d + i), _mm256_loadu_si256((const __m256i*)(s + i)));
+    }
+    _mm256_storeu_si256((__m256i*)(d + n - 32), tail);
+    _mm256_storeu_si256((__m256i*)d, h0);
+    _mm256_storeu_si256((__m256i*)(d + 32), h1);
+}
+
+__attribute__((target("avx2")))
+static void mem_copy_backward_avx2(unsigned char* d, const unsigned char* s, size_t n) {
+    if (n < 32) {
+        mem_copy_backward_sse2(d, s, n);
+        return;
+    }
+    if (n <= 128) {
+        mem_copy_32_128_avx2(d, s, n);
+        return;
+    }
+    __m256i head = _mm256_loadu_si256((const __m256i*)s);
+    __m256i t0 = _mm256_loadu_si256((const __m256i*)(s + n - 64));
+    __m256i t1 = _mm256_loadu_si256((const __m256i*)(s + n - 32));
+    size_t misalign = (uintptr_t)(d + n) & 63;
+    size_t i = n - (misalign != 0 ? misalign : 64);
+    for (; i >= 128; i -= 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s + i - 128));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + i - 96));
+        __m256i c = _mm256_loadu_si256((const __m256i*)(s + i - 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(s + i - 32));
+        _mm256_store_si256((__m256i*)(d + i - 32), e);
+        _mm256_store_si256((__m256i*)(d + i - 64), c);
+        _mm256_store_si256((__m256i*)(d + i - 96), b);
+        _mm256_store_si256((__m256i*)(d + i - 128), a);
+    }
+    for (; i >= 32; i -= 32) {
+        _mm256_store_si256((__m256i*)(d + i - 32), _mm256_loadu_si256((const __m256i*)(s + i - 32)));
+    }
+    _mm256_storeu_si256((__m256i*)d, head);
+    _mm256_storeu_si256((__m256i*)(d + n - 64), t0);
+    _mm256_storeu_si256((__m256i*)(d + n - 32), t1);
+}
+
+__attribute__((target("avx2")))
+static void* memcpy_avx2(void* dst, const void* src, size_t n) {
+    mem_copy_forward_avx2(dst, src, n, n >= mem_nt_threshold);
+    return dst;
+}
+
+__attribute__((target("avx2")))
+static void* memmove_avx2(void* dst, const void* src, size_t n) {
+    uintptr_t distance = (uintptr_t)dst - (uintptr_t)src;
+    if (distance >= n) {
+        mem_copy_forward_avx2(dst, src, n, n >= mem_nt_threshold && (uintptr_t)src - (uintptr_t)dst >= n);
+    } else {
+        mem_copy_backward_avx2(dst, src, n);
+    }
+    return dst;
+}
+
+__attribute__((target("avx2")))
+static void* memset_avx2(void* dst, int c, size_t n) {
+    unsigned char* d = dst;
+    if (n < 32) {
+        return memset_sse2(dst, c, n);
+    }
+    __m256i v = _mm256_set1_epi8((char)c);
+    _mm256_storeu_si256((__m256i*)d, v);
+    _mm256_storeu_si256((__m256i*)(d + n - 32), v);
+    if (n <= 64) {
+        return dst;
+    }
+    _mm256_storeu_si256((__m256i*)(d + 32), v);
+    _mm256_storeu_si256((__m256i*)(d + n - 64), v);
+    if (n <= 128) {
+        return dst;
+    }
+    size_t i = 64 - ((uintptr_t)d & 63);
+    if (n >= mem_nt_threshold) {
+        for (; i + 128 <= n; i += 128) {
+            _mm256_stream_si256((__m256i*)(d + i), v);
+            _mm256_stream_si256((__m256i*)(d + i + 32), v);
+            _mm256_stream_si256((__m256i*)(d + i + 64), v);
+            _mm256_stream_si256((__m256i*)(d + i + 96), v);
+        }
+        _mm_sfence();
+    }
+    for (; i + 128 <= n; i += 128) {
+        _mm256_store_si256((__m256i*)(d + i), v);
+        _mm256_store_si256((__m256i*)(d + i + 32), v);
+        _mm256_store_si256((__m256i*)(d + i + 64), v);
+        _mm256_store_si256((__m256i*)(d + i + 96), v);
+    }
+    for (; i + 32 <= n; i += 32) {
+        _mm256_store_si256((__m256i*)(d + i), v);
+    }
+    return dst;
+}
+#endif
+
+// ---- Runtime dispatch ----
+typedef struct MyMemoryImpl{
+    const char* name;
+    MyMemcpyFn memcpy_fn;
+    MyMemcpyFn memmove_fn;
+    MyMemsetFn memset_fn;
+}MyMemoryImpl;
+
+// Widest first
+static const MyMemoryImpl mem_impls[] = {
+#if defined(__x86_64__)
+    { "avx2", memcpy_avx2, memmove_avx2, memset_avx2 },
+    { "sse2", memcpy_sse2, memmove_sse2, memset_sse2 },
+#endif
+    { "swar", memcpy_swar, memmove_swar, memset_swar },
+};
+#define MEM_IMPL_COUNT (sizeof(mem_impls) / sizeof(mem_impls[0]))
+
+// The word loop until mem_detect_impl runs, so calls from other
+// constructors still work; after that the pointers only change through
+// my_memory_select.
+static const MyMemoryImpl* mem_impl = &mem_impls[MEM_IMPL_COUNT - 1];
+static MyMemcpyFn mem_memcpy_fn = memcpy_swar;
+static MyMemcpyFn mem_memmove_fn = memmove_swar;
+static MyMemsetFn mem_memset_fn = memset_swar;
+
+static bool mem_impl_supported(const MyMemoryImpl* impl) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (impl->memcpy_fn == memcpy_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (impl->memcpy_fn == memcpy_sse2) {
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    (void)impl;
+    return true;
+}
+
+// Forces one implementation ("avx2", "sse2" or "swar"), or the best one for
+// NULL. Returns false if the CPU does not support it. Meant for benchmarks
+// and tests; normal code just calls my_memcpy and friends.
+static inline bool my_memory_select(const char* name) {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (llc > 0) {
+        mem_nt_threshold = (size_t)llc;
+    }
+#endif
+    for (size_t i = 0; i < MEM_IMPL_COUNT; i++) {
+        const MyMemoryImpl* impl = &mem_impls[i];
+        bool wanted = name == NULL || __builtin_strcmp(name, impl->name) == 0;
+        if (wanted && mem_impl_supported(impl)) {
+            mem_memcpy_fn = impl->memcpy_fn;
+            mem_memmove_fn = impl->memmove_fn;
+            mem_memset_fn = impl->memset_fn;
+            mem_impl = impl;
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline const char* my_memory_impl_name(void) {
+    return mem_impl->name;
+}
+
+__attribute__((constructor)) static void mem_detect_impl(void) {
+    my_memory_select(NULL);
+}
+
+// Same contracts as memcpy, memmove and memset
+static inline void* my_memcpy(void* dst, const void* src, size_t n) {
+    return mem_memcpy_fn(dst, src, n);
+}
+
+static inline void* my_memmove(void* dst, const void* src, size_t n) {
+    return mem_memmove_fn(dst, src, n);
+}
+
+static inline void* my_memset(void* dst, int c, size_t n) {
+    return mem_memset_fn(dst, c, n);
+}
+
+#endif
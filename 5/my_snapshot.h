@@ -0,0 +1,38 @@
+// Binary heap snapshot format, shared by my_heap_snapshot in "malloc copy.c"
+// (the writer) and heap_analyze.c (the reader).
+//
+// A snapshot is one SnapshotHeader, then for every page a SnapshotPage
+// followed by its block_count SnapshotBlocks, until end of file.
+#ifndef MY_SNAPSHOT_H
+#define MY_SNAPSHOT_H
+
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "MYHEAP02"  // 02: 64-bit block offsets
+
+#define SNAPSHOT_BLOCK_FREE    0x1u
+#define SNAPSHOT_BLOCK_HANDLE  0x2u  // movable, owned by a handle
+
+typedef struct SnapshotHeader{
+    char magic[8];
+    uint32_t page_header_size;   // sizeof(MyPageHeader) of the writer
+    uint32_t block_header_size;  // sizeof(MyBlockHeader) of the writer
+}SnapshotHeader;
+
+typedef struct SnapshotPage{
+    uint64_t address;
+    uint64_t size;
+    uint64_t free_mem;           // unallocated tail
+    uint32_t pool;               // MyAllocHint
+    uint32_t block_count;
+}SnapshotPage;
+
+typedef struct SnapshotBlock{
+    uint64_t offset;             // of the block header from the page start;
+                                 // bulk and huge pages can pass 4 GiB
+    uint64_t size;               // user bytes, header not included
+    uint32_t flags;              // SNAPSHOT_BLOCK_*
+    uint32_t reserved;           // zero
+}SnapshotBlock;
+
+#endif
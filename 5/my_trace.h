@@ -0,0 +1,58 @@
+// Binary allocator trace format, shared by "malloc copy.c" (the writer)
+// and trace_decode.c (the reader).
+//
+// A dump is one TraceFileHeader followed by TraceRecords. Records of all
+// threads are written ring by ring, oldest first within each thread.
+#ifndef MY_TRACE_H
+#define MY_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "MYTRACE1"
+
+typedef enum TraceEventType{
+    TRACE_MALLOC = 1,
+    TRACE_FREE,
+    TRACE_PAGE_MAP,
+    TRACE_PAGE_UNMAP,
+    TRACE_GUARD_ALLOC,
+    TRACE_GUARD_FREE,
+    TRACE_COMPACT_MOVE,
+    TRACE_EXPAND,
+    TRACE_PRESSURE_ON,     // size is the cgroup's memory usage
+    TRACE_PRESSURE_OFF,
+    TRACE_EVENT_COUNT
+}TraceEventType;
+
+typedef struct TraceRecord{
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC
+    uint64_t addr;         // user pointer, 0 if not applicable
+    uint64_t page;         // page header address, 0 if unknown
+    uint64_t size;
+    uint32_t type;         // TraceEventType
+    uint32_t thread;       // order in which threads first traced
+}TraceRecord;
+
+typedef struct TraceFileHeader{
+    char magic[8];
+    uint32_t record_size;  // sizeof(TraceRecord) of the writer
+    uint32_t thread_count;
+}TraceFileHeader;
+
+static inline const char* trace_event_name(uint32_t type) {
+    switch (type) {
+        case TRACE_MALLOC:       return "malloc";
+        case TRACE_FREE:         return "free";
+        case TRACE_PAGE_MAP:     return "page_map";
+        case TRACE_PAGE_UNMAP:   return "page_unmap";
+        case TRACE_GUARD_ALLOC:  return "guard_alloc";
+        case TRACE_GUARD_FREE:   return "guard_free";
+        case TRACE_COMPACT_MOVE: return "compact_move";
+        case TRACE_EXPAND:       return "expand";
+        case TRACE_PRESSURE_ON:  return "pressure_on";
+        case TRACE_PRESSURE_OFF: return "pressure_off";
+        default:                 return "unknown";
+    }
+}
+
+#endif
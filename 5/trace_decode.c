@@ -0,0 +1,109 @@
+// Turns a binary allocator trace (see my_trace.h, written by my_trace_dump
+// in "malloc copy.c") into readable text, merged across threads by time.
+//
+// Usage: ./trace_decode alloc.trace
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "my_trace.h"
+
+static int compare_by_time(const void* a, const void* b) {
+    const TraceRecord* ra = a;
+    const TraceRecord* rb = b;
+    if (ra->timestamp_ns != rb->timestamp_ns) {
+        return ra->timestamp_ns < rb->timestamp_ns ? -1 : 1;
+    }
+    return (int)ra->thread - (int)rb->thread;
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "%s: not an allocator trace\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+    if (header.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: record size %u, this decoder expects %zu\n",
+                argv[1], header.record_size, sizeof(TraceRecord));
+        fclose(file);
+        return 1;
+    }
+
+    // Read every record, growing the buffer as we go
+    size_t count = 0;
+    size_t capacity = 4096;
+    TraceRecord* records = malloc(capacity * sizeof(TraceRecord));
+    while (records != NULL) {
+        if (count == capacity) {
+            capacity *= 2;
+            TraceRecord* grown = realloc(records, capacity * sizeof(TraceRecord));
+            if (grown == NULL) {
+                free(records);
+                records = NULL;
+                break;
+            }
+            records = grown;
+        }
+        size_t got = fread(records + count, sizeof(TraceRecord), capacity - count, file);
+        count += got;
+        if (got == 0) {
+            break;
+        }
+    }
+    fclose(file);
+    if (records == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    qsort(records, count, sizeof(TraceRecord), compare_by_time);
+
+    size_t per_type[TRACE_EVENT_COUNT] = {0};
+    size_t bytes_per_type[TRACE_EVENT_COUNT] = {0};
+    uint64_t start = count > 0 ? records[0].timestamp_ns : 0;
+
+    for (size_t i = 0; i < count; i++) {
+        TraceRecord* r = &records[i];
+        printf("%12.3f us  T%-3u %-12s size=%-8llu",
+               (double)(r->timestamp_ns - start) / 1000.0, r->thread,
+               trace_event_name(r->type), (unsigned long long)r->size);
+        if (r->addr != 0) {
+            printf(" addr=0x%llx", (unsigned long long)r->addr);
+        }
+        if (r->page != 0) {
+            printf(" page=0x%llx", (unsigned long long)r->page);
+        }
+        printf("\n");
+
+        if (r->type < TRACE_EVENT_COUNT) {
+            per_type[r->type]++;
+            bytes_per_type[r->type] += r->size;
+        }
+    }
+
+    printf("\n=== Trace Summary ===\n");
+    printf("%zu events from %u threads\n", count, header.thread_count);
+    for (uint32_t type = 1; type < TRACE_EVENT_COUNT; type++) {
+        if (per_type[type] > 0) {
+            printf("  %-12s %8zu events, %10zu bytes\n",
+                   trace_event_name(type), per_type[type], bytes_per_type[type]);
+        }
+    }
+
+    free(records);
+    return 0;
+}